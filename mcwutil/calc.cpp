@@ -5,37 +5,6 @@
 
 namespace mcwutil::calc {
 namespace {
-/**
- * \brief Divides two integers, rounding the quotient towards negative
- * infinity.
- *
- * \param[in] num the numerator.
- *
- * \param[in] den the denominator.
- *
- * \return the quotient.
- */
-int divfloor(int num, int den) {
-	return (num < 0 ? num - (den - 1) : num) / den;
-}
-
-/**
- * \brief Computes the mathematical modulus of two integers.
- *
- * \param[in] num the numerator.
- *
- * \param[in] den the denominator, which must be positive.
- *
- * \return the nonnegative modulus of \p num divided by \p den.
- */
-int real_mod(int num, int den) {
-	num %= den;
-	if(num < 0) {
-		num += den;
-	}
-	return num;
-}
-
 /**
  * \brief Converts a user-provided string to an integer.
  *
@@ -108,3 +77,34 @@ int mcwutil::calc::coord(std::string_view appname, std::span<char *> args) {
 	std::cout << "The pointer to the chunk data is found at index " << offset << " within the pointer array in the anvil file header.\n";
 	return 0;
 }
+
+/**
+ * \brief Divides two integers, rounding the quotient towards negative
+ * infinity.
+ *
+ * \param[in] num the numerator.
+ *
+ * \param[in] den the denominator.
+ *
+ * \return the quotient.
+ */
+int mcwutil::calc::divfloor(int num, int den) {
+	return (num < 0 ? num - (den - 1) : num) / den;
+}
+
+/**
+ * \brief Computes the mathematical modulus of two integers.
+ *
+ * \param[in] num the numerator.
+ *
+ * \param[in] den the denominator, which must be positive.
+ *
+ * \return the nonnegative modulus of \p num divided by \p den.
+ */
+int mcwutil::calc::real_mod(int num, int den) {
+	num %= den;
+	if(num < 0) {
+		num += den;
+	}
+	return num;
+}
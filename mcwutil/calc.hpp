@@ -10,6 +10,8 @@ namespace mcwutil {
  */
 namespace calc {
 int coord(std::string_view appname, std::span<char *> args);
+int divfloor(int num, int den);
+int real_mod(int num, int den);
 }
 }
 
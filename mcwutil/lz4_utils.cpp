@@ -0,0 +1,184 @@
+#include <mcwutil/lz4_utils.hpp>
+#include <mcwutil/util/hash.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <lz4.h>
+#include <stdexcept>
+#include <string_view>
+
+using namespace std::literals::string_view_literals;
+
+namespace mcwutil::lz4 {
+namespace {
+/**
+ * \brief The magic number at the start of every block.
+ */
+constexpr std::string_view MAGIC = "LZ4Block"sv;
+
+/**
+ * \brief The size of a block header: magic number, token, compressed length,
+ * uncompressed length, and checksum.
+ */
+constexpr std::size_t HEADER_SIZE = 8 + 1 + 4 + 4 + 4;
+
+/**
+ * \brief The token method bits for a block stored uncompressed.
+ */
+constexpr uint8_t METHOD_RAW = 0x10;
+
+/**
+ * \brief The token method bits for an LZ4-compressed block.
+ */
+constexpr uint8_t METHOD_LZ4 = 0x20;
+
+/**
+ * \brief The base-2 logarithm of the block size used when compressing.
+ */
+constexpr unsigned int BLOCK_SIZE_LOG2 = 16;
+
+/**
+ * \brief The seed for the XXH32 checksum of each block’s uncompressed data.
+ */
+constexpr uint32_t CHECKSUM_SEED = 0x9747B28C;
+
+/**
+ * \brief Encodes a little-endian 32-bit integer to a byte array.
+ *
+ * \param[out] b the buffer into which to encode.
+ *
+ * \param[in] x the integer to encode.
+ */
+void encode_le32(uint8_t *b, uint32_t x) {
+	for(std::size_t i = 0; i != 4; ++i) {
+		b[i] = static_cast<uint8_t>(x);
+		x >>= 8;
+	}
+}
+
+/**
+ * \brief Extracts a little-endian 32-bit integer from a data buffer.
+ *
+ * \param[in] b the data to extract from.
+ *
+ * \return the integer.
+ */
+uint32_t decode_le32(const uint8_t *b) {
+	return static_cast<uint32_t>(b[0]) | static_cast<uint32_t>(b[1]) << 8 | static_cast<uint32_t>(b[2]) << 16 | static_cast<uint32_t>(b[3]) << 24;
+}
+
+/**
+ * \brief Computes the checksum stored in a block header.
+ *
+ * \param[in] data the uncompressed block contents.
+ *
+ * \return the checksum, which is the XXH32 hash truncated to 28 bits.
+ */
+uint32_t checksum(std::span<const uint8_t> data) {
+	return hash::xxh32(data, CHECKSUM_SEED) & 0x0FFFFFFF;
+}
+
+/**
+ * \brief Appends a block header to a buffer.
+ *
+ * \param[in, out] output the buffer to append to.
+ *
+ * \param[in] method the compression method.
+ *
+ * \param[in] compressed_length the length of the stored block data.
+ *
+ * \param[in] uncompressed_length the length of the original block data.
+ *
+ * \param[in] check the checksum of the original block data.
+ */
+void append_header(std::vector<uint8_t> &output, uint8_t method, uint32_t compressed_length, uint32_t uncompressed_length, uint32_t check) {
+	std::size_t pos = output.size();
+	output.resize(pos + HEADER_SIZE);
+	std::copy(MAGIC.begin(), MAGIC.end(), &output[pos]);
+	output[pos + 8] = static_cast<uint8_t>(method | (BLOCK_SIZE_LOG2 - 10));
+	encode_le32(&output[pos + 9], compressed_length);
+	encode_le32(&output[pos + 13], uncompressed_length);
+	encode_le32(&output[pos + 17], check);
+}
+}
+}
+
+/**
+ * \brief Compresses an in-memory buffer into an LZ4 block stream.
+ *
+ * \param[in] input the data to compress.
+ *
+ * \return the compressed data, including the terminating empty block.
+ */
+std::vector<uint8_t> mcwutil::lz4::compress_buffer(std::span<const uint8_t> input) {
+	constexpr std::size_t block_size = std::size_t{1} << BLOCK_SIZE_LOG2;
+	std::vector<uint8_t> output;
+	output.reserve(input.size() + (input.size() / block_size + 2) * HEADER_SIZE);
+	std::vector<uint8_t> compressed(static_cast<std::size_t>(LZ4_compressBound(static_cast<int>(block_size))));
+	for(std::size_t pos = 0; pos < input.size(); pos += block_size) {
+		std::span<const uint8_t> block = input.subspan(pos, std::min(block_size, input.size() - pos));
+		int compressed_length = LZ4_compress_default(reinterpret_cast<const char *>(block.data()), reinterpret_cast<char *>(compressed.data()), static_cast<int>(block.size()), static_cast<int>(compressed.size()));
+		if(compressed_length <= 0) {
+			throw std::logic_error("Internal error: LZ4_compress_default failed.");
+		}
+		if(static_cast<std::size_t>(compressed_length) < block.size()) {
+			append_header(output, METHOD_LZ4, static_cast<uint32_t>(compressed_length), static_cast<uint32_t>(block.size()), checksum(block));
+			output.insert(output.end(), compressed.begin(), compressed.begin() + compressed_length);
+		} else {
+			append_header(output, METHOD_RAW, static_cast<uint32_t>(block.size()), static_cast<uint32_t>(block.size()), checksum(block));
+			output.insert(output.end(), block.begin(), block.end());
+		}
+	}
+	append_header(output, METHOD_RAW, 0, 0, 0);
+	return output;
+}
+
+/**
+ * \brief Decompresses an in-memory LZ4 block stream.
+ *
+ * \param[in] input the stream to decompress.
+ *
+ * \return the decompressed data.
+ *
+ * \exception std::runtime_error if the stream is malformed or a checksum does
+ * not match.
+ */
+std::vector<uint8_t> mcwutil::lz4::decompress_buffer(std::span<const uint8_t> input) {
+	std::vector<uint8_t> output;
+	for(;;) {
+		if(input.size() < HEADER_SIZE || !std::equal(MAGIC.begin(), MAGIC.end(), input.begin())) {
+			throw std::runtime_error("LZ4: malformed block header.");
+		}
+		uint8_t method = input[8] & 0xF0;
+		std::size_t max_length = std::size_t{1} << (10 + (input[8] & 0x0F));
+		uint32_t compressed_length = decode_le32(&input[9]);
+		uint32_t uncompressed_length = decode_le32(&input[13]);
+		uint32_t check = decode_le32(&input[17]);
+		input = input.subspan(HEADER_SIZE);
+		if(uncompressed_length > max_length || (!uncompressed_length != !compressed_length) || compressed_length > input.size()) {
+			throw std::runtime_error("LZ4: malformed block header.");
+		}
+		if(!uncompressed_length) {
+			// An empty block terminates the stream.
+			return output;
+		}
+		std::size_t pos = output.size();
+		output.resize(pos + uncompressed_length);
+		if(method == METHOD_RAW) {
+			if(compressed_length != uncompressed_length) {
+				throw std::runtime_error("LZ4: malformed block header.");
+			}
+			std::copy(input.begin(), input.begin() + compressed_length, &output[pos]);
+		} else if(method == METHOD_LZ4) {
+			int rc = LZ4_decompress_safe(reinterpret_cast<const char *>(input.data()), reinterpret_cast<char *>(&output[pos]), static_cast<int>(compressed_length), static_cast<int>(uncompressed_length));
+			if(rc < 0 || static_cast<uint32_t>(rc) != uncompressed_length) {
+				throw std::runtime_error("LZ4: malformed block data.");
+			}
+		} else {
+			throw std::runtime_error("LZ4: unrecognized compression method.");
+		}
+		if(checksum(std::span(output).subspan(pos)) != check) {
+			throw std::runtime_error("LZ4: checksum mismatch.");
+		}
+		input = input.subspan(compressed_length);
+	}
+}
@@ -0,0 +1,22 @@
+#ifndef LZ4_UTILS_H
+#define LZ4_UTILS_H
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace mcwutil {
+/**
+ * \brief Symbols related to the LZ4 block stream format used for chunks.
+ *
+ * This is the framing written by lz4-java’s \c LZ4BlockOutputStream, which is
+ * what Minecraft uses for compression type 4, rather than the standard LZ4
+ * frame format.
+ */
+namespace lz4 {
+std::vector<uint8_t> compress_buffer(std::span<const uint8_t> input);
+std::vector<uint8_t> decompress_buffer(std::span<const uint8_t> input);
+}
+}
+
+#endif
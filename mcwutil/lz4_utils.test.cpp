@@ -0,0 +1,150 @@
+#include <mcwutil/lz4_utils.hpp>
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+namespace mcwutil::lz4 {
+namespace {
+/**
+ * \brief Verifies that LZ4 block streams are read and written properly.
+ */
+class lz4_test final : public CppUnit::TestFixture {
+	public:
+	CPPUNIT_TEST_SUITE(lz4_test);
+	CPPUNIT_TEST(test_round_trip);
+	CPPUNIT_TEST(test_known_compressed);
+	CPPUNIT_TEST(test_known_raw);
+	CPPUNIT_TEST(test_bad_checksum);
+	CPPUNIT_TEST(test_bad_magic);
+	CPPUNIT_TEST(test_truncated);
+	CPPUNIT_TEST_SUITE_END();
+
+	private:
+	void test_round_trip();
+	void test_known_compressed();
+	void test_known_raw();
+	void test_bad_checksum();
+	void test_bad_magic();
+	void test_truncated();
+};
+
+/**
+ * \brief The block stream that lz4-java’s \c LZ4BlockOutputStream writes for
+ * 64 copies of the letter “a”.
+ *
+ * The single block is LZ4-compressed, with a 64 KiB block size, and the
+ * stream ends with an empty raw block.
+ */
+const std::vector<uint8_t> known_compressed = {
+	// Magic, token (LZ4, 64 KiB), compressed length 11, uncompressed length
+	// 64, checksum.
+	'L', 'Z', '4', 'B', 'l', 'o', 'c', 'k', 0x26, 0x0B, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00, 0x00, 0x23, 0xF0, 0xF6, 0x0F,
+	// One literal, a match of 58 at distance 1, and five final literals.
+	0x1F, 'a', 0x01, 0x00, 0x27, 0x50, 'a', 'a', 'a', 'a', 'a',
+	// Terminating empty block.
+	'L', 'Z', '4', 'B', 'l', 'o', 'c', 'k', 0x16, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+/**
+ * \brief The block stream that lz4-java’s \c LZ4BlockOutputStream writes for
+ * the string “Hello, World!”.
+ *
+ * The input is too short to shrink, so it is stored raw. Its XXH32 is
+ * 0xEBF168C5, of which only the low 28 bits are stored.
+ */
+const std::vector<uint8_t> known_raw = {
+	// Magic, token (raw, 64 KiB), compressed length 13, uncompressed length
+	// 13, checksum.
+	'L', 'Z', '4', 'B', 'l', 'o', 'c', 'k', 0x16, 0x0D, 0x00, 0x00, 0x00, 0x0D, 0x00, 0x00, 0x00, 0xC5, 0x68, 0xF1, 0x0B,
+	'H', 'e', 'l', 'l', 'o', ',', ' ', 'W', 'o', 'r', 'l', 'd', '!',
+	// Terminating empty block.
+	'L', 'Z', '4', 'B', 'l', 'o', 'c', 'k', 0x16, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+/**
+ * \brief Generates test data.
+ *
+ * \param[in] size the number of bytes to generate.
+ *
+ * \param[in] compressible \c true to generate data made of a few distinct
+ * values, or \c false to generate pseudo-random bytes that LZ4 cannot shrink.
+ *
+ * \return the data.
+ */
+std::vector<uint8_t> make_data(std::size_t size, bool compressible) {
+	std::vector<uint8_t> ret(size);
+	uint32_t state = 12345;
+	for(uint8_t &i : ret) {
+		state = state * 1103515245 + 12345;
+		i = static_cast<uint8_t>(compressible ? (state >> 16) % 4 : state >> 24);
+	}
+	return ret;
+}
+}
+}
+
+/**
+ * \brief Tests compressing and decompressing inputs of various sizes, on
+ * either side of the 64 KiB block size.
+ */
+void mcwutil::lz4::lz4_test::test_round_trip() {
+	for(std::size_t size : {std::size_t{0}, std::size_t{1}, std::size_t{1000}, std::size_t{65535}, std::size_t{65536}, std::size_t{65537}, std::size_t{200000}}) {
+		for(bool compressible : {true, false}) {
+			std::vector<uint8_t> data = make_data(size, compressible);
+			CPPUNIT_ASSERT(data == decompress_buffer(compress_buffer(data)));
+		}
+	}
+}
+
+/**
+ * \brief Tests reading and writing an LZ4-compressed block exactly as
+ * lz4-java does.
+ */
+void mcwutil::lz4::lz4_test::test_known_compressed() {
+	const std::vector<uint8_t> text(64, 'a');
+	CPPUNIT_ASSERT(text == decompress_buffer(known_compressed));
+	CPPUNIT_ASSERT(known_compressed == compress_buffer(text));
+}
+
+/**
+ * \brief Tests reading and writing a raw block exactly as lz4-java does,
+ * including the masked checksum.
+ */
+void mcwutil::lz4::lz4_test::test_known_raw() {
+	const std::vector<uint8_t> text = {'H', 'e', 'l', 'l', 'o', ',', ' ', 'W', 'o', 'r', 'l', 'd', '!'};
+	CPPUNIT_ASSERT(text == decompress_buffer(known_raw));
+	CPPUNIT_ASSERT(known_raw == compress_buffer(text));
+}
+
+/**
+ * \brief Tests that a block whose checksum does not match is rejected.
+ */
+void mcwutil::lz4::lz4_test::test_bad_checksum() {
+	std::vector<uint8_t> stream = known_compressed;
+	stream[17] ^= 1;
+	CPPUNIT_ASSERT_THROW(decompress_buffer(stream), std::runtime_error);
+}
+
+/**
+ * \brief Tests that a block with the wrong magic number is rejected.
+ */
+void mcwutil::lz4::lz4_test::test_bad_magic() {
+	std::vector<uint8_t> stream = known_raw;
+	stream[0] = 'X';
+	CPPUNIT_ASSERT_THROW(decompress_buffer(stream), std::runtime_error);
+}
+
+/**
+ * \brief Tests that streams cut short, within a block or before the
+ * terminating block, are rejected.
+ */
+void mcwutil::lz4::lz4_test::test_truncated() {
+	std::vector<uint8_t> stream = known_compressed;
+	CPPUNIT_ASSERT_THROW(decompress_buffer(std::span(stream).first(25)), std::runtime_error);
+	CPPUNIT_ASSERT_THROW(decompress_buffer(std::span(stream).first(32)), std::runtime_error);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(mcwutil::lz4::lz4_test);
@@ -2,15 +2,19 @@
 #include <mcwutil/nbt/nbt.hpp>
 #include <mcwutil/region/region.hpp>
 #include <mcwutil/util/xml.hpp>
+#include <mcwutil/world/world.hpp>
 #include <mcwutil/zlib_utils.hpp>
 #include <exception>
 #include <iostream>
 #include <locale>
+#include <optional>
 #include <span>
 #include <stdexcept>
 #include <string_view>
 #include <typeinfo>
 
+using namespace std::literals::string_view_literals;
+
 namespace mcwutil {
 namespace {
 /**
@@ -20,15 +24,28 @@ namespace {
  */
 void usage(std::string_view appname) {
 	std::cerr << "Usage:\n";
-	std::cerr << appname << " command [arguments...]\n";
+	std::cerr << appname << " [--deflate backend] command [arguments...]\n";
+	std::cerr << '\n';
+	std::cerr << "Global options are:\n";
+	std::cerr << "  --deflate - the library for compressing and decompressing chunks and other whole buffers: zlib, or\n";
+	std::cerr << "              libdeflate if built in (the default when it is); the output is zlib-compatible either way\n";
 	std::cerr << '\n';
 	std::cerr << "Possible commands are:\n";
 	std::cerr << "  coord-calc - computes various useful numbers from a coordinate pair\n";
 	std::cerr << "  region-unpack - unpacks the chunks from a region file (.mca or .mcr)\n";
 	std::cerr << "  region-pack - packs chunks into a region file (.mca or .mcr)\n";
-	std::cerr << "  zlib-decompress - decompresses a ZLIB-format file\n";
-	std::cerr << "  zlib-compress - compresses a ZLIB-format file\n";
-	std::cerr << "  zlib-check - decompresses a ZLIB-format file, discarding the contents\n";
+	std::cerr << "  region-map - applies NBT transformations to every chunk in a region file\n";
+	std::cerr << "  region-put - replaces a single chunk in a region file in place\n";
+	std::cerr << "  region-compact - removes unused sectors from region files\n";
+	std::cerr << "  region-recompress - converts the chunks in a region file to a different compression type\n";
+	std::cerr << "  region-stat - reports sector utilisation, chunk sizes and timestamps of region files\n";
+	std::cerr << "  region-transplant - copies chunks from one world into another, such as from a backup\n";
+	std::cerr << "  region-verify - checks region files for corruption\n";
+	std::cerr << "  world-crop - removes every chunk outside a rectangle from a world\n";
+	std::cerr << "  world-index - builds or queries an index of the chunks in a world\n";
+	std::cerr << "  zlib-decompress - decompresses a ZLIB- or gzip-format file\n";
+	std::cerr << "  zlib-compress - compresses a file into ZLIB or gzip format\n";
+	std::cerr << "  zlib-check - decompresses a ZLIB- or gzip-format file, discarding the contents\n";
 	std::cerr << "  nbt-to-xml - converts an NBT file to an equivalent XML file\n";
 	std::cerr << "  nbt-from-xml - converts an NBT-equivalent XML file to an NBT file\n";
 	std::cerr << "  nbt-block-substitute - replaces block IDs in the terrain of an NBT file\n";
@@ -56,6 +73,17 @@ int main_impl(int argc, char **argv) {
 	std::string_view appname = args.front();
 	args = args.subspan(1);
 
+	// Apply global options.
+	while(args.size() >= 2 && args.front() == "--deflate"sv) {
+		std::optional<zlib::backend> backend = zlib::parse_backend(args[1]);
+		if(!backend) {
+			usage(appname);
+			return 1;
+		}
+		zlib::set_backend(*backend);
+		args = args.subspan(2);
+	}
+
 	// Extract the command name.
 	if(args.empty()) {
 		usage(appname);
@@ -71,6 +99,24 @@ int main_impl(int argc, char **argv) {
 		return region::unpack(appname, args);
 	} else if(command == "region-pack") {
 		return region::pack(appname, args);
+	} else if(command == "region-map") {
+		return region::map(appname, args);
+	} else if(command == "region-put") {
+		return region::put(appname, args);
+	} else if(command == "region-compact") {
+		return region::compact(appname, args);
+	} else if(command == "region-recompress") {
+		return region::recompress(appname, args);
+	} else if(command == "region-stat") {
+		return region::stat(appname, args);
+	} else if(command == "region-transplant") {
+		return region::transplant(appname, args);
+	} else if(command == "region-verify") {
+		return region::verify(appname, args);
+	} else if(command == "world-crop") {
+		return world::crop(appname, args);
+	} else if(command == "world-index") {
+		return world::index(appname, args);
 	} else if(command == "zlib-decompress") {
 		return zlib::decompress(appname, args);
 	} else if(command == "zlib-compress") {
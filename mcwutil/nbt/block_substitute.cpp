@@ -1,8 +1,8 @@
+#include <mcwutil/nbt/file.hpp>
 #include <mcwutil/nbt/nbt.hpp>
 #include <mcwutil/nbt/tags.hpp>
 #include <mcwutil/util/codec.hpp>
 #include <mcwutil/util/file_descriptor.hpp>
-#include <mcwutil/util/mapped_file.hpp>
 #include <mcwutil/util/string.hpp>
 #include <algorithm>
 #include <array>
@@ -10,6 +10,7 @@
 #include <cstdlib>
 #include <fcntl.h>
 #include <iostream>
+#include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <string_view>
@@ -74,13 +75,27 @@ void check_left(std::size_t needed, std::size_t left) {
  *
  * \param[in, out] input_left the number of bytes remaining, to decrement.
  */
-void eat(std::size_t n, uint8_t *&input_ptr, std::size_t &input_left) {
+void eat(std::size_t n, const uint8_t *&input_ptr, std::size_t &input_left) {
 	assert(n <= input_left);
 	input_ptr += n;
 	input_left -= n;
 }
 
-void handle_named(nbt::tag tag, uint8_t *&input_ptr, std::size_t &input_left, const uint16_t *sub_table, const file_descriptor &output_fd, Section &section_blocks, std::vector<std::u8string_view> &path);
+/**
+ * \brief Appends bytes to the end of an output buffer.
+ *
+ * \param[in, out] output the buffer to append to.
+ *
+ * \param[in] data the bytes to append.
+ *
+ * \param[in] length the number of bytes to append.
+ */
+void append(std::vector<uint8_t> &output, const void *data, std::size_t length) {
+	const uint8_t *bytes = static_cast<const uint8_t *>(data);
+	output.insert(output.end(), bytes, bytes + length);
+}
+
+void handle_named(nbt::tag tag, const uint8_t *&input_ptr, std::size_t &input_left, const uint16_t *sub_table, std::vector<uint8_t> &output, Section &section_blocks, std::vector<std::u8string_view> &path);
 
 /**
  * \brief Handles the content of a data item.
@@ -101,41 +116,41 @@ void handle_named(nbt::tag tag, uint8_t *&input_ptr, std::size_t &input_left, co
  *
  * \param[in] sub_table the table of block ID substitutions to apply.
  *
- * \param[out] output_fd the file descriptor to write the result to.
+ * \param[out] output the buffer to append the result to.
  *
  * \param[in, out] section_blocks the working storage in which the section’s
  * block IDs are reassembled from their split components.
  *
  * \param[in] path the path to the current location.
  */
-void handle_content(nbt::tag tag, uint8_t *&input_ptr, std::size_t &input_left, const uint16_t *sub_table, const file_descriptor &output_fd, Section &section_blocks, std::vector<std::u8string_view> &path) {
+void handle_content(nbt::tag tag, const uint8_t *&input_ptr, std::size_t &input_left, const uint16_t *sub_table, std::vector<uint8_t> &output, Section &section_blocks, std::vector<std::u8string_view> &path) {
 	switch(tag) {
 		case nbt::TAG_END:
 			throw std::runtime_error("Malformed NBT: unexpected TAG_END.");
 
 		case nbt::TAG_BYTE:
 			check_left(1, input_left);
-			output_fd.write(input_ptr, 1);
+			append(output, input_ptr, 1);
 			eat(1, input_ptr, input_left);
 			return;
 
 		case nbt::TAG_SHORT:
 			check_left(2, input_left);
-			output_fd.write(input_ptr, 2);
+			append(output, input_ptr, 2);
 			eat(2, input_ptr, input_left);
 			return;
 
 		case nbt::TAG_INT:
 		case nbt::TAG_FLOAT:
 			check_left(4, input_left);
-			output_fd.write(input_ptr, 4);
+			append(output, input_ptr, 4);
 			eat(4, input_ptr, input_left);
 			return;
 
 		case nbt::TAG_LONG:
 		case nbt::TAG_DOUBLE:
 			check_left(8, input_left);
-			output_fd.write(input_ptr, 8);
+			append(output, input_ptr, 8);
 			eat(8, input_ptr, input_left);
 			return;
 
@@ -161,8 +176,8 @@ void handle_content(nbt::tag tag, uint8_t *&input_ptr, std::size_t &input_left,
 			} else {
 				uint8_t header[4];
 				codec::encode_integer<uint32_t>(&header[0], length);
-				output_fd.write(header, sizeof(header));
-				output_fd.write(barray_ptr, length);
+				append(output, header, sizeof(header));
+				append(output, barray_ptr, length);
 			}
 			return;
 		}
@@ -180,8 +195,8 @@ void handle_content(nbt::tag tag, uint8_t *&input_ptr, std::size_t &input_left,
 
 			uint8_t header[2];
 			codec::encode_integer<uint16_t>(&header[0], length);
-			output_fd.write(header, sizeof(header));
-			output_fd.write(string_ptr, length);
+			append(output, header, sizeof(header));
+			append(output, string_ptr, length);
 			return;
 		}
 
@@ -198,10 +213,10 @@ void handle_content(nbt::tag tag, uint8_t *&input_ptr, std::size_t &input_left,
 			uint8_t header[5];
 			codec::encode_integer<uint8_t>(&header[0], subtype);
 			codec::encode_integer<uint32_t>(&header[1], length);
-			output_fd.write(header, sizeof(header));
+			append(output, header, sizeof(header));
 
 			for(int32_t i = 0; i < length; ++i) {
-				handle_content(subtype, input_ptr, input_left, sub_table, output_fd, section_blocks, path);
+				handle_content(subtype, input_ptr, input_left, sub_table, output, section_blocks, path);
 			}
 			return;
 		}
@@ -227,34 +242,34 @@ void handle_content(nbt::tag tag, uint8_t *&input_ptr, std::size_t &input_left,
 						uint8_t header[4];
 						codec::encode_integer<uint8_t>(&header[0], nbt::TAG_BYTE_ARRAY);
 						codec::encode_integer<uint16_t>(&header[1], sizeof(u8"Blocks") - 1);
-						output_fd.write(header, 3);
-						output_fd.write(u8"Blocks", sizeof(u8"Blocks") - 1);
+						append(output, header, 3);
+						append(output, u8"Blocks", sizeof(u8"Blocks") - 1);
 						codec::encode_integer<uint32_t>(&header[0], 16 * 16 * 16);
-						output_fd.write(header, 4);
+						append(output, header, 4);
 						uint8_t buffer[16 * 16 * 16];
 						for(std::size_t i = 0; i < 16 * 16 * 16; ++i) {
 							buffer[i] = static_cast<uint8_t>(section_blocks[i] & 0xFF);
 						}
-						output_fd.write(buffer, 16 * 16 * 16);
+						append(output, buffer, 16 * 16 * 16);
 						if(any_extended) {
 							codec::encode_integer<uint8_t>(&header[0], nbt::TAG_BYTE_ARRAY);
 							codec::encode_integer<uint16_t>(&header[1], sizeof(u8"Add") - 1);
-							output_fd.write(header, 3);
-							output_fd.write(u8"Add", sizeof(u8"Add") - 1);
+							append(output, header, 3);
+							append(output, u8"Add", sizeof(u8"Add") - 1);
 							codec::encode_integer<uint32_t>(&header[0], 16 * 16 * 16 / 2);
-							output_fd.write(header, 4);
+							append(output, header, 4);
 							for(std::size_t i = 0; i < 16 * 16 * 16; i += 2) {
 								buffer[i / 2] = static_cast<uint8_t>((section_blocks[i] >> 8) | ((section_blocks[i + 1] >> 8) << 4));
 							}
-							output_fd.write(buffer, 16 * 16 * 16 / 2);
+							append(output, buffer, 16 * 16 * 16 / 2);
 						}
 					}
 					uint8_t footer;
 					codec::encode_integer<uint8_t>(&footer, nbt::TAG_END);
-					output_fd.write(&footer, sizeof(footer));
+					append(output, &footer, sizeof(footer));
 					return;
 				}
-				handle_named(subtype, input_ptr, input_left, sub_table, output_fd, section_blocks, path);
+				handle_named(subtype, input_ptr, input_left, sub_table, output, section_blocks, path);
 			}
 		}
 
@@ -268,15 +283,15 @@ void handle_content(nbt::tag tag, uint8_t *&input_ptr, std::size_t &input_left,
 
 			uint8_t header[4];
 			codec::encode_integer<uint32_t>(&header[0], length);
-			output_fd.write(header, sizeof(header));
+			append(output, header, sizeof(header));
 
-			output_fd.write(input_ptr, length);
+			append(output, input_ptr, length);
 			eat(length, input_ptr, input_left);
-			output_fd.write(input_ptr, length);
+			append(output, input_ptr, length);
 			eat(length, input_ptr, input_left);
-			output_fd.write(input_ptr, length);
+			append(output, input_ptr, length);
 			eat(length, input_ptr, input_left);
-			output_fd.write(input_ptr, length);
+			append(output, input_ptr, length);
 			eat(length, input_ptr, input_left);
 			return;
 		}
@@ -291,23 +306,23 @@ void handle_content(nbt::tag tag, uint8_t *&input_ptr, std::size_t &input_left,
 
 			uint8_t header[4];
 			codec::encode_integer<uint32_t>(&header[0], length);
-			output_fd.write(header, sizeof(header));
+			append(output, header, sizeof(header));
 
-			output_fd.write(input_ptr, length);
+			append(output, input_ptr, length);
 			eat(length, input_ptr, input_left);
-			output_fd.write(input_ptr, length);
+			append(output, input_ptr, length);
 			eat(length, input_ptr, input_left);
-			output_fd.write(input_ptr, length);
+			append(output, input_ptr, length);
 			eat(length, input_ptr, input_left);
-			output_fd.write(input_ptr, length);
+			append(output, input_ptr, length);
 			eat(length, input_ptr, input_left);
-			output_fd.write(input_ptr, length);
+			append(output, input_ptr, length);
 			eat(length, input_ptr, input_left);
-			output_fd.write(input_ptr, length);
+			append(output, input_ptr, length);
 			eat(length, input_ptr, input_left);
-			output_fd.write(input_ptr, length);
+			append(output, input_ptr, length);
 			eat(length, input_ptr, input_left);
-			output_fd.write(input_ptr, length);
+			append(output, input_ptr, length);
 			eat(length, input_ptr, input_left);
 			return;
 		}
@@ -335,14 +350,14 @@ void handle_content(nbt::tag tag, uint8_t *&input_ptr, std::size_t &input_left,
  *
  * \param[in] sub_table the table of block ID substitutions to apply.
  *
- * \param[out] output_fd the file descriptor to write the result to.
+ * \param[out] output the buffer to append the result to.
  *
  * \param[in, out] section_blocks the working storage in which the section’s
  * block IDs are reassembled from their split components.
  *
  * \param[in] path the path to the current location.
  */
-void handle_named(nbt::tag tag, uint8_t *&input_ptr, std::size_t &input_left, const uint16_t *sub_table, const file_descriptor &output_fd, Section &section_blocks, std::vector<std::u8string_view> &path) {
+void handle_named(nbt::tag tag, const uint8_t *&input_ptr, std::size_t &input_left, const uint16_t *sub_table, std::vector<uint8_t> &output, Section &section_blocks, std::vector<std::u8string_view> &path) {
 	// Read name length.
 	check_left(2, input_left);
 	int16_t name_len = codec::decode_integer<uint16_t>(input_ptr);
@@ -362,12 +377,12 @@ void handle_named(nbt::tag tag, uint8_t *&input_ptr, std::size_t &input_left, co
 		uint8_t header[3];
 		codec::encode_integer<uint8_t>(&header[0], tag);
 		codec::encode_integer<uint16_t>(&header[1], name_len);
-		output_fd.write(header, sizeof(header));
-		output_fd.write(name_ptr, name_len);
+		append(output, header, sizeof(header));
+		append(output, name_ptr, name_len);
 	}
 
 	// Handle content.
-	handle_content(tag, input_ptr, input_left, sub_table, output_fd, section_blocks, path);
+	handle_content(tag, input_ptr, input_left, sub_table, output, section_blocks, path);
 
 	// Fix path.
 	path.pop_back();
@@ -380,14 +395,17 @@ void handle_named(nbt::tag tag, uint8_t *&input_ptr, std::size_t &input_left, co
  */
 void usage(std::string_view appname) {
 	std::cerr << "Usage:\n";
-	std::cerr << appname << " nbt-block-substitute infile outfile from1 to1 [from2 to2 ...]\n";
+	std::cerr << appname << " nbt-block-substitute [--gzip | --zlib | --recompress] infile outfile from1 to1 [from2 to2 ...]\n";
 	std::cerr << '\n';
 	std::cerr << "Changes block IDs in an NBT file.\n";
 	std::cerr << "Only the terrain arrays are affected; items in inventories should be handled separately if they also need to be changed.\n";
 	std::cerr << "It is also not possible to use this tool to replace air in omitted sections with another block.\n";
 	std::cerr << '\n';
 	std::cerr << "Arguments:\n";
-	std::cerr << "  infile - the NBT file to modify\n";
+	std::cerr << "  --gzip - gzip-compress the output\n";
+	std::cerr << "  --zlib - zlib-compress the output\n";
+	std::cerr << "  --recompress - compress the output the same way as infile (by default it is not compressed)\n";
+	std::cerr << "  infile - the NBT file to modify, which may be zlib- or gzip-compressed\n";
 	std::cerr << "  outfile - the location at which to save the new NBT file (must not be equal to infile)\n";
 	std::cerr << "  from1 - the first block ID to change to something else (an integer between 0 and 4095)\n";
 	std::cerr << "  to1 - the block ID to change blocks equal to \"from1\" to (an integer between 0 and 4095)\n";
@@ -395,6 +413,32 @@ void usage(std::string_view appname) {
 }
 }
 
+/**
+ * \brief Replaces block IDs in the terrain arrays of an in-memory NBT
+ * structure.
+ *
+ * \param[in] input the NBT data to read.
+ *
+ * \param[in] sub_table the table of block ID substitutions to apply, indexed
+ * by old block ID.
+ *
+ * \return the modified NBT data.
+ */
+std::vector<uint8_t> mcwutil::nbt::substitute_blocks(std::span<const uint8_t> input, std::span<const uint16_t, 4096> sub_table) {
+	std::vector<uint8_t> output;
+	output.reserve(input.size());
+	Section section_blocks;
+	std::vector<std::u8string_view> path;
+	std::fill(section_blocks.begin(), section_blocks.end(), 0);
+	const uint8_t *input_ptr = input.data();
+	std::size_t input_left = input.size();
+	check_left(1, input_left);
+	nbt::tag root_tag = static_cast<nbt::tag>(codec::decode_integer<uint8_t>(input_ptr));
+	eat(1, input_ptr, input_left);
+	handle_named(root_tag, input_ptr, input_left, sub_table.data(), output, section_blocks, path);
+	return output;
+}
+
 /**
  * \brief Entry point for the \c nbt-block-substitute utility.
  *
@@ -406,13 +450,25 @@ void usage(std::string_view appname) {
  */
 int mcwutil::nbt::block_substitute(std::string_view appname, std::span<char *> args) {
 	// Check parameters.
+	std::optional<zlib::format> output_compression;
+	bool recompress = false;
+	if(!args.empty() && args[0] == "--gzip"sv) {
+		output_compression = zlib::FORMAT_GZIP;
+		args = args.subspan(1);
+	} else if(!args.empty() && args[0] == "--zlib"sv) {
+		output_compression = zlib::FORMAT_ZLIB;
+		args = args.subspan(1);
+	} else if(!args.empty() && args[0] == "--recompress"sv) {
+		recompress = true;
+		args = args.subspan(1);
+	}
 	if(args.size() < 4 || (args.size() % 2) != 0) {
 		usage(appname);
 		return 1;
 	}
 
 	// Build the substitution table.
-	uint16_t sub_table[4096];
+	std::array<uint16_t, 4096> sub_table;
 	for(unsigned int i = 0; i < 4096; ++i) {
 		sub_table[i] = static_cast<uint16_t>(i);
 	}
@@ -445,24 +501,14 @@ int mcwutil::nbt::block_substitute(std::string_view appname, std::span<char *> a
 		sub_table[from] = static_cast<uint16_t>(to);
 	}
 
-	// Open and map input NBT file.
-	file_descriptor input_fd = file_descriptor::create_open(args[0], O_RDONLY, 0);
-	mapped_file input_mapped(input_fd, PROT_READ);
-
-	// Open the output file.
-	file_descriptor output_fd = file_descriptor::create_open(args[1], O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	// Open input NBT file.
+	input_file input(args[0]);
 
 	// Do the thing.
-	Section section_blocks;
-	std::vector<std::u8string_view> path;
-	std::fill(section_blocks.begin(), section_blocks.end(), 0);
-	uint8_t *input_ptr = static_cast<uint8_t *>(input_mapped.data());
-	std::size_t input_left = input_mapped.size();
-	check_left(1, input_left);
-	nbt::tag root_tag = static_cast<nbt::tag>(codec::decode_integer<uint8_t>(input_ptr));
-	eat(1, input_ptr, input_left);
-	handle_named(root_tag, input_ptr, input_left, sub_table, output_fd, section_blocks, path);
-	output_fd.close();
+	std::vector<uint8_t> output = substitute_blocks(input.data(), sub_table);
+
+	// Write the output file.
+	write_file(args[1], output, recompress ? input.compression() : output_compression);
 
 	return 0;
 }
@@ -0,0 +1,76 @@
+#include <mcwutil/nbt/file.hpp>
+#include <fcntl.h>
+#include <filesystem>
+#include <system_error>
+
+/**
+ * \brief Opens an NBT file, inflating it if it is compressed.
+ *
+ * \param[in] filename the file to open.
+ */
+mcwutil::nbt::input_file::input_file(const char *filename) : fd_(file_descriptor::create_open(filename, O_RDONLY, 0)), mapped_(fd_, PROT_READ) {
+	std::span<const uint8_t> stored(static_cast<const uint8_t *>(mapped_.data()), mapped_.size());
+	compression_ = detect_compression(stored);
+	if(compression_) {
+		inflated_ = zlib::decompress_buffer(stored);
+	}
+}
+
+/**
+ * \brief Works out whether the contents of an NBT file are compressed.
+ *
+ * Uncompressed NBT starts with a tag type, from 0 to 12. That is never the
+ * first byte of the gzip magic number, nor a zlib header byte with a window
+ * size zlib would write, so the formats cannot be confused.
+ *
+ * \param[in] data the contents of the file.
+ *
+ * \return the framing of the compressed data, or nothing if the data is not
+ * compressed.
+ */
+std::optional<mcwutil::zlib::format> mcwutil::nbt::detect_compression(std::span<const uint8_t> data) {
+	if(data.size() >= 2 && data[0] == 0x1F && data[1] == 0x8B) {
+		return zlib::FORMAT_GZIP;
+	} else if(data.size() >= 2 && (data[0] & 0x0F) == 8 && (data[0] >> 4) >= 1 && (data[0] >> 4) <= 7 && !(data[1] & 0x20) && !((data[0] << 8 | data[1]) % 31)) {
+		// Deflate with a 512 B to 32 KiB window, no preset dictionary, and a
+		// valid check value.
+		return zlib::FORMAT_ZLIB;
+	} else {
+		return std::nullopt;
+	}
+}
+
+/**
+ * \brief Writes an NBT file, compressing it if asked.
+ *
+ * The data is written to a temporary file alongside the target and flushed to
+ * disk before it replaces the target, so that an existing file is never left
+ * truncated or half-written.
+ *
+ * \param[in] filename the file to create or replace.
+ *
+ * \param[in] data the uncompressed NBT data.
+ *
+ * \param[in] compression the framing to compress the data in, or nothing to
+ * write it uncompressed.
+ */
+void mcwutil::nbt::write_file(const char *filename, std::span<const uint8_t> data, std::optional<zlib::format> compression) {
+	std::filesystem::path temp_filename(filename);
+	temp_filename += ".tmp";
+	file_descriptor fd = file_descriptor::create_open(temp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	try {
+		if(compression) {
+			std::vector<uint8_t> compressed = zlib::compress_buffer(data, 9, *compression);
+			fd.write(compressed.data(), compressed.size());
+		} else {
+			fd.write(data.data(), data.size());
+		}
+		fd.fdatasync();
+		fd.close();
+		std::filesystem::rename(temp_filename, filename);
+	} catch(...) {
+		std::error_code ec;
+		std::filesystem::remove(temp_filename, ec);
+		throw;
+	}
+}
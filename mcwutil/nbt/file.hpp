@@ -0,0 +1,73 @@
+#ifndef NBT_FILE_H
+#define NBT_FILE_H
+
+#include <mcwutil/util/file_descriptor.hpp>
+#include <mcwutil/util/mapped_file.hpp>
+#include <mcwutil/zlib_utils.hpp>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace mcwutil::nbt {
+/**
+ * \brief An NBT file opened for reading, which may be zlib- or
+ * gzip-compressed.
+ *
+ * An uncompressed file is mapped and used in place; a compressed one is
+ * inflated into memory.
+ */
+class input_file final {
+	public:
+	explicit input_file(const char *filename);
+
+	/**
+	 * \brief Returns the uncompressed NBT data.
+	 *
+	 * \return the data.
+	 */
+	std::span<const uint8_t> data() const {
+		if(compression_) {
+			return inflated_;
+		} else {
+			return std::span(static_cast<const uint8_t *>(mapped_.data()), mapped_.size());
+		}
+	}
+
+	/**
+	 * \brief Returns how the file was compressed.
+	 *
+	 * \return the framing of the compressed file, or nothing if it was not
+	 * compressed.
+	 */
+	std::optional<zlib::format> compression() const {
+		return compression_;
+	}
+
+	private:
+	/**
+	 * \brief The file.
+	 */
+	file_descriptor fd_;
+
+	/**
+	 * \brief The file’s contents as stored.
+	 */
+	mapped_file mapped_;
+
+	/**
+	 * \brief How the file was compressed, if it was.
+	 */
+	std::optional<zlib::format> compression_;
+
+	/**
+	 * \brief The inflated contents of a compressed file.
+	 */
+	std::vector<uint8_t> inflated_;
+};
+
+std::optional<zlib::format> detect_compression(std::span<const uint8_t> data);
+void write_file(const char *filename, std::span<const uint8_t> data, std::optional<zlib::format> compression);
+}
+
+#endif
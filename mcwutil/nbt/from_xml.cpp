@@ -1,15 +1,17 @@
+#include <mcwutil/nbt/file.hpp>
 #include <mcwutil/nbt/nbt.hpp>
 #include <mcwutil/nbt/tags.hpp>
 #include <mcwutil/util/codec.hpp>
-#include <mcwutil/util/file_descriptor.hpp>
 #include <mcwutil/util/string.hpp>
 #include <mcwutil/util/xml.hpp>
 #include <algorithm>
-#include <fcntl.h>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
 #include <libxml/tree.h>
 #include <limits>
 #include <memory>
+#include <optional>
 #include <stdexcept>
 #include <string>
 #include <string_view>
@@ -19,6 +21,20 @@ using namespace std::literals::string_view_literals;
 
 namespace mcwutil::nbt {
 namespace {
+/**
+ * \brief Appends bytes to a buffer.
+ *
+ * \param[in, out] nbt the buffer to append to.
+ *
+ * \param[in] data the bytes to append.
+ *
+ * \param[in] size the number of bytes to append.
+ */
+void append(std::vector<uint8_t> &nbt, const void *data, std::size_t size) {
+	const uint8_t *bytes = static_cast<const uint8_t *>(data);
+	nbt.insert(nbt.end(), bytes, bytes + size);
+}
+
 /**
  * \brief Returns the numeric tag value for a given XML element.
  *
@@ -119,11 +135,11 @@ void check_list_subtype(nbt::tag subtype) {
 /**
  * \brief Converts an XML element to NBT.
  *
- * \param[out] nbt_fd the file descriptor to write to.
+ * \param[in, out] nbt the buffer to append the NBT to.
  *
  * \param[in] elt the XML element to convert.
  */
-void write_nbt(const file_descriptor &nbt_fd, const xmlNode &elt) {
+void write_nbt(std::vector<uint8_t> &nbt, const xmlNode &elt) {
 	std::u8string_view elt_name = xml::node_name(elt);
 	if(elt_name == u8"named"sv) {
 		const xmlNode *child = nullptr;
@@ -151,9 +167,9 @@ void write_nbt(const file_descriptor &nbt_fd, const xmlNode &elt) {
 		uint8_t header[3];
 		codec::encode_integer<uint8_t>(&header[0], subtype);
 		codec::encode_integer(&header[1], static_cast<uint16_t>(name.size()));
-		nbt_fd.write(header, sizeof(header));
-		nbt_fd.write(name.data(), name.size());
-		write_nbt(nbt_fd, *child);
+		append(nbt, header, sizeof(header));
+		append(nbt, name.data(), name.size());
+		write_nbt(nbt, *child);
 	} else if(elt_name == u8"byte"sv) {
 		const char8_t *value_raw = xml::node_attr(elt, u8"value");
 		if(!value_raw) {
@@ -162,7 +178,7 @@ void write_nbt(const file_descriptor &nbt_fd, const xmlNode &elt) {
 		uint8_t value = string::fromdecs8(string::u2l(value_raw));
 		uint8_t buffer[1];
 		codec::encode_integer(&buffer[0], value);
-		nbt_fd.write(buffer, sizeof(buffer));
+		append(nbt, buffer, sizeof(buffer));
 	} else if(elt_name == u8"short"sv) {
 		const char8_t *value_raw = xml::node_attr(elt, u8"value");
 		if(!value_raw) {
@@ -171,7 +187,7 @@ void write_nbt(const file_descriptor &nbt_fd, const xmlNode &elt) {
 		uint16_t value = string::fromdecs16(string::u2l(value_raw));
 		uint8_t buffer[sizeof(value)];
 		codec::encode_integer(&buffer[0], value);
-		nbt_fd.write(buffer, sizeof(buffer));
+		append(nbt, buffer, sizeof(buffer));
 	} else if(elt_name == u8"int"sv) {
 		const char8_t *value_raw = xml::node_attr(elt, u8"value");
 		if(!value_raw) {
@@ -180,7 +196,7 @@ void write_nbt(const file_descriptor &nbt_fd, const xmlNode &elt) {
 		uint32_t value = string::fromdecs32(string::u2l(value_raw));
 		uint8_t buffer[sizeof(value)];
 		codec::encode_integer(&buffer[0], value);
-		nbt_fd.write(buffer, sizeof(buffer));
+		append(nbt, buffer, sizeof(buffer));
 	} else if(elt_name == u8"long"sv) {
 		const char8_t *value_raw = xml::node_attr(elt, u8"value");
 		if(!value_raw) {
@@ -189,7 +205,7 @@ void write_nbt(const file_descriptor &nbt_fd, const xmlNode &elt) {
 		uint64_t value = string::fromdecs64(string::u2l(value_raw));
 		uint8_t buffer[sizeof(value)];
 		codec::encode_integer(&buffer[0], value);
-		nbt_fd.write(buffer, sizeof(buffer));
+		append(nbt, buffer, sizeof(buffer));
 	} else if(elt_name == u8"float"sv) {
 		const char8_t *value_raw = xml::node_attr(elt, u8"value");
 		if(!value_raw) {
@@ -198,7 +214,7 @@ void write_nbt(const file_descriptor &nbt_fd, const xmlNode &elt) {
 		float value = string::fromdecf(string::u2l(value_raw));
 		uint8_t buffer[4];
 		codec::encode_float(&buffer[0], value);
-		nbt_fd.write(buffer, sizeof(buffer));
+		append(nbt, buffer, sizeof(buffer));
 	} else if(elt_name == u8"double"sv) {
 		const char8_t *value_raw = xml::node_attr(elt, u8"value");
 		if(!value_raw) {
@@ -207,7 +223,7 @@ void write_nbt(const file_descriptor &nbt_fd, const xmlNode &elt) {
 		double value = string::fromdecd(string::u2l(value_raw));
 		uint8_t buffer[8];
 		codec::encode_double(&buffer[0], value);
-		nbt_fd.write(buffer, sizeof(buffer));
+		append(nbt, buffer, sizeof(buffer));
 	} else if(elt_name == u8"barray"sv) {
 		const xmlNode *text = nullptr;
 		for(const xmlNode *i = elt.children; i; i = i->next) {
@@ -251,12 +267,12 @@ void write_nbt(const file_descriptor &nbt_fd, const xmlNode &elt) {
 			}
 			uint8_t header[4];
 			codec::encode_integer(&header[0], static_cast<uint32_t>(data.size()));
-			nbt_fd.write(header, sizeof(header));
-			nbt_fd.write(&data[0], data.size());
+			append(nbt, header, sizeof(header));
+			append(nbt, &data[0], data.size());
 		} else {
 			uint8_t header[4];
 			codec::encode_integer<uint32_t>(&header[0], 0);
-			nbt_fd.write(header, sizeof(header));
+			append(nbt, header, sizeof(header));
 		}
 	} else if(elt_name == u8"string"sv) {
 		const char8_t *value_raw = xml::node_attr(elt, u8"value");
@@ -269,8 +285,8 @@ void write_nbt(const file_descriptor &nbt_fd, const xmlNode &elt) {
 		}
 		uint8_t header[2];
 		codec::encode_integer(&header[0], static_cast<uint16_t>(value.size()));
-		nbt_fd.write(header, sizeof(header));
-		nbt_fd.write(value.data(), value.size());
+		append(nbt, header, sizeof(header));
+		append(nbt, value.data(), value.size());
 	} else if(elt_name == u8"list"sv) {
 		const char8_t *subtype_raw = xml::node_attr(elt, u8"subtype");
 		if(!subtype_raw) {
@@ -294,10 +310,10 @@ void write_nbt(const file_descriptor &nbt_fd, const xmlNode &elt) {
 		uint8_t header[5];
 		codec::encode_integer<uint8_t>(&header[0], subtype);
 		codec::encode_integer(&header[1], static_cast<uint32_t>(element_count));
-		nbt_fd.write(header, sizeof(header));
+		append(nbt, header, sizeof(header));
 		for(const xmlNode *i = elt.children; i; i = i->next) {
 			if(i->type == XML_ELEMENT_NODE) {
-				write_nbt(nbt_fd, *i);
+				write_nbt(nbt, *i);
 			}
 		}
 	} else if(elt_name == u8"compound"sv) {
@@ -306,12 +322,12 @@ void write_nbt(const file_descriptor &nbt_fd, const xmlNode &elt) {
 				if(xml::node_name(*i) != u8"named"sv) {
 					throw std::runtime_error("Malformed NBT XML: child of compound is not named.");
 				}
-				write_nbt(nbt_fd, *i);
+				write_nbt(nbt, *i);
 			}
 		}
 		uint8_t footer[1];
 		codec::encode_integer<uint8_t>(&footer[0], nbt::TAG_END);
-		nbt_fd.write(footer, sizeof(footer));
+		append(nbt, footer, sizeof(footer));
 	} else if(elt_name == u8"iarray"sv) {
 		const xmlNode *text = nullptr;
 		for(const xmlNode *i = elt.children; i; i = i->next) {
@@ -358,12 +374,12 @@ void write_nbt(const file_descriptor &nbt_fd, const xmlNode &elt) {
 			}
 			uint8_t header[4];
 			codec::encode_integer(&header[0], static_cast<uint32_t>(data.size() / 4));
-			nbt_fd.write(header, sizeof(header));
-			nbt_fd.write(&data[0], data.size());
+			append(nbt, header, sizeof(header));
+			append(nbt, &data[0], data.size());
 		} else {
 			uint8_t header[4];
 			codec::encode_integer<uint32_t>(&header[0], 0);
-			nbt_fd.write(header, sizeof(header));
+			append(nbt, header, sizeof(header));
 		}
 	} else if(elt_name == u8"larray"sv) {
 		const xmlNode *text = nullptr;
@@ -415,12 +431,12 @@ void write_nbt(const file_descriptor &nbt_fd, const xmlNode &elt) {
 			}
 			uint8_t header[4];
 			codec::encode_integer(&header[0], static_cast<uint32_t>(data.size() / 8));
-			nbt_fd.write(header, sizeof(header));
-			nbt_fd.write(&data[0], data.size());
+			append(nbt, header, sizeof(header));
+			append(nbt, &data[0], data.size());
 		} else {
 			uint8_t header[4];
 			codec::encode_integer<uint32_t>(&header[0], 0);
-			nbt_fd.write(header, sizeof(header));
+			append(nbt, header, sizeof(header));
 		}
 	} else {
 		throw std::runtime_error("Malformed NBT XML: unrecognized element.");
@@ -430,11 +446,11 @@ void write_nbt(const file_descriptor &nbt_fd, const xmlNode &elt) {
 /**
  * \brief Converts an XML document to NBT.
  *
- * \param[out] nbt_fd the file descriptor to write to.
+ * \param[in, out] nbt the buffer to append the NBT to.
  *
  * \param[in] doc the XML document to convert.
  */
-void write_nbt(const file_descriptor &nbt_fd, const xmlDoc &doc) {
+void write_nbt(std::vector<uint8_t> &nbt, const xmlDoc &doc) {
 	const xmlNode &root = *xmlDocGetRootElement(&doc);
 	if(xml::node_name(root) != u8"minecraft-nbt"sv) {
 		throw std::runtime_error("Malformed NBT XML: improper root node name.");
@@ -454,7 +470,7 @@ void write_nbt(const file_descriptor &nbt_fd, const xmlDoc &doc) {
 	if(!named) {
 		throw std::runtime_error("Malformed NBT XML: top-level element must exist.");
 	}
-	write_nbt(nbt_fd, *named);
+	write_nbt(nbt, *named);
 }
 }
 }
@@ -470,13 +486,23 @@ void write_nbt(const file_descriptor &nbt_fd, const xmlDoc &doc) {
  */
 int mcwutil::nbt::from_xml(std::string_view appname, std::span<char *> args) {
 	// Check parameters.
+	std::optional<zlib::format> compression;
+	if(!args.empty() && args[0] == "--gzip"sv) {
+		compression = zlib::FORMAT_GZIP;
+		args = args.subspan(1);
+	} else if(!args.empty() && args[0] == "--zlib"sv) {
+		compression = zlib::FORMAT_ZLIB;
+		args = args.subspan(1);
+	}
 	if(args.size() != 2) {
 		std::cerr << "Usage:\n";
-		std::cerr << appname << " nbt-from-xml xmlfile nbtfile\n";
+		std::cerr << appname << " nbt-from-xml [--gzip | --zlib] xmlfile nbtfile\n";
 		std::cerr << '\n';
 		std::cerr << "Converts a human-readable and -editable XML file into an NBT file.\n";
 		std::cerr << '\n';
 		std::cerr << "Arguments:\n";
+		std::cerr << "  --gzip - gzip-compress the NBT file, as for player and level.dat files\n";
+		std::cerr << "  --zlib - zlib-compress the NBT file, as for unpacked chunks\n";
 		std::cerr << "  xmlfile - the XML file to convert\n";
 		std::cerr << "  nbtfile - the NBT file to write\n";
 		return 1;
@@ -485,10 +511,10 @@ int mcwutil::nbt::from_xml(std::string_view appname, std::span<char *> args) {
 	// Read input file.
 	std::unique_ptr<xmlDoc, xml::doc_deleter> document = xml::parse(args[0]);
 
-	// Write output file.
-	file_descriptor nbt_fd = file_descriptor::create_open(args[1], O_WRONLY | O_CREAT | O_TRUNC, 0666);
-	write_nbt(nbt_fd, *document);
-	nbt_fd.close();
+	// Convert and write output file.
+	std::vector<uint8_t> nbt;
+	write_nbt(nbt, *document);
+	write_file(args[1], nbt, compression);
 
 	return 0;
 }
@@ -1,8 +1,11 @@
 #ifndef NBT_NBT_H
 #define NBT_NBT_H
 
+#include <cstdint>
 #include <span>
+#include <string>
 #include <string_view>
+#include <vector>
 
 namespace mcwutil {
 /**
@@ -13,6 +16,11 @@ int to_xml(std::string_view appname, std::span<char *> args);
 int from_xml(std::string_view appname, std::span<char *> args);
 int block_substitute(std::string_view appname, std::span<char *> args);
 int patch_barray(std::string_view appname, std::span<char *> args);
+
+std::vector<uint8_t> substitute_blocks(std::span<const uint8_t> input, std::span<const uint16_t, 4096> sub_table);
+std::vector<std::u8string> split_path(std::u8string_view path);
+void patch_byte_arrays(std::span<uint8_t> data, const std::vector<std::u8string> &path, std::span<const uint8_t, 256> sub_table);
+void validate(std::span<const uint8_t> data);
 }
 }
 
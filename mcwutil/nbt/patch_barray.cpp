@@ -1,14 +1,18 @@
+#include <mcwutil/nbt/file.hpp>
 #include <mcwutil/nbt/nbt.hpp>
 #include <mcwutil/nbt/tags.hpp>
 #include <mcwutil/util/codec.hpp>
 #include <mcwutil/util/file_descriptor.hpp>
 #include <mcwutil/util/mapped_file.hpp>
 #include <mcwutil/util/string.hpp>
+#include <mcwutil/zlib_utils.hpp>
+#include <array>
 #include <cassert>
 #include <cstdlib>
 #include <fcntl.h>
 #include <iostream>
 #include <limits>
+#include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <string>
@@ -309,6 +313,7 @@ void usage(std::string_view appname) {
 	std::cerr << appname << " nbt-patch-barray nbtfile barraypath from1 to1 [from2 to2 ...]\n";
 	std::cerr << '\n';
 	std::cerr << "Patches byte values in byte arrays in an NBT.\n";
+	std::cerr << "A zlib- or gzip-compressed file is decompressed, patched, and compressed again the same way.\n";
 	std::cerr << '\n';
 	std::cerr << "Arguments:\n";
 	std::cerr << "  nbtfile - the NBT file to modify\n";
@@ -328,6 +333,49 @@ void usage(std::string_view appname) {
 }
 }
 
+/**
+ * \brief Splits a slash-separated byte array path into its components.
+ *
+ * \param[in] path the path to split.
+ *
+ * \return the path components, including a leading empty component if \p path
+ * begins with a slash.
+ */
+std::vector<std::u8string> mcwutil::nbt::split_path(std::u8string_view path) {
+	std::vector<std::u8string> path_components;
+	std::u8string current_component;
+	for(const char8_t i : path) {
+		if(i == u8'/') {
+			path_components.push_back(current_component);
+			current_component.clear();
+		} else {
+			current_component.push_back(i);
+		}
+	}
+	path_components.push_back(current_component);
+	return path_components;
+}
+
+/**
+ * \brief Patches byte values in the byte arrays of an in-memory NBT structure.
+ *
+ * \param[in, out] data the NBT data, which is modified in place.
+ *
+ * \param[in] path the components of the path of the byte array to patch, as
+ * returned by \ref split_path.
+ *
+ * \param[in] sub_table the table of byte value substitutions to apply, indexed
+ * by old byte value.
+ */
+void mcwutil::nbt::patch_byte_arrays(std::span<uint8_t> data, const std::vector<std::u8string> &path, std::span<const uint8_t, 256> sub_table) {
+	uint8_t *input_ptr = data.data();
+	std::size_t input_left = data.size();
+	check_left(1, input_left);
+	nbt::tag root_tag = static_cast<nbt::tag>(codec::decode_integer<uint8_t>(input_ptr));
+	eat(1, input_ptr, input_left);
+	handle_named(root_tag, input_ptr, input_left, sub_table.data(), path.begin(), path.end(), true);
+}
+
 /**
  * \brief Entry point for the \c nbt-patch-barray utility.
  *
@@ -345,7 +393,7 @@ int mcwutil::nbt::patch_barray(std::string_view appname, std::span<char *> args)
 	}
 
 	// Build the substitution table.
-	uint8_t sub_table[256];
+	std::array<uint8_t, 256> sub_table;
 	for(unsigned int i = 0; i < 256; ++i) {
 		sub_table[i] = static_cast<uint8_t>(i);
 	}
@@ -379,32 +427,28 @@ int mcwutil::nbt::patch_barray(std::string_view appname, std::span<char *> args)
 	}
 
 	// Build the target path.
-	std::vector<std::u8string> path_components;
+	std::vector<std::u8string> path_components = split_path(string::l2u(args[1]));
+
+	// Open and map NBT file. An uncompressed file is patched in place.
+	std::optional<zlib::format> compression;
+	std::vector<uint8_t> data;
 	{
-		std::u8string path = string::l2u(args[1]);
-		std::u8string current_component;
-		for(const char8_t i : path) {
-			if(i == u8'/') {
-				path_components.push_back(current_component);
-				current_component.clear();
-			} else {
-				current_component.push_back(i);
-			}
+		file_descriptor nbt_fd = file_descriptor::create_open(args[0], O_RDWR, 0);
+		mapped_file nbt_mapped(nbt_fd, PROT_READ | PROT_WRITE);
+		std::span<uint8_t> mapped_data(static_cast<uint8_t *>(nbt_mapped.data()), nbt_mapped.size());
+		compression = detect_compression(mapped_data);
+		if(!compression) {
+			// Do the thing.
+			patch_byte_arrays(mapped_data, path_components, sub_table);
+			return 0;
 		}
-		path_components.push_back(current_component);
+		data = zlib::decompress_buffer(mapped_data);
 	}
 
-	// Open and map NBT file.
-	file_descriptor nbt_fd = file_descriptor::create_open(args[0], O_RDWR, 0);
-	mapped_file nbt_mapped(nbt_fd, PROT_READ | PROT_WRITE);
-
-	// Do the thing.
-	uint8_t *input_ptr = static_cast<uint8_t *>(nbt_mapped.data());
-	std::size_t input_left = nbt_mapped.size();
-	check_left(1, input_left);
-	nbt::tag root_tag = static_cast<nbt::tag>(codec::decode_integer<uint8_t>(input_ptr));
-	eat(1, input_ptr, input_left);
-	handle_named(root_tag, input_ptr, input_left, sub_table, path_components.begin(), path_components.end(), true);
+	// Do the thing to the decompressed data, then write it back compressed
+	// the same way.
+	patch_byte_arrays(data, path_components, sub_table);
+	write_file(args[0], data, compression);
 
 	return 0;
 }
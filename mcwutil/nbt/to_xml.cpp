@@ -1,8 +1,8 @@
+#include <mcwutil/nbt/file.hpp>
 #include <mcwutil/nbt/nbt.hpp>
 #include <mcwutil/nbt/tags.hpp>
 #include <mcwutil/util/codec.hpp>
 #include <mcwutil/util/file_descriptor.hpp>
-#include <mcwutil/util/mapped_file.hpp>
 #include <mcwutil/util/string.hpp>
 #include <mcwutil/util/xml.hpp>
 #include <cassert>
@@ -328,6 +328,7 @@ int mcwutil::nbt::to_xml(std::string_view appname, std::span<char *> args) {
 		std::cerr << appname << " nbt-to-xml nbtfile xmlfile\n";
 		std::cerr << '\n';
 		std::cerr << "Converts an NBT file into a human-readable and -editable XML file.\n";
+		std::cerr << "The NBT file may be zlib-compressed, as unpacked chunks are, or gzip-compressed, as player and level.dat files are.\n";
 		std::cerr << '\n';
 		std::cerr << "Arguments:\n";
 		std::cerr << "  nbtfile - the NBT file to convert\n";
@@ -335,16 +336,15 @@ int mcwutil::nbt::to_xml(std::string_view appname, std::span<char *> args) {
 		return 1;
 	}
 
-	// Open and map NBT file.
-	file_descriptor input_fd = file_descriptor::create_open(args[0], O_RDONLY, 0);
-	mapped_file input_mapped(input_fd, PROT_READ);
+	// Open NBT file.
+	input_file input(args[0]);
 
 	// Construct document.
 	auto nbt_document = xml::empty();
 	xml::internal_subset(*nbt_document, u8"minecraft-nbt", nullptr, u8"urn:uuid:25323dd6-2a7d-11e1-96b7-1c4bd68d068e");
 	xmlNode &nbt_root_elt = xml::node_create_root(*nbt_document, u8"minecraft-nbt");
-	const uint8_t *input_ptr = static_cast<const uint8_t *>(input_mapped.data());
-	std::size_t input_left = input_mapped.size();
+	const uint8_t *input_ptr = input.data().data();
+	std::size_t input_left = input.data().size();
 	check_left(1, input_left);
 	nbt::tag outer_tag = static_cast<nbt::tag>(codec::decode_integer<uint8_t>(input_ptr));
 	eat(1, input_ptr, input_left);
@@ -0,0 +1,175 @@
+#include <mcwutil/nbt/nbt.hpp>
+#include <mcwutil/nbt/tags.hpp>
+#include <mcwutil/util/codec.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+namespace mcwutil::nbt {
+namespace {
+/**
+ * \brief The deepest nesting of lists and compounds accepted, which is the
+ * same limit Minecraft applies when reading.
+ */
+constexpr unsigned int MAX_DEPTH = 512;
+
+/**
+ * \brief Consumes a number of bytes from the input, checking that they are
+ * available.
+ *
+ * \param[in] n the number of bytes to consume.
+ *
+ * \param[in, out] input the remaining input, which is shortened by \p n
+ * bytes.
+ *
+ * \return the consumed bytes.
+ *
+ * \exception std::runtime_error if fewer than \p n bytes remain.
+ */
+std::span<const uint8_t> take(std::size_t n, std::span<const uint8_t> &input) {
+	if(input.size() < n) {
+		throw std::runtime_error("Malformed NBT: input truncated.");
+	}
+	std::span<const uint8_t> ret = input.first(n);
+	input = input.subspan(n);
+	return ret;
+}
+
+/**
+ * \brief Consumes a signed 32-bit array or list length from the input.
+ *
+ * \param[in, out] input the remaining input.
+ *
+ * \return the length.
+ *
+ * \exception std::runtime_error if the length is truncated or negative.
+ */
+std::size_t take_length(std::span<const uint8_t> &input) {
+	int32_t len = static_cast<int32_t>(codec::decode_integer<uint32_t>(take(4, input).data()));
+	if(len < 0) {
+		throw std::runtime_error("Malformed NBT: negative length.");
+	}
+	return static_cast<std::size_t>(len);
+}
+
+/**
+ * \brief Consumes the content of a data item, checking its structure.
+ *
+ * \param[in, out] input the remaining input, which is advanced past the
+ * data item.
+ *
+ * \param[in] tag the data type.
+ *
+ * \param[in] depth the nesting depth of the data item.
+ *
+ * \exception std::runtime_error if the data is malformed.
+ */
+void walk(std::span<const uint8_t> &input, nbt::tag tag, unsigned int depth) {
+	switch(tag) {
+		case nbt::TAG_END:
+			throw std::runtime_error("Malformed NBT: unexpected TAG_END.");
+
+		case nbt::TAG_BYTE:
+			take(1, input);
+			return;
+
+		case nbt::TAG_SHORT:
+			take(2, input);
+			return;
+
+		case nbt::TAG_INT:
+		case nbt::TAG_FLOAT:
+			take(4, input);
+			return;
+
+		case nbt::TAG_LONG:
+		case nbt::TAG_DOUBLE:
+			take(8, input);
+			return;
+
+		case nbt::TAG_BYTE_ARRAY:
+			take(take_length(input), input);
+			return;
+
+		case nbt::TAG_STRING:
+			take(codec::decode_integer<uint16_t>(take(2, input).data()), input);
+			return;
+
+		case nbt::TAG_INT_ARRAY: {
+			std::size_t len = take_length(input);
+			if(len > input.size() / 4) {
+				throw std::runtime_error("Malformed NBT: input truncated.");
+			}
+			take(len * 4, input);
+			return;
+		}
+
+		case nbt::TAG_LONG_ARRAY: {
+			std::size_t len = take_length(input);
+			if(len > input.size() / 8) {
+				throw std::runtime_error("Malformed NBT: input truncated.");
+			}
+			take(len * 8, input);
+			return;
+		}
+
+		case nbt::TAG_LIST: {
+			if(depth >= MAX_DEPTH) {
+				throw std::runtime_error("Malformed NBT: nesting too deep.");
+			}
+			nbt::tag subtype = static_cast<nbt::tag>(take(1, input)[0]);
+			std::size_t len = take_length(input);
+			if(subtype == nbt::TAG_END) {
+				// An empty list may have any subtype, including TAG_END.
+				if(len) {
+					throw std::runtime_error("Malformed NBT: non-empty list of TAG_END.");
+				}
+				return;
+			}
+			for(std::size_t i = 0; i != len; ++i) {
+				walk(input, subtype, depth + 1);
+			}
+			return;
+		}
+
+		case nbt::TAG_COMPOUND: {
+			if(depth >= MAX_DEPTH) {
+				throw std::runtime_error("Malformed NBT: nesting too deep.");
+			}
+			for(;;) {
+				nbt::tag subtype = static_cast<nbt::tag>(take(1, input)[0]);
+				if(subtype == nbt::TAG_END) {
+					return;
+				}
+				take(codec::decode_integer<uint16_t>(take(2, input).data()), input);
+				walk(input, subtype, depth + 1);
+			}
+		}
+	}
+
+	throw std::runtime_error("Malformed NBT: unrecognized tag.");
+}
+}
+}
+
+/**
+ * \brief Checks that a buffer holds exactly one well-formed named NBT tag.
+ *
+ * Only the structure is checked; the values themselves are not interpreted.
+ *
+ * \param[in] data the uncompressed NBT data.
+ *
+ * \exception std::runtime_error if the data is truncated, contains an
+ * unrecognized tag, is nested too deeply, or is followed by trailing bytes.
+ */
+void mcwutil::nbt::validate(std::span<const uint8_t> data) {
+	nbt::tag tag = static_cast<nbt::tag>(take(1, data)[0]);
+	if(tag == nbt::TAG_END) {
+		throw std::runtime_error("Malformed NBT: unexpected TAG_END.");
+	}
+	take(codec::decode_integer<uint16_t>(take(2, data).data()), data);
+	walk(data, tag, 0);
+	if(!data.empty()) {
+		throw std::runtime_error("Malformed NBT: trailing data after root tag.");
+	}
+}
@@ -0,0 +1,144 @@
+#include <mcwutil/region/bundle.hpp>
+#include <mcwutil/region/compression.hpp>
+#include <mcwutil/region/reader.hpp>
+#include <mcwutil/util/codec.hpp>
+#include <algorithm>
+#include <array>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string_view>
+
+using mcwutil::region::bundle;
+using namespace std::literals::string_view_literals;
+
+namespace mcwutil::region {
+namespace {
+/**
+ * \brief The magic number at the start of every bundle.
+ */
+constexpr std::string_view MAGIC = "MCWUBNDL"sv;
+
+/**
+ * \brief The size of the fixed header, consisting of the magic number and
+ * chunk count.
+ */
+constexpr std::size_t HEADER_SIZE = 8 + 4;
+
+/**
+ * \brief The size of a single index entry.
+ */
+constexpr std::size_t ENTRY_SIZE = 4 + 4 + 8 + 4 + 1;
+}
+}
+
+/**
+ * \brief Checks whether a file is a bundle.
+ *
+ * \param[in] filename the file to check.
+ *
+ * \return \c true if \p filename is a regular file starting with the bundle
+ * magic number.
+ */
+bool bundle::is_bundle(const std::filesystem::path &filename) {
+	if(!std::filesystem::is_regular_file(filename)) {
+		return false;
+	}
+	file_descriptor fd = file_descriptor::create_open(filename, O_RDONLY, 0);
+	std::array<char, MAGIC.size()> magic;
+	try {
+		fd.read(magic.data(), magic.size());
+	} catch(const std::runtime_error &) {
+		return false;
+	}
+	return std::string_view(magic.data(), magic.size()) == MAGIC;
+}
+
+/**
+ * \brief Writes all the chunks of a region to a new bundle.
+ *
+ * \param[in] region the region to read chunks from.
+ *
+ * \param[in] filename the bundle file to create or replace.
+ */
+void bundle::write(const reader &region, const std::filesystem::path &filename) {
+	// Collect the present chunks, validating them as we go.
+	std::vector<unsigned int> indices;
+	for(unsigned int i = 0; i < 1024; ++i) {
+		if(region.present(i)) {
+			region.payload(i);
+			if(!valid_compression(region.compression(i))) {
+				throw std::runtime_error("Malformed chunk: unrecognized compression type.");
+			}
+			indices.push_back(i);
+		}
+	}
+
+	// Build the header and index.
+	std::vector<uint8_t> index(HEADER_SIZE + ENTRY_SIZE * indices.size());
+	std::copy(MAGIC.begin(), MAGIC.end(), index.begin());
+	codec::encode_integer(&index[8], static_cast<uint32_t>(indices.size()));
+	uint64_t offset = index.size();
+	for(std::size_t i = 0; i != indices.size(); ++i) {
+		uint8_t *e = &index[HEADER_SIZE + ENTRY_SIZE * i];
+		std::size_t length = region.payload(indices[i]).size();
+		codec::encode_integer(&e[0], static_cast<uint32_t>(indices[i]));
+		codec::encode_integer(&e[4], region.timestamp(indices[i]));
+		codec::encode_integer(&e[8], offset);
+		codec::encode_integer(&e[16], static_cast<uint32_t>(length));
+		codec::encode_integer(&e[20], region.compression(indices[i]));
+		offset += length;
+	}
+
+	// Write the index followed by the payloads.
+	file_descriptor fd = file_descriptor::create_open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	fd.write(index.data(), index.size());
+	for(unsigned int i : indices) {
+		std::span<const uint8_t> payload = region.payload(i);
+		fd.write(payload.data(), payload.size());
+	}
+	fd.close();
+}
+
+/**
+ * \brief Opens and maps a bundle and parses its index.
+ *
+ * \param[in] filename the bundle file to open.
+ *
+ * \exception std::runtime_error if the bundle is malformed.
+ */
+bundle::bundle(const std::filesystem::path &filename) :
+		fd_(file_descriptor::create_open(filename, O_RDONLY, 0)),
+		mapped_(fd_, PROT_READ) {
+	std::span<const uint8_t> file(static_cast<const uint8_t *>(mapped_.data()), mapped_.size());
+	if(file.size() < HEADER_SIZE || !std::equal(MAGIC.begin(), MAGIC.end(), file.begin())) {
+		throw std::runtime_error("Malformed bundle: bad magic number.");
+	}
+	uint32_t count = codec::decode_integer<uint32_t>(&file[8]);
+	if(count > 1024 || file.size() < HEADER_SIZE + ENTRY_SIZE * count) {
+		throw std::runtime_error("Malformed bundle: index truncated.");
+	}
+	std::array<bool, 1024> seen{};
+	entries_.reserve(count);
+	for(std::size_t i = 0; i != count; ++i) {
+		const uint8_t *e = &file[HEADER_SIZE + ENTRY_SIZE * i];
+		uint32_t index = codec::decode_integer<uint32_t>(&e[0]);
+		uint32_t timestamp = codec::decode_integer<uint32_t>(&e[4]);
+		uint64_t offset = codec::decode_integer<uint64_t>(&e[8]);
+		uint32_t length = codec::decode_integer<uint32_t>(&e[16]);
+		uint8_t compression_type = codec::decode_integer<uint8_t>(&e[20]);
+		if(index >= 1024) {
+			throw std::runtime_error("Malformed bundle: chunk index out of range.");
+		}
+		if(!valid_compression(compression_type)) {
+			throw std::runtime_error("Malformed bundle: unrecognized compression type.");
+		}
+		if(seen[index]) {
+			throw std::runtime_error("Malformed bundle: repeated chunk index.");
+		}
+		seen[index] = true;
+		if(offset > file.size() || length > file.size() - offset) {
+			throw std::runtime_error("Malformed bundle: chunk beyond end of file.");
+		}
+		entries_.push_back(entry{index, timestamp, compression_type, file.subspan(static_cast<std::size_t>(offset), length)});
+	}
+}
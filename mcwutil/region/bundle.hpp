@@ -0,0 +1,90 @@
+#ifndef REGION_BUNDLE_H
+#define REGION_BUNDLE_H
+
+#include <mcwutil/util/file_descriptor.hpp>
+#include <mcwutil/util/mapped_file.hpp>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+namespace mcwutil::region {
+class reader;
+
+/**
+ * \brief A single-file archive holding the unpacked chunks of one region.
+ *
+ * A bundle is an alternative to a directory of \c chunk-*.nbt.zlib files plus
+ * a \c metadata.xml. All integers are big-endian. The file consists of:
+ * 1. The eight-byte magic number \c MCWUBNDL.
+ * 2. The number of chunks, a 32-bit integer.
+ * 3. For each chunk, a 21-byte index entry consisting of the chunk’s index
+ *    within the region (32 bits), its timestamp (32 bits), the offset of its
+ *    payload from the start of the file (64 bits), the length of its payload
+ *    (32 bits), and its compression type (8 bits).
+ * 4. The chunk payloads, concatenated.
+ */
+class bundle final {
+	public:
+	/**
+	 * \brief A single chunk in a bundle.
+	 */
+	struct entry final {
+		/**
+		 * \brief The index of the chunk within the region.
+		 */
+		unsigned int index;
+
+		/**
+		 * \brief The last-modified time of the chunk.
+		 */
+		uint32_t timestamp;
+
+		/**
+		 * \brief The compression type of the chunk.
+		 */
+		uint8_t compression;
+
+		/**
+		 * \brief The compressed chunk data, as a view into the mapped bundle.
+		 */
+		std::span<const uint8_t> payload;
+	};
+
+	static bool is_bundle(const std::filesystem::path &filename);
+	static void write(const reader &region, const std::filesystem::path &filename);
+
+	explicit bundle(const std::filesystem::path &filename);
+
+	// This class is not copyable.
+	explicit bundle(const bundle &) = delete;
+	void operator=(const bundle &) = delete;
+
+	/**
+	 * \brief Returns the chunks in the bundle.
+	 *
+	 * \return the chunks, in the order they appear in the bundle.
+	 */
+	const std::vector<entry> &entries() const {
+		return entries_;
+	}
+
+	private:
+	/**
+	 * \brief The open bundle file.
+	 */
+	file_descriptor fd_;
+
+	/**
+	 * \brief The mapping of the bundle file.
+	 */
+	mapped_file mapped_;
+
+	/**
+	 * \brief The chunks in the bundle.
+	 */
+	std::vector<entry> entries_;
+};
+}
+
+#endif
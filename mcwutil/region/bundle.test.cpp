@@ -0,0 +1,198 @@
+#include <mcwutil/region/bundle.hpp>
+#include <mcwutil/region/compression.hpp>
+#include <mcwutil/region/reader.hpp>
+#include <mcwutil/region/writer.hpp>
+#include <mcwutil/util/file_descriptor.hpp>
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace mcwutil::region {
+namespace {
+/**
+ * \brief Verifies that bundles are written and read back properly.
+ */
+class bundle_test final : public CppUnit::TestFixture {
+	public:
+	CPPUNIT_TEST_SUITE(bundle_test);
+	CPPUNIT_TEST(test_round_trip);
+	CPPUNIT_TEST(test_empty);
+	CPPUNIT_TEST(test_is_bundle);
+	CPPUNIT_TEST(test_bad_magic);
+	CPPUNIT_TEST(test_truncated);
+	CPPUNIT_TEST_SUITE_END();
+
+	void setUp() override;
+	void tearDown() override;
+
+	private:
+	/**
+	 * \brief A directory holding the files of one test, removed afterwards.
+	 */
+	std::filesystem::path directory_;
+
+	/**
+	 * \brief The region file bundled by the tests.
+	 */
+	std::filesystem::path region_filename_;
+
+	/**
+	 * \brief The bundle file written by the tests.
+	 */
+	std::filesystem::path bundle_filename_;
+
+	void test_round_trip();
+	void test_empty();
+	void test_is_bundle();
+	void test_bad_magic();
+	void test_truncated();
+};
+
+/**
+ * \brief A chunk stored in the test region.
+ */
+struct test_chunk final {
+	/**
+	 * \brief The index of the chunk within the region.
+	 */
+	unsigned int index;
+
+	/**
+	 * \brief The last-modified time of the chunk.
+	 */
+	uint32_t timestamp;
+
+	/**
+	 * \brief The compression type of the chunk.
+	 */
+	compression compression_type;
+
+	/**
+	 * \brief The chunk’s payload.
+	 */
+	std::vector<uint8_t> payload;
+};
+
+/**
+ * \brief The chunks stored in the test region.
+ */
+const test_chunk chunks[] = {
+	{0, 100, COMPRESSION_ZLIB, {1, 2, 3}},
+	{7, 200, COMPRESSION_GZIP, std::vector<uint8_t>(5000, 0x55)},
+	{1023, 300, COMPRESSION_LZ4, {4}},
+};
+
+/**
+ * \brief Writes a region file holding \ref chunks.
+ *
+ * \param[in] filename the file to create.
+ */
+void make_region(const std::filesystem::path &filename) {
+	writer w(file_descriptor::create_open(filename, O_RDWR | O_CREAT | O_TRUNC, 0666));
+	for(const test_chunk &i : chunks) {
+		w.write(i.index, i.payload, static_cast<uint8_t>(i.compression_type), i.timestamp);
+	}
+	w.close();
+}
+}
+}
+
+/**
+ * \brief Creates the directory for the test.
+ */
+void mcwutil::region::bundle_test::setUp() {
+	std::string name = (std::filesystem::temp_directory_path() / "mcwutil-test-XXXXXX").string();
+	if(!mkdtemp(name.data())) {
+		throw std::system_error(errno, std::system_category(), "mkdtemp");
+	}
+	directory_ = name;
+	region_filename_ = directory_ / "r.0.0.mca";
+	bundle_filename_ = directory_ / "r.0.0.bundle";
+}
+
+/**
+ * \brief Removes the directory for the test.
+ */
+void mcwutil::region::bundle_test::tearDown() {
+	std::filesystem::remove_all(directory_);
+}
+
+/**
+ * \brief Tests that every chunk of a region comes back from its bundle, in
+ * index order.
+ */
+void mcwutil::region::bundle_test::test_round_trip() {
+	make_region(region_filename_);
+	bundle::write(reader(region_filename_), bundle_filename_);
+	bundle b(bundle_filename_);
+	CPPUNIT_ASSERT_EQUAL(std::size(chunks), b.entries().size());
+	for(std::size_t i = 0; i != std::size(chunks); ++i) {
+		const bundle::entry &e = b.entries()[i];
+		CPPUNIT_ASSERT_EQUAL(chunks[i].index, e.index);
+		CPPUNIT_ASSERT_EQUAL(chunks[i].timestamp, e.timestamp);
+		CPPUNIT_ASSERT_EQUAL(static_cast<uint8_t>(chunks[i].compression_type), e.compression);
+		CPPUNIT_ASSERT(std::vector<uint8_t>(e.payload.begin(), e.payload.end()) == chunks[i].payload);
+	}
+}
+
+/**
+ * \brief Tests bundling a region with no chunks.
+ */
+void mcwutil::region::bundle_test::test_empty() {
+	writer(file_descriptor::create_open(region_filename_, O_RDWR | O_CREAT | O_TRUNC, 0666)).close();
+	bundle::write(reader(region_filename_), bundle_filename_);
+	CPPUNIT_ASSERT(bundle::is_bundle(bundle_filename_));
+	CPPUNIT_ASSERT(bundle(bundle_filename_).entries().empty());
+}
+
+/**
+ * \brief Tests telling bundles apart from other files.
+ */
+void mcwutil::region::bundle_test::test_is_bundle() {
+	make_region(region_filename_);
+	bundle::write(reader(region_filename_), bundle_filename_);
+	CPPUNIT_ASSERT(bundle::is_bundle(bundle_filename_));
+	CPPUNIT_ASSERT(!bundle::is_bundle(region_filename_));
+	CPPUNIT_ASSERT(!bundle::is_bundle(directory_));
+	file_descriptor::create_open(directory_ / "short", O_WRONLY | O_CREAT, 0666).write("MCWU", 4);
+	CPPUNIT_ASSERT(!bundle::is_bundle(directory_ / "short"));
+}
+
+/**
+ * \brief Tests that a bundle with the wrong magic number is rejected.
+ */
+void mcwutil::region::bundle_test::test_bad_magic() {
+	make_region(region_filename_);
+	bundle::write(reader(region_filename_), bundle_filename_);
+	file_descriptor::create_open(bundle_filename_, O_WRONLY, 0).pwrite("X", 1, 0);
+	CPPUNIT_ASSERT(!bundle::is_bundle(bundle_filename_));
+	CPPUNIT_ASSERT_THROW(bundle b(bundle_filename_), std::runtime_error);
+}
+
+/**
+ * \brief Tests that bundles cut short, within the header, the index or the
+ * payloads, are rejected.
+ */
+void mcwutil::region::bundle_test::test_truncated() {
+	make_region(region_filename_);
+	reader region(region_filename_);
+	bundle::write(region, bundle_filename_);
+	off_t full_size = static_cast<off_t>(std::filesystem::file_size(bundle_filename_));
+	for(off_t size : {off_t{10}, off_t{12 + 21 * 2}, full_size - 1}) {
+		bundle::write(region, bundle_filename_);
+		file_descriptor::create_open(bundle_filename_, O_WRONLY, 0).ftruncate(size);
+		CPPUNIT_ASSERT_THROW(bundle b(bundle_filename_), std::runtime_error);
+	}
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(mcwutil::region::bundle_test);
@@ -0,0 +1,209 @@
+#include <mcwutil/region/compact.hpp>
+#include <mcwutil/region/reader.hpp>
+#include <mcwutil/region/region.hpp>
+#include <mcwutil/util/codec.hpp>
+#include <mcwutil/util/file_descriptor.hpp>
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <fcntl.h>
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+namespace mcwutil::region {
+namespace {
+/**
+ * \brief A chunk that is moved by way of a staging copy past the end of the
+ * file.
+ */
+struct staged_chunk final {
+	/**
+	 * \brief The chunk’s index within the region file.
+	 */
+	unsigned int index;
+
+	/**
+	 * \brief The sector at which the staging copy starts.
+	 */
+	uint32_t staged;
+
+	/**
+	 * \brief The sector to which the chunk finally moves.
+	 */
+	uint32_t destination;
+
+	/**
+	 * \brief The number of sectors the chunk occupies.
+	 */
+	uint32_t sectors;
+
+	/**
+	 * \brief The number of bytes to copy.
+	 */
+	std::size_t bytes;
+};
+
+/**
+ * \brief Points a header entry at a new location.
+ *
+ * \param[out] header the region header to modify.
+ *
+ * \param[in] index the chunk’s index within the region file.
+ *
+ * \param[in] offset the chunk’s new location, in sectors.
+ *
+ * \param[in] sectors the number of sectors the chunk occupies.
+ */
+void set_location(std::span<uint8_t> header, unsigned int index, uint32_t offset, uint32_t sectors) {
+	codec::encode_integer<uint32_t, 3>(&header[index * 4], offset);
+	codec::encode_integer(&header[index * 4 + 3], static_cast<uint8_t>(sectors));
+}
+}
+}
+
+/**
+ * \brief Compacts a single region file in place.
+ *
+ * Chunks are packed together in file order, and sectors allocated to a chunk
+ * beyond those needed to hold its payload are released.
+ *
+ * Compaction is crash-safe: at every point, each header entry on disk refers
+ * to a complete copy of its chunk. A chunk whose new location lies wholly in
+ * dead space is copied there directly. Any other chunk would overwrite a
+ * location that the header may still refer to, so it is first copied past the
+ * end of the file, and only moved down once the header refers to that copy.
+ * Each copy reaches stable storage before the header is changed to refer to
+ * it, and each header change does so before the space it frees is reused. If
+ * compaction is interrupted, the file is left valid but may be larger than
+ * before; compacting it again finishes the job.
+ *
+ * \param[in] filename the region file to compact.
+ *
+ * \return the number of bytes by which the file shrank.
+ *
+ * \exception std::runtime_error if the region file is malformed; in that
+ * case, the file is left untouched.
+ */
+off_t mcwutil::region::compact_file(const std::filesystem::path &filename) {
+	reader region(filename);
+	if(region.file().empty()) {
+		return 0;
+	}
+
+	// Validate every chunk before touching anything, including checking that
+	// no two chunks share sectors, since sliding one would corrupt the other.
+	uint32_t previous_end = 2;
+	for(unsigned int i : region.offset_order()) {
+		if(!region.external(i)) {
+			region.payload(i);
+		}
+		if(region.sector_offset(i) < previous_end) {
+			throw std::runtime_error("Malformed region header: chunks overlap.");
+		}
+		previous_end = region.sector_offset(i) + region.sector_count(i);
+	}
+
+	// Copy each chunk that moves either straight to its new location, if that
+	// is dead space, or to a staging area past the end of the file.
+	file_descriptor fd = file_descriptor::create_open(filename, O_RDWR, 0);
+	std::array<uint8_t, 4096> header;
+	std::copy_n(region.file().begin(), header.size(), header.begin());
+	bool header_changed = false;
+	std::vector<staged_chunk> staged;
+	uint32_t write_ptr = 2;
+	uint32_t stage_ptr = static_cast<uint32_t>((region.file().size() + 4095) / 4096);
+	previous_end = 2;
+	for(unsigned int i : region.offset_order()) {
+		// An external chunk leaves only its length and compression type in
+		// the region.
+		std::size_t chunk_bytes = 5 + (region.external(i) ? 0 : region.payload(i).size());
+		uint32_t needed = static_cast<uint32_t>((chunk_bytes + 4095) / 4096);
+		uint32_t offset = region.sector_offset(i);
+		const uint8_t *source = &region.file()[static_cast<std::size_t>(offset) * 4096];
+		if(offset != write_ptr && (write_ptr < previous_end || write_ptr + needed > offset)) {
+			fd.pwrite(source, chunk_bytes, static_cast<off_t>(stage_ptr) * 4096);
+			staged.push_back({i, stage_ptr, write_ptr, needed, chunk_bytes});
+			set_location(header, i, stage_ptr, needed);
+			header_changed = true;
+			stage_ptr += needed;
+		} else {
+			if(offset != write_ptr) {
+				fd.pwrite(source, chunk_bytes, static_cast<off_t>(write_ptr) * 4096);
+			}
+			if(offset != write_ptr || region.sector_count(i) != needed) {
+				set_location(header, i, write_ptr, needed);
+				header_changed = true;
+			}
+		}
+		previous_end = offset + region.sector_count(i);
+		write_ptr += needed;
+	}
+	if(header_changed) {
+		fd.fdatasync();
+		fd.pwrite(header.data(), header.size(), 0);
+		fd.fdatasync();
+	}
+
+	// Move the staged chunks down to their final locations, which the header
+	// no longer refers to.
+	if(!staged.empty()) {
+		std::vector<uint8_t> buffer;
+		for(const staged_chunk &i : staged) {
+			buffer.resize(i.bytes);
+			fd.pread(buffer.data(), buffer.size(), static_cast<off_t>(i.staged) * 4096);
+			fd.pwrite(buffer.data(), buffer.size(), static_cast<off_t>(i.destination) * 4096);
+			set_location(header, i.index, i.destination, i.sectors);
+		}
+		fd.fdatasync();
+		fd.pwrite(header.data(), header.size(), 0);
+		fd.fdatasync();
+	}
+
+	// Trim the dead space from the end of the file.
+	off_t old_size = static_cast<off_t>(region.file().size());
+	off_t new_size = static_cast<off_t>(write_ptr) * 4096;
+	fd.ftruncate(new_size);
+	fd.close();
+	return old_size - new_size;
+}
+
+/**
+ * \brief Entry point for the \c region-compact utility.
+ *
+ * \param[in] appname The name of the application.
+ *
+ * \param[in] args the command-line arguments.
+ *
+ * \return the application exit code.
+ */
+int mcwutil::region::compact(std::string_view appname, std::span<char *> args) {
+	// Check parameters.
+	if(args.empty()) {
+		std::cerr << "Usage:\n";
+		std::cerr << appname << " region-compact regionfile [regionfile ...]\n";
+		std::cerr << '\n';
+		std::cerr << "Removes unused sectors from region files in place, moving chunks together and truncating the files.\n";
+		std::cerr << "The files must not be in use by a running server. Compaction is crash-safe: if it is interrupted,\n";
+		std::cerr << "every chunk is still intact, though a file may be larger than before until it is compacted again.\n";
+		std::cerr << '\n';
+		std::cerr << "Arguments:\n";
+		std::cerr << "  regionfile - a .mca or .mcr file to compact\n";
+		return 1;
+	}
+
+	// Compact each file.
+	off_t total = 0;
+	for(const char *i : args) {
+		off_t reclaimed = compact_file(i);
+		std::cout << i << ": reclaimed " << reclaimed << " bytes\n";
+		total += reclaimed;
+	}
+	if(args.size() > 1) {
+		std::cout << "Total: reclaimed " << total << " bytes\n";
+	}
+
+	return 0;
+}
@@ -0,0 +1,11 @@
+#ifndef REGION_COMPACT_H
+#define REGION_COMPACT_H
+
+#include <filesystem>
+#include <sys/types.h>
+
+namespace mcwutil::region {
+off_t compact_file(const std::filesystem::path &filename);
+}
+
+#endif
@@ -0,0 +1,146 @@
+#include <mcwutil/region/compression.hpp>
+#include <mcwutil/lz4_utils.hpp>
+#include <mcwutil/zlib_utils.hpp>
+#include <stdexcept>
+
+using namespace std::literals::string_view_literals;
+
+/**
+ * \brief Checks whether a compression type byte is one that is understood.
+ *
+ * \param[in] type the compression type byte.
+ *
+ * \return \c true if \p type is a valid \ref compression value.
+ */
+bool mcwutil::region::valid_compression(uint8_t type) {
+	return type >= COMPRESSION_GZIP && type <= COMPRESSION_LZ4;
+}
+
+/**
+ * \brief Parses a compression type given on the command line.
+ *
+ * \param[in] name the name (\c gzip, \c zlib, \c none, or \c lz4) or number of
+ * the compression type.
+ *
+ * \return the compression type, or nothing if \p name is not recognized.
+ */
+std::optional<mcwutil::region::compression> mcwutil::region::parse_compression(std::string_view name) {
+	if(name == "gzip"sv || name == "1"sv) {
+		return COMPRESSION_GZIP;
+	} else if(name == "zlib"sv || name == "2"sv) {
+		return COMPRESSION_ZLIB;
+	} else if(name == "none"sv || name == "3"sv) {
+		return COMPRESSION_NONE;
+	} else if(name == "lz4"sv || name == "4"sv) {
+		return COMPRESSION_LZ4;
+	} else {
+		return std::nullopt;
+	}
+}
+
+/**
+ * \brief Returns the filename extension used for unpacked chunks.
+ *
+ * \param[in] type the compression type of the chunk.
+ *
+ * \return the extension, including the leading dot.
+ */
+const char *mcwutil::region::compression_extension(compression type) {
+	switch(type) {
+		case COMPRESSION_GZIP:
+			return ".nbt.gz";
+		case COMPRESSION_ZLIB:
+			return ".nbt.zlib";
+		case COMPRESSION_NONE:
+			return ".nbt";
+		case COMPRESSION_LZ4:
+			return ".nbt.lz4";
+	}
+	throw std::logic_error("Internal error: invalid compression type.");
+}
+
+/**
+ * \brief Works out the compression type of an unpacked chunk from its file
+ * name.
+ *
+ * \param[in] filename the name of the file.
+ *
+ * \return the compression type whose \ref compression_extension the name ends
+ * with, or nothing if it ends with none of them.
+ */
+std::optional<mcwutil::region::compression> mcwutil::region::compression_from_filename(std::string_view filename) {
+	for(compression i : {COMPRESSION_GZIP, COMPRESSION_ZLIB, COMPRESSION_NONE, COMPRESSION_LZ4}) {
+		if(filename.ends_with(compression_extension(i))) {
+			return i;
+		}
+	}
+	return std::nullopt;
+}
+
+/**
+ * \brief Decompresses a chunk payload.
+ *
+ * \param[in] payload the compressed payload.
+ *
+ * \param[in] type the compression type of the payload.
+ *
+ * \return the uncompressed NBT data.
+ */
+std::vector<uint8_t> mcwutil::region::decompress(std::span<const uint8_t> payload, compression type) {
+	switch(type) {
+		case COMPRESSION_GZIP:
+		case COMPRESSION_ZLIB:
+			return zlib::decompress_buffer(payload);
+		case COMPRESSION_NONE:
+			return std::vector<uint8_t>(payload.begin(), payload.end());
+		case COMPRESSION_LZ4:
+			return lz4::decompress_buffer(payload);
+	}
+	throw std::runtime_error("Malformed chunk: unrecognized compression type.");
+}
+
+/**
+ * \brief Compresses a chunk payload.
+ *
+ * \param[in] data the uncompressed NBT data.
+ *
+ * \param[in] type the compression type to use.
+ *
+ * \return the compressed payload.
+ */
+std::vector<uint8_t> mcwutil::region::compress(std::span<const uint8_t> data, compression type) {
+	switch(type) {
+		case COMPRESSION_GZIP:
+			return zlib::compress_buffer(data, 9, zlib::FORMAT_GZIP);
+		case COMPRESSION_ZLIB:
+			return zlib::compress_buffer(data, 9, zlib::FORMAT_ZLIB);
+		case COMPRESSION_NONE:
+			return std::vector<uint8_t>(data.begin(), data.end());
+		case COMPRESSION_LZ4:
+			return lz4::compress_buffer(data);
+	}
+	throw std::logic_error("Internal error: invalid compression type.");
+}
+
+/**
+ * \brief Compresses a chunk payload as small as possible.
+ *
+ * For the deflate-based types, several levels and strategies are tried; the
+ * other types have only one way of compressing.
+ *
+ * \param[in] data the uncompressed NBT data.
+ *
+ * \param[in] type the compression type to use.
+ *
+ * \return the compressed payload.
+ */
+std::vector<uint8_t> mcwutil::region::compress_smallest(std::span<const uint8_t> data, compression type) {
+	switch(type) {
+		case COMPRESSION_GZIP:
+			return zlib::compress_buffer_smallest(data, zlib::FORMAT_GZIP);
+		case COMPRESSION_ZLIB:
+			return zlib::compress_buffer_smallest(data, zlib::FORMAT_ZLIB);
+		default:
+			return compress(data, type);
+	}
+}
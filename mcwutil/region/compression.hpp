@@ -0,0 +1,51 @@
+#ifndef REGION_COMPRESSION_H
+#define REGION_COMPRESSION_H
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace mcwutil::region {
+/**
+ * \brief The possible compression types of a chunk payload.
+ */
+enum compression {
+	/**
+	 * \brief The payload is a gzip stream.
+	 */
+	COMPRESSION_GZIP = 1,
+
+	/**
+	 * \brief The payload is a zlib stream.
+	 */
+	COMPRESSION_ZLIB = 2,
+
+	/**
+	 * \brief The payload is stored uncompressed.
+	 */
+	COMPRESSION_NONE = 3,
+
+	/**
+	 * \brief The payload is an LZ4 block stream.
+	 */
+	COMPRESSION_LZ4 = 4,
+};
+
+/**
+ * \brief The bit set in a chunk’s compression type byte when its payload is
+ * too large for the region and is stored in a separate file instead.
+ */
+constexpr uint8_t COMPRESSION_EXTERNAL = 128;
+
+bool valid_compression(uint8_t type);
+std::optional<compression> parse_compression(std::string_view name);
+const char *compression_extension(compression type);
+std::optional<compression> compression_from_filename(std::string_view filename);
+std::vector<uint8_t> decompress(std::span<const uint8_t> payload, compression type);
+std::vector<uint8_t> compress(std::span<const uint8_t> data, compression type);
+std::vector<uint8_t> compress_smallest(std::span<const uint8_t> data, compression type);
+}
+
+#endif
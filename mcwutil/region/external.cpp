@@ -0,0 +1,84 @@
+#include <mcwutil/region/external.hpp>
+#include <mcwutil/util/string.hpp>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+using namespace std::literals::string_view_literals;
+
+/**
+ * \brief Parses a coordinate pair given on the command line.
+ *
+ * \param[in] s the string to parse, of the form <code>X,Z</code>.
+ *
+ * \return the coordinates, or nothing if \p s is not of the right form.
+ */
+std::optional<mcwutil::region::coordinates> mcwutil::region::parse_coordinates(std::string_view s) {
+	std::size_t comma = s.find(',');
+	if(comma == std::string_view::npos) {
+		return std::nullopt;
+	}
+	try {
+		return coordinates{string::fromdecs32(s.substr(0, comma)), string::fromdecs32(s.substr(comma + 1))};
+	} catch(const std::system_error &) {
+		return std::nullopt;
+	}
+}
+
+/**
+ * \brief Parses the name of an Anvil region file.
+ *
+ * \param[in] filename the path to the file, whose final component should have
+ * the form <code>r.X.Z.mca</code>.
+ *
+ * \return the coordinates of the region, or nothing if the name is not of the
+ * right form.
+ */
+std::optional<mcwutil::region::coordinates> mcwutil::region::parse_region_filename(const std::filesystem::path &filename) {
+	std::string name = filename.filename().string();
+	std::string_view view(name);
+	if(!view.starts_with("r."sv) || !view.ends_with(".mca"sv)) {
+		return std::nullopt;
+	}
+	view.remove_prefix(2);
+	view.remove_suffix(4);
+	std::size_t dot = view.find('.');
+	if(dot == std::string_view::npos) {
+		return std::nullopt;
+	}
+	try {
+		return coordinates{string::fromdecs32(view.substr(0, dot)), string::fromdecs32(view.substr(dot + 1))};
+	} catch(const std::system_error &) {
+		return std::nullopt;
+	}
+}
+
+/**
+ * \brief Returns the name of the file holding a chunk too large to fit in its
+ * region.
+ *
+ * Such a chunk is stored in <code>c.X.Z.mcc</code>, where X and Z are the
+ * global chunk coordinates, alongside the region file.
+ *
+ * \param[in] region_filename the region file.
+ *
+ * \param[in] index the index of the chunk within the region.
+ *
+ * \return the name of the external chunk file.
+ *
+ * \exception std::runtime_error if \p region_filename is not of the form
+ * <code>r.X.Z.mca</code>, so the chunk’s coordinates are unknown.
+ */
+std::filesystem::path mcwutil::region::external_filename(const std::filesystem::path &region_filename, unsigned int index) {
+	std::optional<coordinates> region = parse_region_filename(region_filename);
+	if(!region) {
+		throw std::runtime_error("Cannot locate external chunk: region file name is not of the form r.X.Z.mca.");
+	}
+	std::string name("c.");
+	name += string::todecs(region->x * 32 + static_cast<int>(index % 32));
+	name += '.';
+	name += string::todecs(region->z * 32 + static_cast<int>(index / 32));
+	name += ".mcc";
+	return region_filename.parent_path() / name;
+}
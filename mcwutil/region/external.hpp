@@ -0,0 +1,29 @@
+#ifndef REGION_EXTERNAL_H
+#define REGION_EXTERNAL_H
+
+#include <filesystem>
+#include <optional>
+#include <string_view>
+
+namespace mcwutil::region {
+/**
+ * \brief The position of a region, or of a chunk, within its dimension.
+ */
+struct coordinates final {
+	/**
+	 * \brief The X coordinate.
+	 */
+	int x;
+
+	/**
+	 * \brief The Z coordinate.
+	 */
+	int z;
+};
+
+std::optional<coordinates> parse_coordinates(std::string_view s);
+std::optional<coordinates> parse_region_filename(const std::filesystem::path &filename);
+std::filesystem::path external_filename(const std::filesystem::path &region_filename, unsigned int index);
+}
+
+#endif
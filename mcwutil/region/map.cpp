@@ -0,0 +1,236 @@
+#include <mcwutil/nbt/nbt.hpp>
+#include <mcwutil/region/compression.hpp>
+#include <mcwutil/region/reader.hpp>
+#include <mcwutil/region/region.hpp>
+#include <mcwutil/region/state.hpp>
+#include <mcwutil/region/writer.hpp>
+#include <mcwutil/util/string.hpp>
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+using namespace std::literals::string_view_literals;
+
+namespace mcwutil::region {
+namespace {
+/**
+ * \brief A transformation applied to the uncompressed NBT of each chunk.
+ */
+using transform = std::function<void(std::vector<uint8_t> &)>;
+
+/**
+ * \brief Parses a comma-separated list of <code>from=to</code> pairs.
+ *
+ * \param[in] spec the list to parse.
+ *
+ * \param[in] max the largest permitted value on either side of a pair.
+ *
+ * \return the pairs.
+ *
+ * \exception std::invalid_argument if \p spec is malformed or a value exceeds
+ * \p max.
+ */
+std::vector<std::pair<unsigned int, unsigned int>> parse_pairs(std::string_view spec, unsigned int max) {
+	std::vector<std::pair<unsigned int, unsigned int>> ret;
+	while(!spec.empty()) {
+		std::string_view pair = spec.substr(0, spec.find(','));
+		spec.remove_prefix(std::min(spec.size(), pair.size() + 1));
+		std::size_t equals = pair.find('=');
+		if(equals == std::string_view::npos) {
+			throw std::invalid_argument("substitution is not of the form from=to");
+		}
+		unsigned int from, to;
+		try {
+			from = string::fromdecui(pair.substr(0, equals));
+			to = string::fromdecui(pair.substr(equals + 1));
+		} catch(const std::system_error &) {
+			throw std::invalid_argument("substitution value is not an integer");
+		}
+		if(from > max || to > max) {
+			throw std::invalid_argument("substitution value out of range");
+		}
+		ret.emplace_back(from, to);
+	}
+	if(ret.empty()) {
+		throw std::invalid_argument("empty substitution list");
+	}
+	return ret;
+}
+
+/**
+ * \brief Parses a transformation specification from the command line.
+ *
+ * \param[in] spec the specification.
+ *
+ * \return the transformation.
+ *
+ * \exception std::invalid_argument if \p spec is malformed.
+ */
+transform parse_transform(std::string_view spec) {
+	if(spec.starts_with("block-substitute:"sv)) {
+		std::array<uint16_t, 4096> sub_table;
+		for(unsigned int i = 0; i < 4096; ++i) {
+			sub_table[i] = static_cast<uint16_t>(i);
+		}
+		for(const auto &[from, to] : parse_pairs(spec.substr("block-substitute:"sv.size()), 4095)) {
+			sub_table[from] = static_cast<uint16_t>(to);
+		}
+		return [sub_table](std::vector<uint8_t> &nbt) {
+			nbt = nbt::substitute_blocks(nbt, sub_table);
+		};
+	} else if(spec.starts_with("patch-barray:"sv)) {
+		spec.remove_prefix("patch-barray:"sv.size());
+		std::size_t colon = spec.rfind(':');
+		if(colon == std::string_view::npos) {
+			throw std::invalid_argument("patch-barray transform has no path");
+		}
+		std::vector<std::u8string> path = nbt::split_path(string::l2u(spec.substr(0, colon)));
+		std::array<uint8_t, 256> sub_table;
+		for(unsigned int i = 0; i < 256; ++i) {
+			sub_table[i] = static_cast<uint8_t>(i);
+		}
+		for(const auto &[from, to] : parse_pairs(spec.substr(colon + 1), 255)) {
+			sub_table[from] = static_cast<uint8_t>(to);
+		}
+		return [path = std::move(path), sub_table](std::vector<uint8_t> &nbt) {
+			nbt::patch_byte_arrays(nbt, path, sub_table);
+		};
+	} else {
+		throw std::invalid_argument("unrecognized transform");
+	}
+}
+
+/**
+ * \brief Displays the usage help text.
+ *
+ * \param[in] appname The name of the application.
+ */
+void usage(std::string_view appname) {
+	std::cerr << "Usage:\n";
+	std::cerr << appname << " region-map [--state statefile] inregion outregion transform1 [transform2 ...]\n";
+	std::cerr << '\n';
+	std::cerr << "Applies NBT transformations to every chunk in a region file, without unpacking it.\n";
+	std::cerr << '\n';
+	std::cerr << "Arguments:\n";
+	std::cerr << "  --state - skip chunks left unchanged since the run that last updated statefile; as the recorded state is that of\n";
+	std::cerr << "            the output, chunks can only be skipped when inregion equals outregion, and the state is discarded if the\n";
+	std::cerr << "            regions or transformations differ from that run\n";
+	std::cerr << "  inregion - the .mca or .mcr file to read\n";
+	std::cerr << "  outregion - the region file to create or replace (may be equal to inregion)\n";
+	std::cerr << "  transform1 - the first transformation to apply to each chunk (see below)\n";
+	std::cerr << '\n';
+	std::cerr << "Transformations are applied in the order given, and are one of:\n";
+	std::cerr << "  block-substitute:from1=to1[,from2=to2...] - replaces block IDs in the terrain, as nbt-block-substitute\n";
+	std::cerr << "  patch-barray:path:from1=to1[,from2=to2...] - replaces byte values in byte arrays, as nbt-patch-barray\n";
+}
+}
+}
+
+/**
+ * \brief Entry point for the \c region-map utility.
+ *
+ * \param[in] appname The name of the application.
+ *
+ * \param[in] args the command-line arguments.
+ *
+ * \return the application exit code.
+ */
+int mcwutil::region::map(std::string_view appname, std::span<char *> args) {
+	// Check parameters.
+	std::optional<std::filesystem::path> state_filename;
+	if(args.size() >= 2 && args[0] == "--state"sv) {
+		state_filename = args[1];
+		args = args.subspan(2);
+	}
+	if(args.size() < 3) {
+		usage(appname);
+		return 1;
+	}
+
+	// Extract provided pathnames.
+	const char *input_filename = args[0];
+	const std::filesystem::path output_filename(args[1]);
+
+	// Parse the transformations.
+	std::vector<transform> transforms;
+	for(const char *i : args.subspan(2)) {
+		try {
+			transforms.push_back(parse_transform(i));
+		} catch(const std::invalid_argument &) {
+			usage(appname);
+			return 1;
+		}
+	}
+
+	// Open the input region file and, if given, the state of the previous run.
+	// The state is only valid for the same regions and transformations.
+	reader input(input_filename);
+	std::optional<state> previous;
+	if(state_filename) {
+		std::vector<std::string> identity{"region-map", std::filesystem::weakly_canonical(input_filename).string(), std::filesystem::weakly_canonical(output_filename).string()};
+		for(const char *i : args.subspan(2)) {
+			identity.emplace_back(i);
+		}
+		previous.emplace(*state_filename, state::fingerprint(identity));
+	}
+
+	// Build the output in a temporary file alongside the final one, so that the
+	// input and output may be the same file.
+	writer output = writer::replace(output_filename);
+
+	// Transform each chunk, visiting them in file order so the input is read
+	// sequentially.
+	for(unsigned int i = 0; i < 1024; ++i) {
+		if(previous && !input.present(i)) {
+			previous->clear(i);
+		}
+	}
+	for(unsigned int i : input.offset_order()) {
+		std::span<const uint8_t> payload = input.payload(i);
+		uint8_t compression_type = input.compression(i);
+		if(!valid_compression(compression_type)) {
+			throw std::runtime_error("Malformed chunk: unrecognized compression type.");
+		}
+
+		// A chunk whose timestamp and contents match what the previous run
+		// wrote has already been transformed, so copy it verbatim.
+		if(previous && previous->unchanged(i, input.timestamp(i), state::content_hash(payload))) {
+			output.write(i, payload, compression_type, input.timestamp(i));
+			continue;
+		}
+
+		// Decompress, transform, and recompress the chunk, keeping its
+		// compression type.
+		std::vector<uint8_t> nbt = decompress(payload, static_cast<compression>(compression_type));
+		for(const transform &j : transforms) {
+			j(nbt);
+		}
+		std::vector<uint8_t> compressed = compress(nbt, static_cast<compression>(compression_type));
+
+		// Write the chunk to the output file.
+		output.write(i, compressed, compression_type, input.timestamp(i));
+		if(previous) {
+			previous->set(i, input.timestamp(i), state::content_hash(compressed));
+		}
+	}
+
+	// Move the new file and its external chunk files into place, removing the
+	// old external files it no longer needs, and record what it now holds.
+	output.commit();
+	if(previous) {
+		previous->save();
+	}
+
+	return 0;
+}
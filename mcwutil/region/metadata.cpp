@@ -0,0 +1,224 @@
+#include <mcwutil/region/compression.hpp>
+#include <mcwutil/region/metadata.hpp>
+#include <mcwutil/region/reader.hpp>
+#include <mcwutil/util/codec.hpp>
+#include <mcwutil/util/file_descriptor.hpp>
+#include <mcwutil/util/string.hpp>
+#include <mcwutil/util/xml.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <fcntl.h>
+#include <libxml/tree.h>
+#include <stdexcept>
+#include <string_view>
+#include <sys/stat.h>
+#include <vector>
+
+using namespace std::literals::string_view_literals;
+
+namespace mcwutil::region {
+namespace {
+/**
+ * \brief The magic number at the start of every binary metadata file.
+ */
+constexpr std::string_view MAGIC = "MCWUMETA"sv;
+
+/**
+ * \brief The size of a binary metadata file.
+ */
+constexpr std::size_t BINARY_SIZE = MAGIC.size() + 8192 + 1024;
+
+/**
+ * \brief Loads the metadata from a \c metadata.bin file.
+ *
+ * \param[in] filename the file to load.
+ *
+ * \return the metadata.
+ *
+ * \exception std::runtime_error if the file is malformed.
+ */
+region_metadata load_binary(const std::filesystem::path &filename) {
+	file_descriptor fd = file_descriptor::create_open(filename, O_RDONLY, 0);
+	struct stat stbuf;
+	fd.fstat(stbuf);
+	if(stbuf.st_size != static_cast<off_t>(BINARY_SIZE)) {
+		throw std::runtime_error("Malformed metadata.bin: wrong size.");
+	}
+	std::vector<uint8_t> data(BINARY_SIZE);
+	fd.read(data.data(), data.size());
+	if(!std::equal(MAGIC.begin(), MAGIC.end(), data.begin())) {
+		throw std::runtime_error("Malformed metadata.bin: bad magic number.");
+	}
+	const uint8_t *header = &data[MAGIC.size()];
+	const uint8_t *compressions = header + 8192;
+	region_metadata ret;
+	for(unsigned int i = 0; i < 1024; ++i) {
+		chunk_metadata &m = ret[i];
+		m.present = codec::decode_integer<uint32_t>(&header[i * 4]) != 0;
+		m.timestamp = m.present ? codec::decode_integer<uint32_t>(&header[4096 + i * 4]) : 0;
+		m.compression = compressions[i];
+		if(m.present && !valid_compression(m.compression)) {
+			throw std::runtime_error("Malformed metadata.bin: unrecognized compression type.");
+		}
+	}
+	return ret;
+}
+
+/**
+ * \brief Loads the metadata from a \c metadata.xml file.
+ *
+ * \param[in] filename the file to load.
+ *
+ * \return the metadata.
+ *
+ * \exception std::runtime_error if the file is malformed.
+ */
+region_metadata load_xml(const std::filesystem::path &filename) {
+	auto metadata_document = xml::parse(filename.c_str());
+	const xmlNode &metadata_root_elt = *xmlDocGetRootElement(metadata_document.get());
+	if(xml::node_name(metadata_root_elt) != u8"minecraft-region-metadata"sv) {
+		throw std::runtime_error("Malformed metadata.xml: improper root node name.");
+	}
+
+	// Iterate the chunk elements in the metadata file.
+	// There should be 1024 of them with distinct indices.
+	// Keep track of which have been seen.
+	std::array<bool, 1024> seen_indices;
+	std::fill(seen_indices.begin(), seen_indices.end(), false);
+	region_metadata ret;
+	for(const xmlNode *i = metadata_root_elt.children; i; i = i->next) {
+		if(i->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+		unsigned int index = string::fromdecui(string::u2l(xml::node_attr(*i, u8"index")));
+		unsigned int present = string::fromdecui(string::u2l(xml::node_attr(*i, u8"present")));
+		uint32_t timestamp;
+		{
+			const char8_t *timestamp_raw = xml::node_attr(*i, u8"timestamp");
+			if(timestamp_raw) {
+				timestamp = string::fromdecu32(string::u2l(timestamp_raw));
+			} else {
+				timestamp = 0;
+			}
+		}
+		uint8_t compression_type = COMPRESSION_ZLIB;
+		{
+			const char8_t *compression_raw = xml::node_attr(*i, u8"compression");
+			if(compression_raw) {
+				unsigned int compression_number = string::fromdecui(string::u2l(compression_raw));
+				if(compression_number > 255 || !valid_compression(static_cast<uint8_t>(compression_number))) {
+					throw std::runtime_error("Malformed metadata.xml: unrecognized compression type.");
+				}
+				compression_type = static_cast<uint8_t>(compression_number);
+			}
+		}
+
+		if(index >= 1024) {
+			throw std::runtime_error("Malformed metadata.xml: chunk index out of range.");
+		}
+		if(seen_indices[index]) {
+			throw std::runtime_error("Malformed metadata.xml: repeated chunk index.");
+		}
+		seen_indices[index] = true;
+		ret[index] = {present != 0, timestamp, compression_type};
+	}
+
+	// Check if all values have been seen.
+	if(std::find(seen_indices.begin(), seen_indices.end(), false) != seen_indices.end()) {
+		throw std::runtime_error("Malformed metadata.xml: not every chunk index is present.");
+	}
+	return ret;
+}
+
+/**
+ * \brief Writes a \c metadata.bin file.
+ *
+ * \param[in] filename the file to write.
+ *
+ * \param[in] region the region whose metadata to write.
+ */
+void save_binary(const std::filesystem::path &filename, const reader &region) {
+	std::vector<uint8_t> data(BINARY_SIZE, 0);
+	std::copy(MAGIC.begin(), MAGIC.end(), data.begin());
+	std::span<const uint8_t> header = region.header();
+	std::copy(header.begin(), header.end(), data.begin() + MAGIC.size());
+	for(unsigned int i : region.offset_order()) {
+		data[MAGIC.size() + 8192 + i] = region.compression(i);
+	}
+	file_descriptor fd = file_descriptor::create_open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	fd.write(data.data(), data.size());
+	fd.close();
+}
+
+/**
+ * \brief Writes a \c metadata.xml file.
+ *
+ * \param[in] filename the file to write.
+ *
+ * \param[in] region the region whose metadata to write.
+ */
+void save_xml(const std::filesystem::path &filename, const reader &region) {
+	auto metadata_document = xml::empty();
+	xml::internal_subset(*metadata_document, u8"minecraft-region-metadata", nullptr, u8"urn:uuid:5e7a5ee0-2a7b-11e1-9e08-1c4bd68d068e");
+	xmlNode &metadata_root_elt = xml::node_create_root(*metadata_document, u8"minecraft-region-metadata");
+	for(unsigned int i = 0; i < 1024; ++i) {
+		xmlNode &metadata_chunk_elt = xml::node_append_child(metadata_root_elt, u8"chunk");
+		xml::node_attr(metadata_chunk_elt, u8"index", string::l2u(string::todecu(i)).c_str());
+		if(region.present(i)) {
+			xml::node_attr(metadata_chunk_elt, u8"present", u8"1");
+			xml::node_attr(metadata_chunk_elt, u8"timestamp", string::l2u(string::todecu(region.timestamp(i))).c_str());
+			xml::node_attr(metadata_chunk_elt, u8"compression", string::l2u(string::todecu(region.compression(i))).c_str());
+		} else {
+			xml::node_attr(metadata_chunk_elt, u8"present", u8"0");
+		}
+	}
+	file_descriptor fd = file_descriptor::create_open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	xml::write(*metadata_document, fd);
+	fd.close();
+}
+}
+}
+
+/**
+ * \brief Loads the metadata of an unpacked region.
+ *
+ * \c metadata.bin is used if it exists, and \c metadata.xml otherwise.
+ *
+ * \param[in] directory the directory holding the unpacked region.
+ *
+ * \return the metadata.
+ *
+ * \exception std::runtime_error if the metadata is malformed.
+ */
+mcwutil::region::region_metadata mcwutil::region::load_metadata(const std::filesystem::path &directory) {
+	std::filesystem::path binary_filename = directory / "metadata.bin";
+	if(std::filesystem::exists(binary_filename)) {
+		return load_binary(binary_filename);
+	}
+	return load_xml(directory / "metadata.xml");
+}
+
+/**
+ * \brief Saves the metadata of a region being unpacked.
+ *
+ * A metadata file of the other form left over from an earlier unpack is
+ * removed, so that it cannot be picked up in place of the new one.
+ *
+ * \pre The compression type of every present chunk is valid.
+ *
+ * \param[in] directory the directory holding the unpacked region.
+ *
+ * \param[in] region the region being unpacked.
+ *
+ * \param[in] binary \c true to write \c metadata.bin, or \c false to write \c
+ * metadata.xml.
+ */
+void mcwutil::region::save_metadata(const std::filesystem::path &directory, const reader &region, bool binary) {
+	if(binary) {
+		save_binary(directory / "metadata.bin", region);
+		std::filesystem::remove(directory / "metadata.xml");
+	} else {
+		save_xml(directory / "metadata.xml", region);
+		std::filesystem::remove(directory / "metadata.bin");
+	}
+}
@@ -0,0 +1,48 @@
+#ifndef REGION_METADATA_H
+#define REGION_METADATA_H
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+
+namespace mcwutil::region {
+class reader;
+
+/**
+ * \brief The metadata of one chunk of an unpacked region.
+ */
+struct chunk_metadata final {
+	/**
+	 * \brief Whether the chunk is present.
+	 */
+	bool present;
+
+	/**
+	 * \brief The last-modified time of the chunk.
+	 */
+	uint32_t timestamp;
+
+	/**
+	 * \brief The compression type of the chunk.
+	 */
+	uint8_t compression;
+};
+
+/**
+ * \brief The metadata of every chunk of an unpacked region.
+ *
+ * The metadata is stored alongside the chunk files in one of two forms.
+ * \c metadata.xml holds one element per chunk and is meant to be read and
+ * edited by people. \c metadata.bin is built and parsed with almost no work;
+ * it consists of the eight-byte magic number \c MCWUMETA, a verbatim copy of
+ * the 8 KiB region header, and 1024 compression type bytes, zero for absent
+ * chunks. Only whether each location is nonzero is taken from the copied
+ * header, since packing lays the chunks out afresh.
+ */
+using region_metadata = std::array<chunk_metadata, 1024>;
+
+region_metadata load_metadata(const std::filesystem::path &directory);
+void save_metadata(const std::filesystem::path &directory, const reader &region, bool binary);
+}
+
+#endif
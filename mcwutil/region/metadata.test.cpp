@@ -0,0 +1,159 @@
+#include <mcwutil/region/compression.hpp>
+#include <mcwutil/region/metadata.hpp>
+#include <mcwutil/region/reader.hpp>
+#include <mcwutil/region/writer.hpp>
+#include <mcwutil/util/file_descriptor.hpp>
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+namespace mcwutil::region {
+namespace {
+/**
+ * \brief Verifies that region metadata is saved and loaded back properly.
+ */
+class metadata_test final : public CppUnit::TestFixture {
+	public:
+	CPPUNIT_TEST_SUITE(metadata_test);
+	CPPUNIT_TEST(test_round_trip_binary);
+	CPPUNIT_TEST(test_round_trip_xml);
+	CPPUNIT_TEST(test_replaces_other_form);
+	CPPUNIT_TEST(test_bad_magic);
+	CPPUNIT_TEST(test_truncated);
+	CPPUNIT_TEST_SUITE_END();
+
+	void setUp() override;
+	void tearDown() override;
+
+	private:
+	/**
+	 * \brief A directory holding the files of one test, removed afterwards.
+	 */
+	std::filesystem::path directory_;
+
+	void test_round_trip_binary();
+	void test_round_trip_xml();
+	void test_replaces_other_form();
+	void test_bad_magic();
+	void test_truncated();
+};
+
+/**
+ * \brief Writes a region file holding a few chunks of different compression
+ * types.
+ *
+ * \param[in] filename the file to create.
+ */
+void make_region(const std::filesystem::path &filename) {
+	writer w(file_descriptor::create_open(filename, O_RDWR | O_CREAT | O_TRUNC, 0666));
+	const uint8_t payload[] = {1, 2, 3};
+	w.write(0, payload, COMPRESSION_ZLIB, 100);
+	w.write(7, payload, COMPRESSION_GZIP, 200);
+	w.write(500, payload, COMPRESSION_NONE, 0);
+	w.write(1023, payload, COMPRESSION_LZ4, 0xFFFFFFFF);
+	w.close();
+}
+
+/**
+ * \brief Checks that loaded metadata matches the region made by \ref
+ * make_region.
+ *
+ * \param[in] metadata the metadata.
+ */
+void check_metadata(const region_metadata &metadata) {
+	for(unsigned int i = 0; i != 1024; ++i) {
+		bool expected = i == 0 || i == 7 || i == 500 || i == 1023;
+		CPPUNIT_ASSERT_EQUAL(expected, metadata[i].present);
+	}
+	CPPUNIT_ASSERT_EQUAL(uint32_t{100}, metadata[0].timestamp);
+	CPPUNIT_ASSERT_EQUAL(static_cast<uint8_t>(COMPRESSION_ZLIB), metadata[0].compression);
+	CPPUNIT_ASSERT_EQUAL(uint32_t{200}, metadata[7].timestamp);
+	CPPUNIT_ASSERT_EQUAL(static_cast<uint8_t>(COMPRESSION_GZIP), metadata[7].compression);
+	CPPUNIT_ASSERT_EQUAL(uint32_t{0}, metadata[500].timestamp);
+	CPPUNIT_ASSERT_EQUAL(static_cast<uint8_t>(COMPRESSION_NONE), metadata[500].compression);
+	CPPUNIT_ASSERT_EQUAL(uint32_t{0xFFFFFFFF}, metadata[1023].timestamp);
+	CPPUNIT_ASSERT_EQUAL(static_cast<uint8_t>(COMPRESSION_LZ4), metadata[1023].compression);
+}
+}
+}
+
+/**
+ * \brief Creates the directory for the test, holding a region file.
+ */
+void mcwutil::region::metadata_test::setUp() {
+	std::string name = (std::filesystem::temp_directory_path() / "mcwutil-test-XXXXXX").string();
+	if(!mkdtemp(name.data())) {
+		throw std::system_error(errno, std::system_category(), "mkdtemp");
+	}
+	directory_ = name;
+	make_region(directory_ / "r.0.0.mca");
+}
+
+/**
+ * \brief Removes the directory for the test.
+ */
+void mcwutil::region::metadata_test::tearDown() {
+	std::filesystem::remove_all(directory_);
+}
+
+/**
+ * \brief Tests saving and loading \c metadata.bin.
+ */
+void mcwutil::region::metadata_test::test_round_trip_binary() {
+	save_metadata(directory_, reader(directory_ / "r.0.0.mca"), true);
+	CPPUNIT_ASSERT(std::filesystem::exists(directory_ / "metadata.bin"));
+	check_metadata(load_metadata(directory_));
+}
+
+/**
+ * \brief Tests saving and loading \c metadata.xml.
+ */
+void mcwutil::region::metadata_test::test_round_trip_xml() {
+	save_metadata(directory_, reader(directory_ / "r.0.0.mca"), false);
+	CPPUNIT_ASSERT(std::filesystem::exists(directory_ / "metadata.xml"));
+	check_metadata(load_metadata(directory_));
+}
+
+/**
+ * \brief Tests that saving either form removes a leftover file of the other.
+ */
+void mcwutil::region::metadata_test::test_replaces_other_form() {
+	reader region(directory_ / "r.0.0.mca");
+	save_metadata(directory_, region, false);
+	save_metadata(directory_, region, true);
+	CPPUNIT_ASSERT(!std::filesystem::exists(directory_ / "metadata.xml"));
+	save_metadata(directory_, region, false);
+	CPPUNIT_ASSERT(!std::filesystem::exists(directory_ / "metadata.bin"));
+}
+
+/**
+ * \brief Tests that a \c metadata.bin with the wrong magic number is
+ * rejected.
+ */
+void mcwutil::region::metadata_test::test_bad_magic() {
+	save_metadata(directory_, reader(directory_ / "r.0.0.mca"), true);
+	file_descriptor::create_open(directory_ / "metadata.bin", O_WRONLY, 0).pwrite("X", 1, 0);
+	CPPUNIT_ASSERT_THROW(load_metadata(directory_), std::runtime_error);
+}
+
+/**
+ * \brief Tests that a \c metadata.bin cut short is rejected.
+ */
+void mcwutil::region::metadata_test::test_truncated() {
+	reader region(directory_ / "r.0.0.mca");
+	for(off_t size : {off_t{0}, off_t{4}, off_t{8 + 8192}, off_t{8 + 8192 + 1023}}) {
+		save_metadata(directory_, region, true);
+		file_descriptor::create_open(directory_ / "metadata.bin", O_WRONLY, 0).ftruncate(size);
+		CPPUNIT_ASSERT_THROW(load_metadata(directory_), std::runtime_error);
+	}
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(mcwutil::region::metadata_test);
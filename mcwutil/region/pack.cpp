@@ -1,27 +1,234 @@
+#include <mcwutil/calc.hpp>
+#include <mcwutil/region/bundle.hpp>
+#include <mcwutil/region/compression.hpp>
+#include <mcwutil/region/external.hpp>
+#include <mcwutil/region/metadata.hpp>
 #include <mcwutil/region/region.hpp>
-#include <mcwutil/util/codec.hpp>
+#include <mcwutil/region/writer.hpp>
 #include <mcwutil/util/file_descriptor.hpp>
+#include <mcwutil/util/mapped_file.hpp>
+#include <mcwutil/util/parallel.hpp>
 #include <mcwutil/util/string.hpp>
-#include <mcwutil/util/xml.hpp>
 #include <algorithm>
 #include <array>
 #include <cerrno>
 #include <cstddef>
+#include <cstdint>
 #include <cstdio>
 #include <fcntl.h>
 #include <filesystem>
 #include <iostream>
-#include <libxml/tree.h>
+#include <numeric>
+#include <optional>
+#include <span>
 #include <stdexcept>
 #include <string>
 #include <string_view>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <vector>
 
 using namespace std::literals::string_literals;
 using namespace std::literals::string_view_literals;
 
+namespace mcwutil::region {
+namespace {
+/**
+ * \brief A chunk to be copied into a region.
+ */
+struct packed_chunk final {
+	/**
+	 * \brief The index of the chunk within the region.
+	 */
+	unsigned int index;
+
+	/**
+	 * \brief The compression type of the chunk.
+	 */
+	uint8_t compression;
+
+	/**
+	 * \brief The last-modified time of the chunk.
+	 */
+	uint32_t timestamp;
+
+	/**
+	 * \brief The file holding the compressed chunk data, or empty if the data
+	 * is in \ref payload.
+	 */
+	std::filesystem::path filename;
+
+	/**
+	 * \brief The compressed chunk data, if it is not in a file of its own.
+	 */
+	std::span<const uint8_t> payload;
+
+	/**
+	 * \brief The size of the compressed chunk data.
+	 */
+	std::size_t payload_size;
+
+	/**
+	 * \brief The position in the region file at which to write the payload.
+	 */
+	off_t offset;
+
+	/**
+	 * \brief The file to write the payload to if it goes in an external file,
+	 * or empty if it goes in the region file.
+	 */
+	std::filesystem::path external_filename;
+};
+
+/**
+ * \brief An order in which to lay out the chunks of a region, as a
+ * permutation of chunk indices.
+ */
+using layout = std::array<unsigned int, 1024>;
+
+/**
+ * \brief Returns the position of a chunk along a Z-order (Morton) curve
+ * through its region.
+ *
+ * \param[in] index the index of the chunk within the region.
+ *
+ * \return the position, formed by interleaving the bits of the chunk’s X and
+ * Z coordinates.
+ */
+unsigned int morton_key(unsigned int index) {
+	unsigned int x = index % 32, z = index / 32, key = 0;
+	for(unsigned int bit = 0; bit < 5; ++bit) {
+		key |= ((x >> bit) & 1U) << (2 * bit);
+		key |= ((z >> bit) & 1U) << (2 * bit + 1);
+	}
+	return key;
+}
+
+/**
+ * \brief Builds a layout that follows a Z-order curve, so that chunks near
+ * each other in the world are near each other in the file.
+ *
+ * \return the layout.
+ */
+layout morton_layout() {
+	layout ret;
+	for(unsigned int i = 0; i < 1024; ++i) {
+		ret[morton_key(i)] = i;
+	}
+	return ret;
+}
+
+/**
+ * \brief Builds a layout that follows an access log, so that chunks loaded
+ * together are stored together.
+ *
+ * The log is a text file with one chunk per line, given as its global X,Z
+ * chunk coordinates. Chunks are laid out in the order of their first
+ * appearance; those never mentioned follow in Z-order. Lines naming chunks
+ * in other regions are ignored if the region file’s name gives its
+ * coordinates.
+ *
+ * \param[in] log_filename the access log.
+ *
+ * \param[in] region_filename the region file being built.
+ *
+ * \return the layout.
+ *
+ * \exception std::runtime_error if the log is malformed.
+ */
+layout log_layout(const std::filesystem::path &log_filename, const std::filesystem::path &region_filename) {
+	std::optional<coordinates> region_coords = parse_region_filename(region_filename);
+	file_descriptor log_fd = file_descriptor::create_open(log_filename, O_RDONLY, 0);
+	mapped_file log_mapped(log_fd, PROT_READ);
+	std::string_view log(static_cast<const char *>(log_mapped.data()), log_mapped.size());
+
+	layout ret;
+	std::size_t placed = 0;
+	std::array<bool, 1024> seen{};
+	while(!log.empty()) {
+		std::string_view line = log.substr(0, log.find('\n'));
+		log.remove_prefix(std::min(log.size(), line.size() + 1));
+		if(!line.empty() && line.back() == '\r') {
+			line.remove_suffix(1);
+		}
+		if(line.empty()) {
+			continue;
+		}
+		std::optional<coordinates> chunk = parse_coordinates(line);
+		if(!chunk) {
+			throw std::runtime_error("Malformed access log: line is not of the form X,Z.");
+		}
+		if(region_coords && (calc::divfloor(chunk->x, 32) != region_coords->x || calc::divfloor(chunk->z, 32) != region_coords->z)) {
+			continue;
+		}
+		unsigned int index = static_cast<unsigned int>(calc::real_mod(chunk->x, 32) + 32 * calc::real_mod(chunk->z, 32));
+		if(!seen[index]) {
+			seen[index] = true;
+			ret[placed++] = index;
+		}
+	}
+	for(unsigned int i : morton_layout()) {
+		if(!seen[i]) {
+			ret[placed++] = i;
+		}
+	}
+	return ret;
+}
+
+/**
+ * \brief Parses a layout given on the command line.
+ *
+ * \param[in] spec the layout name: \c index, \c morton, or \c log: followed
+ * by the name of an access log.
+ *
+ * \param[in] region_filename the region file being built.
+ *
+ * \return the layout, or nothing if \p spec is not recognized.
+ */
+std::optional<layout> parse_layout(std::string_view spec, const std::filesystem::path &region_filename) {
+	if(spec == "index"sv) {
+		layout ret;
+		std::iota(ret.begin(), ret.end(), 0U);
+		return ret;
+	} else if(spec == "morton"sv) {
+		return morton_layout();
+	} else if(spec.starts_with("log:"sv) && spec.size() > 4) {
+		return log_layout(spec.substr(4), region_filename);
+	} else {
+		return std::nullopt;
+	}
+}
+
+/**
+ * \brief Copies a chunk’s payload into its place in a region file or its
+ * external file.
+ *
+ * \param[in] chunk the chunk to copy.
+ *
+ * \param[in] region_fd the region file.
+ */
+void copy_chunk(const packed_chunk &chunk, const file_descriptor &region_fd) {
+	std::optional<file_descriptor> external_fd;
+	const file_descriptor *dest = &region_fd;
+	off_t dest_offset = chunk.offset;
+	if(!chunk.external_filename.empty()) {
+		external_fd.emplace(file_descriptor::create_open(chunk.external_filename, O_WRONLY | O_CREAT | O_TRUNC, 0666));
+		dest = &*external_fd;
+		dest_offset = 0;
+	}
+	if(chunk.filename.empty()) {
+		dest->pwrite(chunk.payload.data(), chunk.payload.size(), dest_offset);
+	} else {
+		file_descriptor::create_open(chunk.filename, O_RDONLY, 0).copy_to(*dest, dest_offset, chunk.payload_size);
+	}
+	if(external_fd) {
+		external_fd->close();
+	}
+}
+}
+}
+
 /**
  * \brief Entry point for the \c region-pack utility.
  *
@@ -33,15 +240,42 @@ using namespace std::literals::string_view_literals;
  */
 int mcwutil::region::pack(std::string_view appname, std::span<char *> args) {
 	// Check parameters.
-	if(args.size() != 2) {
+	unsigned int jobs = 1;
+	std::string_view layout_spec = "index"sv;
+	for(;;) {
+		if(args.size() >= 2 && args[0] == "--jobs"sv) {
+			jobs = parallel::parse_jobs(args[1]).value_or(0);
+			args = args.subspan(2);
+		} else if(args.size() >= 2 && args[0] == "--layout"sv) {
+			layout_spec = args[1];
+			args = args.subspan(2);
+		} else {
+			break;
+		}
+	}
+	std::optional<layout> order;
+	if(args.size() == 2) {
+		order = parse_layout(layout_spec, args[1]);
+	}
+	if(!order || !jobs) {
 		std::cerr << "Usage:\n";
-		std::cerr << appname << " region-pack indir regionfile\n";
+		std::cerr << appname << " region-pack [--jobs N] [--layout layout] indir regionfile\n";
 		std::cerr << '\n';
 		std::cerr << "Builds a region file by packing a collection of chunks.\n";
 		std::cerr << '\n';
 		std::cerr << "Arguments:\n";
-		std::cerr << "  indir - the directory containing the metadata.xml and chunk-*.nbt.zlib files to pack\n";
+		std::cerr << "  --jobs - copy chunks on N threads (0 means one per CPU); the output is the same either way\n";
+		std::cerr << "  --layout - the order in which to store the chunks in the file (see below)\n";
+		std::cerr << "  indir - the directory containing the metadata.bin or metadata.xml and chunk-* files to pack, or a bundle file created by region-unpack --bundle\n";
 		std::cerr << "  regionfile - the .mcr file to create or replace\n";
+		std::cerr << '\n';
+		std::cerr << "The layout is one of:\n";
+		std::cerr << "  index - by index within the region, so one row of 32 chunks after another (default)\n";
+		std::cerr << "  morton - along a Z-order curve, so that chunks near each other in the world are near each other on disk\n";
+		std::cerr << "  log:logfile - in the order chunks first appear in logfile, which lists global chunk coordinates as X,Z one\n";
+		std::cerr << "                per line, followed by the chunks never listed in Z-order\n";
+		std::cerr << '\n';
+		std::cerr << "Chunks too large for a region file are written to c.X.Z.mcc files alongside it, in which case regionfile must be named r.X.Z.mca.\n";
 		return 1;
 	}
 
@@ -49,84 +283,62 @@ int mcwutil::region::pack(std::string_view appname, std::span<char *> args) {
 	const char *input_directory = args[0];
 	const char *region_filename = args[1];
 
-	// Load the metadata document.
-	std::filesystem::path metadata_file(input_directory);
-	metadata_file /= "metadata.xml";
-	auto metadata_document = xml::parse(metadata_file.c_str());
-	const xmlNode &metadata_root_elt = *xmlDocGetRootElement(metadata_document.get());
-	if(xml::node_name(metadata_root_elt) != u8"minecraft-region-metadata"sv) {
-		throw std::runtime_error("Malformed metadata.xml: improper root node name.");
-	}
-
-	// Open the region file.
-	file_descriptor region_fd = file_descriptor::create_open(region_filename, O_WRONLY | O_TRUNC | O_CREAT, 0666);
-	off_t region_write_ptr = 8192;
-
-	// Iterate the chunk elements in the metadata file.
-	// There should be 1024 of them with distinct indices.
-	// Keep track of which have been seen.
-	// Also allocate space to hold the header that we're building.
-	std::array<bool, 1024> seen_indices;
-	std::fill(seen_indices.begin(), seen_indices.end(), false);
-	std::array<uint8_t, 8192> header;
-	std::fill(header.begin(), header.end(), 0);
-	for(const xmlNode *i = metadata_root_elt.children; i; i = i->next) {
-		if(i->type != XML_ELEMENT_NODE) {
-			continue;
+	// Find the chunks to pack, in layout order, either in a bundle or in a
+	// directory of chunk files.
+	std::optional<bundle> input_bundle;
+	std::vector<packed_chunk> chunks;
+	if(bundle::is_bundle(input_directory)) {
+		input_bundle.emplace(input_directory);
+		std::array<const bundle::entry *, 1024> entries{};
+		for(const bundle::entry &i : input_bundle->entries()) {
+			entries[i.index] = &i;
 		}
-		unsigned int index = string::fromdecui(string::u2l(xml::node_attr(*i, u8"index")));
-		unsigned int present = string::fromdecui(string::u2l(xml::node_attr(*i, u8"present")));
-		uint32_t timestamp;
-		{
-			const char8_t *timestamp_raw = xml::node_attr(*i, u8"timestamp");
-			if(timestamp_raw) {
-				timestamp = string::fromdecu32(string::u2l(timestamp_raw));
-			} else {
-				timestamp = 0;
+		for(unsigned int index : *order) {
+			if(const bundle::entry *e = entries[index]) {
+				chunks.push_back({index, e->compression, e->timestamp, {}, e->payload, e->payload.size(), 0, {}});
 			}
 		}
-
-		if(seen_indices[index]) {
-			throw std::runtime_error("Malformed metadata.xml: repeated chunk index.");
-		}
-		seen_indices[index] = true;
-
-		if(present) {
-			// Copy the chunk data into the region file.
-			std::filesystem::path chunk_filename(input_directory);
-			std::string file_part("chunk-"s);
-			file_part += string::todecu(index, 4);
-			file_part += ".nbt.zlib"sv;
-			chunk_filename /= file_part;
-			file_descriptor chunk_fd = file_descriptor::create_open(chunk_filename, O_RDONLY, 0);
-			struct stat stbuf;
-			chunk_fd.fstat(stbuf);
-			uint8_t chunk_data[5 + stbuf.st_size];
-			chunk_fd.read(&chunk_data[5], sizeof(chunk_data) - 5);
-			codec::encode_integer(&chunk_data[0], static_cast<uint32_t>(stbuf.st_size + 1));
-			codec::encode_integer<uint8_t>(&chunk_data[4], 2);
-			region_fd.pwrite(chunk_data, sizeof(chunk_data), region_write_ptr);
-			uint32_t sector_offset = static_cast<uint32_t>(region_write_ptr / 4096);
-			codec::encode_integer<uint32_t, 3>(&header.data()[4 * index], sector_offset);
-			uint8_t sector_count = static_cast<uint8_t>((sizeof(chunk_data) + 4095) / 4096);
-			codec::encode_integer(&header.data()[4 * index + 3], sector_count);
-			codec::encode_integer(&header.data()[4096 + 4 * index], timestamp);
-			region_write_ptr += static_cast<off_t>(sector_count) * 4096;
+	} else {
+		region_metadata metadata = load_metadata(input_directory);
+		for(unsigned int index : *order) {
+			const chunk_metadata &m = metadata[index];
+			if(m.present) {
+				std::filesystem::path chunk_filename(input_directory);
+				std::string file_part("chunk-"s);
+				file_part += string::todecu(index, 4);
+				file_part += compression_extension(static_cast<compression>(m.compression));
+				chunk_filename /= file_part;
+				std::size_t payload_size = static_cast<std::size_t>(std::filesystem::file_size(chunk_filename));
+				chunks.push_back({index, m.compression, m.timestamp, std::move(chunk_filename), {}, payload_size, 0, {}});
+			}
 		}
 	}
 
-	// Check if all values have been seen.
-	if(std::find(seen_indices.begin(), seen_indices.end(), false) != seen_indices.end()) {
-		throw std::runtime_error("Malformed metadata.xml: not every chunk index is present.");
+	// Build the new region alongside the old one, so that the old one and its
+	// external chunk files are left alone until the new one is complete.
+	writer region = writer::replace(region_filename);
+
+	// Lay out the chunks, each after the previous one. A chunk too large to
+	// fit goes in an external file, leaving only a stub behind.
+	for(packed_chunk &i : chunks) {
+		if((5 + i.payload_size + 4095) / 4096 > 255) {
+			i.external_filename = region.stage_external(i.index);
+			region.write_external(i.index, i.compression, i.timestamp);
+		} else {
+			i.offset = region.reserve(i.index, i.payload_size, i.compression, i.timestamp);
+		}
 	}
 
-	// Extend the file to a sector boundary.
-	region_fd.ftruncate(region_write_ptr);
+	// Allocate the whole file at once, so it can be placed contiguously.
+	region.fd().preallocate(0, static_cast<off_t>(region.file_sectors()) * 4096);
 
-	// Write the header.
-	region_fd.pwrite(header.data(), header.size(), 0);
+	// Copy the chunks into place. Their positions are already fixed, so they
+	// can be copied in any order.
+	parallel::for_each(chunks.size(), jobs, [&chunks, &region](std::size_t i) {
+		copy_chunk(chunks[i], region.fd());
+	});
 
-	region_fd.close();
+	region.commit();
 
 	return 0;
 }
@@ -0,0 +1,77 @@
+#include <mcwutil/region/compression.hpp>
+#include <mcwutil/region/region.hpp>
+#include <mcwutil/region/writer.hpp>
+#include <mcwutil/util/file_descriptor.hpp>
+#include <mcwutil/util/mapped_file.hpp>
+#include <mcwutil/util/string.hpp>
+#include <cstdint>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <system_error>
+
+using namespace std::literals::string_view_literals;
+
+/**
+ * \brief Entry point for the \c region-put utility.
+ *
+ * \param[in] appname The name of the application.
+ *
+ * \param[in] args the command-line arguments.
+ *
+ * \return the application exit code.
+ */
+int mcwutil::region::put(std::string_view appname, std::span<char *> args) {
+	// Check parameters.
+	std::optional<compression> compression_type;
+	bool compression_valid = true;
+	if(args.size() >= 2 && args[0] == "--compression"sv) {
+		compression_type = parse_compression(args[1]);
+		compression_valid = compression_type.has_value();
+		args = args.subspan(2);
+	}
+	unsigned int index = 1024;
+	uint32_t timestamp = static_cast<uint32_t>(std::time(nullptr));
+	if(args.size() == 3 || args.size() == 4) {
+		try {
+			index = string::fromdecui(args[1]);
+			if(args.size() == 4) {
+				timestamp = string::fromdecu32(args[3]);
+			}
+		} catch(const std::system_error &) {
+			index = 1024;
+		}
+		if(!compression_type) {
+			compression_type = compression_from_filename(args[2]);
+		}
+	}
+	if(index >= 1024 || !compression_valid || !compression_type) {
+		std::cerr << "Usage:\n";
+		std::cerr << appname << " region-put [--compression type] regionfile index chunkfile [timestamp]\n";
+		std::cerr << '\n';
+		std::cerr << "Replaces a single chunk in a region file in place, without rewriting the rest of the file.\n";
+		std::cerr << '\n';
+		std::cerr << "Arguments:\n";
+		std::cerr << "  --compression - the compression type of chunkfile (gzip, zlib, none, or lz4); by default, it is worked out from\n";
+		std::cerr << "                  the file name extension (.nbt.gz, .nbt.zlib, .nbt, or .nbt.lz4)\n";
+		std::cerr << "  regionfile - the .mca or .mcr file to modify\n";
+		std::cerr << "  index - the index of the chunk within the region (an integer between 0 and 1023)\n";
+		std::cerr << "  chunkfile - the compressed chunk to store, as produced by region-unpack\n";
+		std::cerr << "  timestamp - the last-modified time to record, in seconds since the Unix epoch (default: now)\n";
+		return 1;
+	}
+
+	// Read the chunk.
+	file_descriptor chunk_fd = file_descriptor::create_open(args[2], O_RDONLY, 0);
+	mapped_file chunk_mapped(chunk_fd, PROT_READ);
+
+	// Store it.
+	writer region(file_descriptor::create_open(args[0], O_RDWR, 0), args[0]);
+	region.write(index, std::span(static_cast<const uint8_t *>(chunk_mapped.data()), chunk_mapped.size()), static_cast<uint8_t>(*compression_type), timestamp);
+	region.close();
+
+	return 0;
+}
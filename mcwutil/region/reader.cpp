@@ -0,0 +1,166 @@
+#include <mcwutil/region/compression.hpp>
+#include <mcwutil/region/external.hpp>
+#include <mcwutil/region/reader.hpp>
+#include <mcwutil/region/snapshot.hpp>
+#include <mcwutil/util/codec.hpp>
+#include <algorithm>
+#include <fcntl.h>
+#include <stdexcept>
+
+using mcwutil::region::reader;
+
+/**
+ * \brief Opens and maps a region file and parses its header.
+ *
+ * An empty file is accepted and treated as a region with no chunks.
+ *
+ * \param[in] filename the region file to open.
+ *
+ * \param[in] snapshot \c true to read from a consistent private copy of the
+ * file and its external chunk files, taken by \ref region::snapshot, so that
+ * it may safely be read while a server is writing to it.
+ *
+ * \exception std::runtime_error if the file is too short to hold a header.
+ */
+reader::reader(const std::filesystem::path &filename, bool snapshot) :
+		reader(filename, snapshot ? region::snapshot(filename) : snapshot_files{file_descriptor::create_open(filename, O_RDONLY, 0), {}}) {
+}
+
+/**
+ * \brief Maps an open region file and parses its header.
+ *
+ * \param[in] filename the name of the region file, from which the names of
+ * external chunk files not in \p files are derived.
+ *
+ * \param[in] files the region file and any external chunk files already
+ * opened.
+ *
+ * \exception std::runtime_error if the file is too short to hold a header.
+ */
+reader::reader(const std::filesystem::path &filename, snapshot_files &&files) :
+		filename_(filename),
+		fd_(std::move(files.region)),
+		mapped_(fd_, PROT_READ),
+		file_(static_cast<const uint8_t *>(mapped_.data()), mapped_.size()),
+		entries_{} {
+	for(const auto &[index, fd] : files.external) {
+		external_[index] = std::make_unique<mapped_file>(fd, PROT_READ);
+	}
+	if(file_.empty()) {
+		return;
+	}
+	if(file_.size() < 8192) {
+		throw std::runtime_error("Malformed region file: header truncated.");
+	}
+	for(unsigned int i = 0; i < 1024; ++i) {
+		entry &e = entries_[i];
+		e.sector_offset = codec::decode_integer<uint32_t, 3>(&file_[i * 4]);
+		e.sector_count = codec::decode_integer<uint8_t>(&file_[i * 4 + 3]);
+		e.timestamp = codec::decode_integer<uint32_t>(&file_[4096 + i * 4]);
+		if(present(i)) {
+			offset_order_.push_back(i);
+		}
+	}
+	std::stable_sort(offset_order_.begin(), offset_order_.end(), [this](unsigned int x, unsigned int y) {
+		return entries_[x].sector_offset < entries_[y].sector_offset;
+	});
+}
+
+/**
+ * \brief Returns the compression type of a chunk.
+ *
+ * \pre The chunk is present.
+ *
+ * \param[in] index the index of the chunk within the region.
+ *
+ * \return the compression type byte, without the \ref COMPRESSION_EXTERNAL
+ * flag.
+ *
+ * \exception std::runtime_error if the chunk’s location is malformed.
+ */
+uint8_t reader::compression(unsigned int index) const {
+	return static_cast<uint8_t>(chunk_header(index)[4] & ~COMPRESSION_EXTERNAL);
+}
+
+/**
+ * \brief Returns whether a chunk’s payload is stored in an external file.
+ *
+ * \pre The chunk is present.
+ *
+ * \param[in] index the index of the chunk within the region.
+ *
+ * \return \c true if the payload is in a <code>c.X.Z.mcc</code> file, or \c
+ * false if it is in the region file.
+ *
+ * \exception std::runtime_error if the chunk’s location is malformed.
+ */
+bool reader::external(unsigned int index) const {
+	return (chunk_header(index)[4] & COMPRESSION_EXTERNAL) != 0;
+}
+
+/**
+ * \brief Returns the compressed payload of a chunk.
+ *
+ * \pre The chunk is present.
+ *
+ * \param[in] index the index of the chunk within the region.
+ *
+ * \return a view of the payload, not including the length and compression
+ * type, within the mapped region file or external chunk file.
+ *
+ * \exception std::runtime_error if the chunk’s location or length is
+ * malformed.
+ *
+ * \exception std::system_error if the chunk is external and its file cannot
+ * be opened.
+ */
+std::span<const uint8_t> reader::payload(unsigned int index) const {
+	std::span<const uint8_t> chunk = chunk_header(index);
+	uint32_t precise_size_bytes = codec::decode_integer<uint32_t>(&chunk[0]);
+	if(precise_size_bytes < 1) {
+		throw std::runtime_error("Malformed chunk: precise size < 1.");
+	}
+	if(precise_size_bytes > chunk.size() - 4) {
+		throw std::runtime_error("Malformed chunk: precise size > rough size.");
+	}
+	if(!(chunk[4] & COMPRESSION_EXTERNAL)) {
+		return chunk.subspan(5, precise_size_bytes - 1);
+	}
+
+	// The payload is in its own file, which is mapped the first time it is
+	// needed and kept until the reader is destroyed.
+	std::lock_guard<std::mutex> lock(external_mutex_);
+	std::unique_ptr<mapped_file> &mapping = external_[index];
+	if(!mapping) {
+		file_descriptor fd = file_descriptor::create_open(external_filename(filename_, index), O_RDONLY, 0);
+		mapping = std::make_unique<mapped_file>(fd, PROT_READ);
+	}
+	return std::span<const uint8_t>(static_cast<const uint8_t *>(mapping->data()), mapping->size());
+}
+
+/**
+ * \brief Returns the sectors allocated to a chunk, after validating its
+ * location.
+ *
+ * \param[in] index the index of the chunk within the region.
+ *
+ * \return a view of the chunk’s sectors, truncated at the end of the file,
+ * which is at least five bytes long.
+ *
+ * \exception std::runtime_error if the chunk’s location is malformed.
+ */
+std::span<const uint8_t> reader::chunk_header(unsigned int index) const {
+	const entry &e = entries_[index];
+	if(!e.sector_offset || !e.sector_count) {
+		throw std::runtime_error("Malformed region header: chunk is half-present.");
+	}
+	if(e.sector_offset < 2) {
+		throw std::runtime_error("Malformed region header: chunk overlaps header.");
+	}
+	std::size_t offset_bytes = static_cast<std::size_t>(e.sector_offset) * 4096;
+	if(offset_bytes + 5 > file_.size()) {
+		throw std::runtime_error("Malformed region header: chunk beyond end of file.");
+	}
+	std::size_t rough_size_bytes = std::min(static_cast<std::size_t>(e.sector_count) * 4096, file_.size() - offset_bytes);
+	return file_.subspan(offset_bytes, rough_size_bytes);
+}
@@ -0,0 +1,192 @@
+#ifndef REGION_READER_H
+#define REGION_READER_H
+
+#include <mcwutil/region/snapshot.hpp>
+#include <mcwutil/util/file_descriptor.hpp>
+#include <mcwutil/util/mapped_file.hpp>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+namespace mcwutil::region {
+/**
+ * \brief A read-only, memory-mapped view of a region file.
+ *
+ * The header is parsed once, at construction. Chunk payloads are exposed as
+ * views into the mapping, so no data is copied until it is actually used.
+ * Payloads of chunks stored in external <code>c.X.Z.mcc</code> files are
+ * mapped on first use, or up front when reading a snapshot, and exposed in
+ * the same way.
+ */
+class reader final {
+	public:
+	explicit reader(const std::filesystem::path &filename, bool snapshot = false);
+
+	// This class is not copyable.
+	explicit reader(const reader &) = delete;
+	void operator=(const reader &) = delete;
+
+	/**
+	 * \brief Returns the raw 8 KiB header.
+	 *
+	 * \return the header, or an empty span if the file is empty.
+	 */
+	std::span<const uint8_t> header() const {
+		return file_.first(file_.empty() ? 0 : 8192);
+	}
+
+	/**
+	 * \brief Returns the entire contents of the file.
+	 *
+	 * \return the file contents.
+	 */
+	std::span<const uint8_t> file() const {
+		return file_;
+	}
+
+	/**
+	 * \brief Returns the open region file.
+	 *
+	 * \return the file descriptor, which may be used to copy data out of the
+	 * region within the kernel.
+	 */
+	const file_descriptor &fd() const {
+		return fd_;
+	}
+
+	/**
+	 * \brief Returns the offset of a chunk.
+	 *
+	 * \param[in] index the index of the chunk within the region.
+	 *
+	 * \return the offset, in 4 KiB sectors, of the chunk, or zero if absent.
+	 */
+	uint32_t sector_offset(unsigned int index) const {
+		return entries_[index].sector_offset;
+	}
+
+	/**
+	 * \brief Returns the number of sectors allocated to a chunk.
+	 *
+	 * \param[in] index the index of the chunk within the region.
+	 *
+	 * \return the number of 4 KiB sectors allocated to the chunk, or zero if
+	 * absent.
+	 */
+	uint8_t sector_count(unsigned int index) const {
+		return entries_[index].sector_count;
+	}
+
+	/**
+	 * \brief Returns the last-modified time of a chunk.
+	 *
+	 * \param[in] index the index of the chunk within the region.
+	 *
+	 * \return the timestamp, in seconds since the Unix epoch.
+	 */
+	uint32_t timestamp(unsigned int index) const {
+		return entries_[index].timestamp;
+	}
+
+	/**
+	 * \brief Returns whether a chunk is present.
+	 *
+	 * \param[in] index the index of the chunk within the region.
+	 *
+	 * \return \c true if the header records any location for the chunk.
+	 */
+	bool present(unsigned int index) const {
+		return entries_[index].sector_offset || entries_[index].sector_count;
+	}
+
+	/**
+	 * \brief Returns the indices of the present chunks, sorted by their
+	 * position in the file.
+	 *
+	 * Visiting chunks in this order reads the file sequentially.
+	 *
+	 * \return the chunk indices.
+	 */
+	const std::vector<unsigned int> &offset_order() const {
+		return offset_order_;
+	}
+
+	uint8_t compression(unsigned int index) const;
+	bool external(unsigned int index) const;
+	std::span<const uint8_t> payload(unsigned int index) const;
+
+	private:
+	/**
+	 * \brief The location and timestamp of a single chunk, as decoded from the
+	 * header.
+	 */
+	struct entry final {
+		/**
+		 * \brief The offset, in sectors, of the chunk.
+		 */
+		uint32_t sector_offset;
+
+		/**
+		 * \brief The number of sectors allocated to the chunk.
+		 */
+		uint8_t sector_count;
+
+		/**
+		 * \brief The last-modified time of the chunk.
+		 */
+		uint32_t timestamp;
+	};
+
+	/**
+	 * \brief The name of the region file.
+	 */
+	std::filesystem::path filename_;
+
+	/**
+	 * \brief The open region file.
+	 */
+	file_descriptor fd_;
+
+	/**
+	 * \brief The mapping of the region file.
+	 */
+	mapped_file mapped_;
+
+	/**
+	 * \brief The contents of the region file.
+	 */
+	std::span<const uint8_t> file_;
+
+	/**
+	 * \brief The decoded header entries.
+	 */
+	std::array<entry, 1024> entries_;
+
+	/**
+	 * \brief The indices of the present chunks, in file order.
+	 */
+	std::vector<unsigned int> offset_order_;
+
+	/**
+	 * \brief The mappings of the external chunk files opened so far, by chunk
+	 * index.
+	 */
+	mutable std::array<std::unique_ptr<mapped_file>, 1024> external_;
+
+	/**
+	 * \brief Guards \ref external_, so that payloads may be fetched from
+	 * several threads.
+	 */
+	mutable std::mutex external_mutex_;
+
+	explicit reader(const std::filesystem::path &filename, snapshot_files &&files);
+	std::span<const uint8_t> chunk_header(unsigned int index) const;
+};
+}
+
+#endif
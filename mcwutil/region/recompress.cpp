@@ -0,0 +1,108 @@
+#include <mcwutil/region/compression.hpp>
+#include <mcwutil/region/reader.hpp>
+#include <mcwutil/region/region.hpp>
+#include <mcwutil/region/writer.hpp>
+#include <mcwutil/util/parallel.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+using namespace std::literals::string_view_literals;
+
+/**
+ * \brief Entry point for the \c region-recompress utility.
+ *
+ * \param[in] appname The name of the application.
+ *
+ * \param[in] args the command-line arguments.
+ *
+ * \return the application exit code.
+ */
+int mcwutil::region::recompress(std::string_view appname, std::span<char *> args) {
+	// Check parameters.
+	bool best = false;
+	unsigned int jobs = 1;
+	std::optional<compression> target;
+	for(;;) {
+		if(!args.empty() && args[0] == "--best"sv) {
+			best = true;
+			args = args.subspan(1);
+		} else if(args.size() >= 2 && args[0] == "--jobs"sv) {
+			jobs = parallel::parse_jobs(args[1]).value_or(0);
+			args = args.subspan(2);
+		} else if(args.size() >= 2 && args[0] == "--to"sv) {
+			target = parse_compression(args[1]);
+			args = args.subspan(2);
+		} else {
+			break;
+		}
+	}
+	if(!target || args.size() != 2 || !jobs) {
+		std::cerr << "Usage:\n";
+		std::cerr << appname << " region-recompress [--best] [--jobs N] --to type inregion outregion\n";
+		std::cerr << '\n';
+		std::cerr << "Converts every chunk in a region file to a different compression type.\n";
+		std::cerr << '\n';
+		std::cerr << "Arguments:\n";
+		std::cerr << "  --best - for gzip and zlib, try several compression levels and strategies on every chunk, including those\n";
+		std::cerr << "           already of the target type, and keep the smallest result; slow, but suited to archiving\n";
+		std::cerr << "  --jobs - compress chunks on N threads (0 means one per CPU); the output is the same either way\n";
+		std::cerr << "  type - the compression type to convert to (gzip, zlib, none, or lz4)\n";
+		std::cerr << "  inregion - the .mca file to read\n";
+		std::cerr << "  outregion - the region file to create or replace (may be equal to inregion)\n";
+		return 1;
+	}
+
+	// Extract provided pathnames.
+	const char *input_filename = args[0];
+	const std::filesystem::path output_filename(args[1]);
+
+	// Open the input region file.
+	reader input(input_filename);
+
+	// Convert the chunks in parallel. Chunks that already use the target
+	// compression type are left as they are, unless looking for the best
+	// compression, in which case they are kept only if nothing smaller is
+	// found.
+	const std::vector<unsigned int> &order = input.offset_order();
+	std::vector<std::optional<std::vector<uint8_t>>> converted(order.size());
+	parallel::for_each(order.size(), jobs, [&](std::size_t k) {
+		unsigned int i = order[k];
+		std::span<const uint8_t> payload = input.payload(i);
+		uint8_t compression_type = input.compression(i);
+		if(!valid_compression(compression_type)) {
+			throw std::runtime_error("Malformed chunk: unrecognized compression type.");
+		}
+		if(compression_type == *target && !best) {
+			return;
+		}
+		std::vector<uint8_t> nbt = decompress(payload, static_cast<compression>(compression_type));
+		std::vector<uint8_t> compressed = best ? compress_smallest(nbt, *target) : compress(nbt, *target);
+		if(compression_type != *target || compressed.size() < payload.size()) {
+			converted[k] = std::move(compressed);
+		}
+	});
+
+	// Write the chunks in file order to a temporary output file alongside the
+	// final one, so that the input and output may be the same file.
+	writer output = writer::replace(output_filename);
+	for(std::size_t k = 0; k != order.size(); ++k) {
+		unsigned int i = order[k];
+		if(converted[k]) {
+			output.write(i, *converted[k], static_cast<uint8_t>(*target), input.timestamp(i));
+		} else {
+			output.write(i, input.payload(i), input.compression(i), input.timestamp(i));
+		}
+	}
+
+	// Move the new file and its external chunk files into place, removing the
+	// old external files it no longer needs.
+	output.commit();
+
+	return 0;
+}
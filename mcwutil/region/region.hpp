@@ -9,8 +9,15 @@ namespace mcwutil {
  * \brief Symbols related to the MCRegion/Anvil format.
  */
 namespace region {
+int compact(std::string_view appname, std::span<char *> args);
+int map(std::string_view appname, std::span<char *> args);
 int pack(std::string_view appname, std::span<char *> args);
+int put(std::string_view appname, std::span<char *> args);
+int recompress(std::string_view appname, std::span<char *> args);
+int stat(std::string_view appname, std::span<char *> args);
+int transplant(std::string_view appname, std::span<char *> args);
 int unpack(std::string_view appname, std::span<char *> args);
+int verify(std::string_view appname, std::span<char *> args);
 }
 }
 
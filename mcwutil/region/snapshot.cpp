@@ -0,0 +1,344 @@
+#include <mcwutil/region/compression.hpp>
+#include <mcwutil/region/external.hpp>
+#include <mcwutil/region/snapshot.hpp>
+#include <mcwutil/util/codec.hpp>
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <map>
+#include <stdexcept>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace mcwutil::region {
+namespace {
+/**
+ * \brief The number of times to re-read the header, looking for chunks that
+ * changed while being copied, before giving up.
+ */
+constexpr unsigned int MAX_ATTEMPTS = 10;
+
+/**
+ * \brief How long a file must have gone unmodified before a copy of it is
+ * trusted without being checked.
+ */
+constexpr std::chrono::seconds QUIET_PERIOD(2);
+
+/**
+ * \brief How long to give a writer to finish what it was doing before
+ * checking a copy.
+ */
+constexpr std::chrono::milliseconds SETTLE_TIME(20);
+
+/**
+ * \brief A region header.
+ */
+using header_data = std::array<uint8_t, 8192>;
+
+/**
+ * \brief Returns the current size of a file.
+ *
+ * \param[in] fd the file.
+ *
+ * \return the size, in bytes.
+ */
+off_t file_size(const file_descriptor &fd) {
+	struct stat stbuf;
+	fd.fstat(stbuf);
+	return stbuf.st_size;
+}
+
+/**
+ * \brief Returns the last-modified time of a file.
+ *
+ * \param[in] fd the file.
+ *
+ * \return the modification time.
+ */
+std::chrono::system_clock::time_point modified(const file_descriptor &fd) {
+	struct stat stbuf;
+	fd.fstat(stbuf);
+	return std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::seconds(stbuf.st_mtim.tv_sec) + std::chrono::nanoseconds(stbuf.st_mtim.tv_nsec)));
+}
+
+/**
+ * \brief Returns the location of a chunk.
+ *
+ * \param[in] header the region header.
+ *
+ * \param[in] index the index of the chunk within the region.
+ *
+ * \return the first byte and the number of bytes allocated to the chunk.
+ */
+std::pair<off_t, off_t> chunk_extent(const header_data &header, unsigned int index) {
+	uint32_t offset = codec::decode_integer<uint32_t, 3>(&header[index * 4]);
+	uint8_t count = header[index * 4 + 3];
+	return {static_cast<off_t>(offset) * 4096, static_cast<off_t>(count) * 4096};
+}
+
+/**
+ * \brief Checks whether a chunk’s header entries differ between two headers.
+ *
+ * \param[in] x one header.
+ *
+ * \param[in] y the other header.
+ *
+ * \param[in] index the index of the chunk within the region.
+ *
+ * \return \c true if the chunk’s location or timestamp differs.
+ */
+bool entry_changed(const header_data &x, const header_data &y, unsigned int index) {
+	return std::memcmp(&x[index * 4], &y[index * 4], 4) || std::memcmp(&x[4096 + index * 4], &y[4096 + index * 4], 4);
+}
+
+/**
+ * \brief Creates an anonymous temporary file to hold a snapshot.
+ *
+ * The file is created in the same directory as the original if possible, so
+ * that the two share a filesystem and extents can be shared between them.
+ *
+ * \param[in] filename the file being snapshotted.
+ *
+ * \return the temporary file, which disappears when closed.
+ */
+file_descriptor create_temporary(const std::filesystem::path &filename) {
+	std::filesystem::path directory = filename.parent_path();
+	if(directory.empty()) {
+		directory = ".";
+	}
+	try {
+		return file_descriptor::create_open(directory, O_RDWR | O_TMPFILE, 0600);
+	} catch(const std::system_error &) {
+		return file_descriptor::create_open(std::filesystem::temp_directory_path(), O_RDWR | O_TMPFILE, 0600);
+	}
+}
+
+/**
+ * \brief Copies part of the live file into the snapshot.
+ *
+ * Data beyond the end of the live file is not copied.
+ *
+ * \param[in] live the live file.
+ *
+ * \param[in] copy the snapshot.
+ *
+ * \param[in] extent the first byte and the number of bytes to copy.
+ *
+ * \param[in] dest_offset the position in the snapshot to copy to.
+ */
+void copy_extent(const file_descriptor &live, const file_descriptor &copy, std::pair<off_t, off_t> extent, off_t dest_offset) {
+	auto [offset, length] = extent;
+	length = std::max<off_t>(0, std::min(length, file_size(live) - offset));
+	std::size_t copied = live.copy_range(offset, copy, dest_offset, static_cast<std::size_t>(length));
+	std::vector<uint8_t> buffer(static_cast<std::size_t>(length) - copied);
+	live.pread(buffer.data(), buffer.size(), offset + static_cast<off_t>(copied));
+	copy.pwrite(buffer.data(), buffer.size(), dest_offset + static_cast<off_t>(copied));
+}
+
+/**
+ * \brief Checks whether part of the snapshot still matches the live file.
+ *
+ * \param[in] live the live file.
+ *
+ * \param[in] copy the snapshot.
+ *
+ * \param[in] extent the first byte and the number of bytes to compare in the
+ * live file.
+ *
+ * \param[in] dest_offset the position of the copy in the snapshot.
+ *
+ * \return \c true if the bytes are the same.
+ */
+bool same_extent(const file_descriptor &live, const file_descriptor &copy, std::pair<off_t, off_t> extent, off_t dest_offset) {
+	auto [offset, length] = extent;
+	off_t live_length = std::max<off_t>(0, std::min(length, file_size(live) - offset));
+	off_t copy_length = std::max<off_t>(0, std::min(length, file_size(copy) - dest_offset));
+	if(live_length != copy_length) {
+		return false;
+	}
+	std::vector<uint8_t> live_data(static_cast<std::size_t>(live_length)), copy_data(static_cast<std::size_t>(copy_length));
+	live.pread(live_data.data(), live_data.size(), offset);
+	copy.pread(copy_data.data(), copy_data.size(), dest_offset);
+	return live_data == copy_data;
+}
+
+/**
+ * \brief Opens the external chunk file of a chunk just copied into the
+ * snapshot, if it has one.
+ *
+ * The file is opened before the chunk is checked, so if it is replaced in the
+ * meantime, the save that replaced it also changes the chunk’s header entry
+ * and the chunk is copied again.
+ *
+ * \param[in] filename the live region file.
+ *
+ * \param[in] copy the snapshot.
+ *
+ * \param[in] result the snapshot’s header.
+ *
+ * \param[in] index the index of the chunk within the region.
+ *
+ * \param[in, out] external the external chunk files opened so far.
+ */
+void open_external(const std::filesystem::path &filename, const file_descriptor &copy, const header_data &result, unsigned int index, std::map<unsigned int, file_descriptor> &external) {
+	external.erase(index);
+	uint8_t compression;
+	try {
+		copy.pread(&compression, 1, chunk_extent(result, index).first + 4);
+	} catch(const std::runtime_error &) {
+		// The chunk lies beyond the end of the file; the reader reports it.
+		return;
+	}
+	if(!(compression & COMPRESSION_EXTERNAL)) {
+		return;
+	}
+	try {
+		external.emplace(index, file_descriptor::create_open(external_filename(filename, index), O_RDONLY, 0));
+	} catch(const std::system_error &) {
+		// The reader reports the missing file if the chunk is read.
+	}
+}
+}
+}
+
+/**
+ * \brief Takes a consistent private copy of a region file that may be being
+ * written to, such as by a running server.
+ *
+ * The whole file is cloned if the filesystem can share extents; otherwise
+ * the header is read and the sectors of each chunk are copied, which on some
+ * filesystems also shares extents. The header is then read again, and each
+ * chunk whose entry changed, or whose sectors no longer match the copy, is
+ * copied again to the end of the snapshot and checked on the next pass. A
+ * chunk that passes its check is kept as it was, even if it changes later,
+ * so each chunk settles independently of how busy the rest of the file is.
+ * Every chunk in the snapshot therefore matches its header entry as it stood
+ * at some moment during the copy, though different chunks may come from
+ * different saves.
+ *
+ * The external chunk file of each chunk stored externally is opened as the
+ * chunk is copied, and checked along with it, so that the payload matches the
+ * stub in the snapshot even if the server later moves the chunk back into
+ * the region or replaces its file.
+ *
+ * A file that was not modified during the copy, nor for a little while
+ * before, is trusted without being checked. Otherwise, any writer is given a
+ * moment to finish before the check, so that a chunk rewritten in place is
+ * seen with its new timestamp rather than half-written.
+ *
+ * \param[in] filename the region file.
+ *
+ * \return the snapshot.
+ *
+ * \exception std::runtime_error if the file is still changing after several
+ * attempts, or its header is truncated.
+ */
+mcwutil::region::snapshot_files mcwutil::region::snapshot(const std::filesystem::path &filename) {
+	file_descriptor live = file_descriptor::create_open(filename, O_RDONLY, 0);
+	file_descriptor copy = create_temporary(filename);
+	std::map<unsigned int, file_descriptor> external;
+	off_t size = file_size(live);
+	if(!size) {
+		return {file_descriptor(std::move(copy)), std::move(external)};
+	}
+	if(size < 8192) {
+		throw std::runtime_error("Malformed region file: header truncated.");
+	}
+
+	// Take a first copy of every chunk. The snapshot’s header starts out the
+	// same as the live one, as the chunks are at the same positions.
+	std::chrono::system_clock::time_point copy_started = std::chrono::system_clock::now();
+	std::chrono::system_clock::time_point last_modified = modified(live);
+	header_data header;
+	live.pread(header.data(), header.size(), 0);
+	header_data result = header;
+	std::vector<unsigned int> pending;
+	for(unsigned int i = 0; i < 1024; ++i) {
+		if(chunk_extent(header, i).second) {
+			pending.push_back(i);
+		}
+	}
+	if(ioctl(copy.fd(), FICLONE, live.fd()) < 0) {
+		for(unsigned int i : pending) {
+			copy_extent(live, copy, chunk_extent(header, i), chunk_extent(header, i).first);
+		}
+	}
+	for(unsigned int i : pending) {
+		open_external(filename, copy, result, i, external);
+	}
+	off_t end = std::max<off_t>(size, 8192);
+	for(unsigned int i : pending) {
+		auto [offset, length] = chunk_extent(header, i);
+		end = std::max(end, offset + length);
+	}
+	end = (end + 4095) / 4096 * 4096;
+
+	// Recopy chunks that changed while they were being copied. Here, header
+	// holds the live entry of each pending chunk as it was when copied.
+	for(unsigned int attempt = 1;; ++attempt) {
+		// A file left alone throughout cannot have changed under the copy.
+		if(modified(live) == last_modified && copy_started - last_modified >= QUIET_PERIOD) {
+			break;
+		}
+
+		// Otherwise, check the chunks copied in the last pass, after giving a
+		// save in progress a moment to finish.
+		std::this_thread::sleep_for(SETTLE_TIME);
+		header_data current;
+		live.pread(current.data(), current.size(), 0);
+		std::vector<unsigned int> changed;
+		for(unsigned int i : pending) {
+			if(entry_changed(header, current, i) || !same_extent(live, copy, chunk_extent(header, i), chunk_extent(result, i).first)) {
+				changed.push_back(i);
+			}
+		}
+		if(changed.empty()) {
+			break;
+		}
+		if(attempt == MAX_ATTEMPTS) {
+			throw std::runtime_error("Region file kept changing while being copied.");
+		}
+
+		// Copy the changed chunks to fresh space at the end of the snapshot,
+		// so as not to overwrite any chunk already checked, whose sectors the
+		// live file may since have reused.
+		copy_started = std::chrono::system_clock::now();
+		last_modified = modified(live);
+		pending.clear();
+		for(unsigned int i : changed) {
+			std::memcpy(&header[i * 4], &current[i * 4], 4);
+			std::memcpy(&header[4096 + i * 4], &current[4096 + i * 4], 4);
+			std::memcpy(&result[4096 + i * 4], &current[4096 + i * 4], 4);
+			auto [offset, length] = chunk_extent(current, i);
+			if(!length) {
+				// The chunk was deleted.
+				std::fill_n(&result[i * 4], 4, uint8_t{0});
+				external.erase(i);
+				continue;
+			}
+			if(end / 4096 + length / 4096 > 0xFFFFFF) {
+				throw std::runtime_error("Region file kept changing while being copied.");
+			}
+			copy_extent(live, copy, {offset, length}, end);
+			codec::encode_integer<uint32_t, 3>(&result[i * 4], static_cast<uint32_t>(end / 4096));
+			result[i * 4 + 3] = current[i * 4 + 3];
+			end += length;
+			open_external(filename, copy, result, i, external);
+			pending.push_back(i);
+		}
+	}
+
+	// Write the header describing where each chunk ended up.
+	copy.pwrite(result.data(), result.size(), 0);
+	return {file_descriptor(std::move(copy)), std::move(external)};
+}
@@ -0,0 +1,34 @@
+#ifndef REGION_SNAPSHOT_H
+#define REGION_SNAPSHOT_H
+
+#include <mcwutil/util/file_descriptor.hpp>
+#include <filesystem>
+#include <map>
+
+namespace mcwutil::region {
+/**
+ * \brief A consistent private copy of a region file, together with the
+ * external chunk files it refers to.
+ */
+struct snapshot_files final {
+	/**
+	 * \brief An anonymous file holding the copy of the region file, which
+	 * disappears when closed.
+	 */
+	file_descriptor region;
+
+	/**
+	 * \brief The external chunk file of each chunk that the copy stores
+	 * externally, by chunk index, opened while the copy was being checked.
+	 *
+	 * External chunk files are replaced by renaming rather than rewritten in
+	 * place, so an open one never changes. A chunk whose file could not be
+	 * opened is missing here.
+	 */
+	std::map<unsigned int, file_descriptor> external;
+};
+
+snapshot_files snapshot(const std::filesystem::path &filename);
+}
+
+#endif
@@ -0,0 +1,711 @@
+#include <mcwutil/region/compression.hpp>
+#include <mcwutil/region/external.hpp>
+#include <mcwutil/region/reader.hpp>
+#include <mcwutil/region/region.hpp>
+#include <mcwutil/util/parallel.hpp>
+#include <mcwutil/util/string.hpp>
+#include <mcwutil/world/dimensions.hpp>
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+using namespace std::literals::string_view_literals;
+
+namespace mcwutil::region {
+namespace {
+/**
+ * \brief The number of buckets in a size histogram.
+ *
+ * Bucket zero counts sizes up to 1 KiB; each subsequent bucket doubles the
+ * upper bound, and the last also counts everything larger.
+ */
+constexpr std::size_t SIZE_BUCKETS = 22;
+
+/**
+ * \brief The upper bounds, in seconds of age, of the timestamp histogram
+ * buckets, after the buckets for unset and future timestamps.
+ */
+constexpr std::array<uint64_t, 4> AGE_BOUNDS = {86400, 7 * 86400, 30 * 86400, 365 * 86400};
+
+/**
+ * \brief The labels of the timestamp histogram buckets.
+ */
+constexpr std::array<std::string_view, AGE_BOUNDS.size() + 3> AGE_LABELS = {"unset"sv, "future"sv, "<1d"sv, "<7d"sv, "<30d"sv, "<365d"sv, ">=365d"sv};
+
+/**
+ * \brief A summary of a set of sizes.
+ */
+struct size_distribution final {
+	/**
+	 * \brief The number of sizes.
+	 */
+	uint64_t count = 0;
+
+	/**
+	 * \brief The sum of the sizes, in bytes.
+	 */
+	uint64_t total = 0;
+
+	/**
+	 * \brief The smallest size, in bytes, or the largest representable value
+	 * if there are none.
+	 */
+	uint64_t min = std::numeric_limits<uint64_t>::max();
+
+	/**
+	 * \brief The largest size, in bytes, or zero if there are none.
+	 */
+	uint64_t max = 0;
+
+	/**
+	 * \brief The number of sizes falling in each histogram bucket.
+	 */
+	std::array<uint64_t, SIZE_BUCKETS> buckets{};
+
+	/**
+	 * \brief Adds one size.
+	 *
+	 * \param[in] size the size, in bytes.
+	 */
+	void add(uint64_t size) {
+		++count;
+		total += size;
+		min = std::min(min, size);
+		max = std::max(max, size);
+		std::size_t bucket = 0;
+		while(bucket + 1 < SIZE_BUCKETS && size > bucket_bound(bucket)) {
+			++bucket;
+		}
+		++buckets[bucket];
+	}
+
+	/**
+	 * \brief Adds all the sizes from another distribution.
+	 *
+	 * \param[in] other the distribution to add.
+	 */
+	void merge(const size_distribution &other) {
+		count += other.count;
+		total += other.total;
+		min = std::min(min, other.min);
+		max = std::max(max, other.max);
+		for(std::size_t i = 0; i != SIZE_BUCKETS; ++i) {
+			buckets[i] += other.buckets[i];
+		}
+	}
+
+	/**
+	 * \brief Returns the upper bound of a histogram bucket.
+	 *
+	 * \param[in] bucket the bucket number.
+	 *
+	 * \return the largest size, in bytes, counted in \p bucket.
+	 */
+	static uint64_t bucket_bound(std::size_t bucket) {
+		return uint64_t{1024} << bucket;
+	}
+};
+
+/**
+ * \brief One of the largest chunks.
+ */
+struct chunk_size final {
+	/**
+	 * \brief The region file containing the chunk.
+	 */
+	std::string filename;
+
+	/**
+	 * \brief The chunk’s index within the region file.
+	 */
+	unsigned int index;
+
+	/**
+	 * \brief The chunk’s world coordinates, if the region filename gives
+	 * them.
+	 */
+	std::optional<coordinates> chunk;
+
+	/**
+	 * \brief The size of the chunk’s compressed payload, in bytes.
+	 */
+	uint64_t compressed;
+
+	/**
+	 * \brief The size of the decompressed chunk, in bytes.
+	 */
+	uint64_t uncompressed;
+};
+
+/**
+ * \brief Statistics gathered over one or more region files.
+ */
+struct stats final {
+	/**
+	 * \brief The number of region files, including unreadable ones.
+	 */
+	uint64_t files = 0;
+
+	/**
+	 * \brief The number of region files whose header could not be read, and
+	 * which contribute nothing else.
+	 */
+	uint64_t unreadable_files = 0;
+
+	/**
+	 * \brief The total size of the region files, in bytes.
+	 */
+	uint64_t bytes = 0;
+
+	/**
+	 * \brief The total number of sectors, counting a final partial sector.
+	 */
+	uint64_t sectors = 0;
+
+	/**
+	 * \brief The number of sectors occupied by region headers.
+	 */
+	uint64_t header_sectors = 0;
+
+	/**
+	 * \brief The number of sectors allocated to at least one chunk.
+	 */
+	uint64_t live_sectors = 0;
+
+	/**
+	 * \brief The number of sectors neither in a header nor allocated to a
+	 * chunk.
+	 */
+	uint64_t dead_sectors = 0;
+
+	/**
+	 * \brief The number of sectors allocated to chunks beyond what their
+	 * payloads need.
+	 */
+	uint64_t slack_sectors = 0;
+
+	/**
+	 * \brief The number of chunks present in the headers.
+	 */
+	uint64_t chunks = 0;
+
+	/**
+	 * \brief The number of readable chunks stored in external files.
+	 */
+	uint64_t external_chunks = 0;
+
+	/**
+	 * \brief The number of chunks that could not be read or decompressed.
+	 */
+	uint64_t unreadable_chunks = 0;
+
+	/**
+	 * \brief The compressed sizes of the readable chunks.
+	 */
+	size_distribution compressed;
+
+	/**
+	 * \brief The decompressed sizes of the readable chunks.
+	 */
+	size_distribution uncompressed;
+
+	/**
+	 * \brief The number of chunks whose timestamps fall in each bucket of
+	 * \ref AGE_LABELS.
+	 */
+	std::array<uint64_t, AGE_LABELS.size()> ages{};
+
+	/**
+	 * \brief The largest chunks, largest first.
+	 */
+	std::vector<chunk_size> largest;
+
+	/**
+	 * \brief Adds the statistics from other region files.
+	 *
+	 * \param[in] other the statistics to add.
+	 *
+	 * \param[in] top the number of largest chunks to keep.
+	 */
+	void merge(const stats &other, std::size_t top) {
+		files += other.files;
+		unreadable_files += other.unreadable_files;
+		bytes += other.bytes;
+		sectors += other.sectors;
+		header_sectors += other.header_sectors;
+		live_sectors += other.live_sectors;
+		dead_sectors += other.dead_sectors;
+		slack_sectors += other.slack_sectors;
+		chunks += other.chunks;
+		external_chunks += other.external_chunks;
+		unreadable_chunks += other.unreadable_chunks;
+		compressed.merge(other.compressed);
+		uncompressed.merge(other.uncompressed);
+		for(std::size_t i = 0; i != ages.size(); ++i) {
+			ages[i] += other.ages[i];
+		}
+		largest.insert(largest.end(), other.largest.begin(), other.largest.end());
+		trim(top);
+	}
+
+	/**
+	 * \brief Keeps only the largest chunks.
+	 *
+	 * \param[in] top the number of chunks to keep.
+	 */
+	void trim(std::size_t top) {
+		std::stable_sort(largest.begin(), largest.end(), [](const chunk_size &x, const chunk_size &y) { return x.compressed > y.compressed; });
+		if(largest.size() > top) {
+			largest.resize(top);
+		}
+	}
+};
+
+/**
+ * \brief Returns the timestamp histogram bucket for a chunk.
+ *
+ * \param[in] timestamp the chunk’s timestamp.
+ *
+ * \param[in] now the current time.
+ *
+ * \return the bucket number.
+ */
+std::size_t age_bucket(uint32_t timestamp, std::time_t now) {
+	if(!timestamp) {
+		return 0;
+	}
+	if(timestamp > now) {
+		return 1;
+	}
+	uint64_t age = static_cast<uint64_t>(now - timestamp);
+	std::size_t bucket = 0;
+	while(bucket != AGE_BOUNDS.size() && age >= AGE_BOUNDS[bucket]) {
+		++bucket;
+	}
+	return bucket + 2;
+}
+
+/**
+ * \brief Gathers statistics for one region file.
+ *
+ * Chunks that cannot be read or decompressed are counted as unreadable, and
+ * contribute only to the sector counts. If the region header itself cannot
+ * be read, the error is reported on standard error and the whole file is
+ * counted as unreadable.
+ *
+ * \param[in] filename the region file.
+ *
+ * \param[in] top the number of largest chunks to keep.
+ *
+ * \param[in] jobs the number of threads on which to decompress chunks.
+ *
+ * \param[in] now the current time.
+ *
+ * \param[in] snapshot whether to read from a consistent snapshot of the file.
+ *
+ * \return the statistics.
+ */
+stats stat_file(const std::filesystem::path &filename, std::size_t top, unsigned int jobs, std::time_t now, bool snapshot) {
+	stats s;
+	s.files = 1;
+	std::optional<reader> opened;
+	try {
+		opened.emplace(filename, snapshot);
+	} catch(const std::exception &exp) {
+		std::cerr << filename.string() + ": " + exp.what() + '\n';
+		s.unreadable_files = 1;
+		return s;
+	}
+	reader &region = *opened;
+	std::optional<coordinates> region_coords = parse_region_filename(filename);
+	s.bytes = region.file().size();
+	s.sectors = (s.bytes + 4095) / 4096;
+	s.header_sectors = std::min<uint64_t>(s.sectors, 2);
+
+	// Measure every chunk, decompressing in parallel.
+	const std::vector<unsigned int> &order = region.offset_order();
+	std::vector<std::optional<chunk_size>> sizes(order.size());
+	parallel::for_each(order.size(), jobs, [&](std::size_t i) {
+		unsigned int index = order[i];
+		try {
+			std::span<const uint8_t> payload = region.payload(index);
+			uint8_t compression_type = region.compression(index);
+			if(!valid_compression(compression_type)) {
+				return;
+			}
+			uint64_t uncompressed = decompress(payload, static_cast<compression>(compression_type)).size();
+			std::optional<coordinates> chunk;
+			if(region_coords) {
+				chunk = coordinates{region_coords->x * 32 + static_cast<int>(index % 32), region_coords->z * 32 + static_cast<int>(index / 32)};
+			}
+			sizes[i] = chunk_size{filename.string(), index, chunk, payload.size(), uncompressed};
+		} catch(const std::exception &) {
+			// Counted as unreadable below.
+		}
+	});
+
+	// Tally the chunks and the sectors they occupy.
+	std::vector<bool> live(s.sectors, false);
+	for(std::size_t i = 0; i != order.size(); ++i) {
+		unsigned int index = order[i];
+		++s.chunks;
+		++s.ages[age_bucket(region.timestamp(index), now)];
+		uint64_t first = std::max<uint64_t>(region.sector_offset(index), 2);
+		uint64_t last = std::min<uint64_t>(uint64_t{region.sector_offset(index)} + region.sector_count(index), s.sectors);
+		for(uint64_t j = first; j < last; ++j) {
+			live[j] = true;
+		}
+		if(!sizes[i]) {
+			++s.unreadable_chunks;
+			continue;
+		}
+		bool external = region.external(index);
+		if(external) {
+			++s.external_chunks;
+		}
+		uint64_t needed = external ? 1 : (5 + sizes[i]->compressed + 4095) / 4096;
+		if(region.sector_count(index) > needed) {
+			s.slack_sectors += region.sector_count(index) - needed;
+		}
+		s.compressed.add(sizes[i]->compressed);
+		s.uncompressed.add(sizes[i]->uncompressed);
+		s.largest.push_back(std::move(*sizes[i]));
+	}
+	s.live_sectors = static_cast<uint64_t>(std::count(live.begin(), live.end(), true));
+	s.dead_sectors = s.sectors - s.header_sectors - s.live_sectors;
+	s.trim(top);
+	return s;
+}
+
+/**
+ * \brief Quotes a string for inclusion in JSON output.
+ *
+ * \param[in] s the string.
+ *
+ * \return the quoted string.
+ */
+std::string json_string(std::string_view s) {
+	std::string ret("\"");
+	for(char ch : s) {
+		if(ch == '"' || ch == '\\') {
+			ret += '\\';
+			ret += ch;
+		} else if(static_cast<unsigned char>(ch) < 0x20) {
+			static const char DIGITS[] = "0123456789abcdef";
+			ret += "\\u00";
+			ret += DIGITS[(ch >> 4) & 0x0F];
+			ret += DIGITS[ch & 0x0F];
+		} else {
+			ret += ch;
+		}
+	}
+	ret += '"';
+	return ret;
+}
+
+/**
+ * \brief Formats a size distribution as JSON.
+ *
+ * \param[in] d the distribution.
+ *
+ * \return the JSON object.
+ */
+std::string json_distribution(const size_distribution &d) {
+	std::string ret("{\"count\":");
+	ret += string::todecu(d.count);
+	ret += ",\"total\":";
+	ret += string::todecu(d.total);
+	if(d.count) {
+		ret += ",\"min\":";
+		ret += string::todecu(d.min);
+		ret += ",\"max\":";
+		ret += string::todecu(d.max);
+		ret += ",\"mean\":";
+		ret += string::todecu(d.total / d.count);
+	}
+	ret += ",\"histogram\":[";
+	for(std::size_t i = 0; i != SIZE_BUCKETS; ++i) {
+		if(i) {
+			ret += ',';
+		}
+		ret += "{\"le\":";
+		ret += i + 1 == SIZE_BUCKETS ? std::string("null") : string::todecu(size_distribution::bucket_bound(i));
+		ret += ",\"count\":";
+		ret += string::todecu(d.buckets[i]);
+		ret += '}';
+	}
+	ret += "]}";
+	return ret;
+}
+
+/**
+ * \brief Formats statistics as JSON.
+ *
+ * \param[in] s the statistics.
+ *
+ * \return the JSON object.
+ */
+std::string json_stats(const stats &s) {
+	std::string ret("{\"files\":");
+	ret += string::todecu(s.files);
+	ret += ",\"unreadable_files\":";
+	ret += string::todecu(s.unreadable_files);
+	ret += ",\"bytes\":";
+	ret += string::todecu(s.bytes);
+	ret += ",\"sectors\":{\"total\":";
+	ret += string::todecu(s.sectors);
+	ret += ",\"header\":";
+	ret += string::todecu(s.header_sectors);
+	ret += ",\"live\":";
+	ret += string::todecu(s.live_sectors);
+	ret += ",\"dead\":";
+	ret += string::todecu(s.dead_sectors);
+	ret += ",\"slack\":";
+	ret += string::todecu(s.slack_sectors);
+	ret += "},\"chunks\":{\"total\":";
+	ret += string::todecu(s.chunks);
+	ret += ",\"external\":";
+	ret += string::todecu(s.external_chunks);
+	ret += ",\"unreadable\":";
+	ret += string::todecu(s.unreadable_chunks);
+	ret += "},\"compressed\":";
+	ret += json_distribution(s.compressed);
+	ret += ",\"uncompressed\":";
+	ret += json_distribution(s.uncompressed);
+	ret += ",\"timestamps\":{";
+	for(std::size_t i = 0; i != AGE_LABELS.size(); ++i) {
+		if(i) {
+			ret += ',';
+		}
+		ret += json_string(AGE_LABELS[i]);
+		ret += ':';
+		ret += string::todecu(s.ages[i]);
+	}
+	ret += "},\"largest\":[";
+	for(std::size_t i = 0; i != s.largest.size(); ++i) {
+		const chunk_size &c = s.largest[i];
+		if(i) {
+			ret += ',';
+		}
+		ret += "{\"file\":";
+		ret += json_string(c.filename);
+		ret += ",\"index\":";
+		ret += string::todecu(c.index);
+		if(c.chunk) {
+			ret += ",\"x\":";
+			ret += string::todecs(c.chunk->x);
+			ret += ",\"z\":";
+			ret += string::todecs(c.chunk->z);
+		}
+		ret += ",\"compressed\":";
+		ret += string::todecu(c.compressed);
+		ret += ",\"uncompressed\":";
+		ret += string::todecu(c.uncompressed);
+		ret += '}';
+	}
+	ret += "]}";
+	return ret;
+}
+
+/**
+ * \brief Formats a size distribution as text.
+ *
+ * \param[in] label the name of the distribution.
+ *
+ * \param[in] d the distribution.
+ *
+ * \param[in] histogram whether to include the histogram.
+ *
+ * \return the text.
+ */
+std::string text_distribution(std::string_view label, const size_distribution &d, bool histogram) {
+	std::string ret("  ");
+	ret += label;
+	ret += " size: ";
+	if(!d.count) {
+		ret += "no chunks\n";
+		return ret;
+	}
+	ret += "min " + string::todecu(d.min) + ", mean " + string::todecu(d.total / d.count) + ", max " + string::todecu(d.max) + ", total " + string::todecu(d.total) + " bytes\n";
+	if(histogram) {
+		for(std::size_t i = 0; i != SIZE_BUCKETS; ++i) {
+			if(d.buckets[i]) {
+				ret += "    ";
+				ret += i + 1 == SIZE_BUCKETS ? std::string("larger") : "<= " + string::todecu(size_distribution::bucket_bound(i) / 1024) + " KiB";
+				ret += ": " + string::todecu(d.buckets[i]) + '\n';
+			}
+		}
+	}
+	return ret;
+}
+
+/**
+ * \brief Formats statistics as text.
+ *
+ * \param[in] name the name of the file or set of files.
+ *
+ * \param[in] s the statistics.
+ *
+ * \param[in] detailed whether to include histograms and the largest chunks.
+ *
+ * \return the text.
+ */
+std::string text_stats(std::string_view name, const stats &s, bool detailed) {
+	std::string ret(name);
+	ret += ":\n";
+	ret += "  size: " + string::todecu(s.bytes) + " bytes in " + string::todecu(s.files) + " file(s) (" + string::todecu(s.unreadable_files) + " unreadable)\n";
+	ret += "  sectors: " + string::todecu(s.sectors) + " (" + string::todecu(s.header_sectors) + " header, " + string::todecu(s.live_sectors) + " live, " + string::todecu(s.dead_sectors) + " dead, " + string::todecu(s.slack_sectors) + " slack)\n";
+	ret += "  chunks: " + string::todecu(s.chunks) + " (" + string::todecu(s.external_chunks) + " external, " + string::todecu(s.unreadable_chunks) + " unreadable)\n";
+	ret += text_distribution("compressed", s.compressed, detailed);
+	ret += text_distribution("uncompressed", s.uncompressed, detailed);
+	if(detailed) {
+		ret += "  timestamps:";
+		for(std::size_t i = 0; i != AGE_LABELS.size(); ++i) {
+			ret += ' ';
+			ret += AGE_LABELS[i];
+			ret += ' ' + string::todecu(s.ages[i]);
+		}
+		ret += '\n';
+		if(!s.largest.empty()) {
+			ret += "  largest chunks:\n";
+			for(const chunk_size &c : s.largest) {
+				ret += "    " + string::todecu(c.compressed) + " bytes (" + string::todecu(c.uncompressed) + " uncompressed): " + c.filename + " index " + string::todecu(c.index);
+				if(c.chunk) {
+					ret += " chunk (" + string::todecs(c.chunk->x) + ", " + string::todecs(c.chunk->z) + ')';
+				}
+				ret += '\n';
+			}
+		}
+	}
+	return ret;
+}
+
+/**
+ * \brief Displays the usage help text.
+ *
+ * \param[in] appname The name of the application.
+ */
+void usage(std::string_view appname) {
+	std::cerr << "Usage:\n";
+	std::cerr << appname << " region-stat [--json] [--snapshot] [--top N] [--jobs N] path [path ...]\n";
+	std::cerr << '\n';
+	std::cerr << "Reports how region files use their space: live, dead (reclaimable by region-compact) and slack\n";
+	std::cerr << "(over-allocated) sectors, compressed and uncompressed chunk size distributions, the largest chunks,\n";
+	std::cerr << "and a histogram of chunk timestamps by age. Region files that cannot be opened are reported on\n";
+	std::cerr << "standard error, counted as unreadable and otherwise skipped, and make the exit status nonzero.\n";
+	std::cerr << '\n';
+	std::cerr << "Arguments:\n";
+	std::cerr << "  --json - write a single JSON object instead of text\n";
+	std::cerr << "  --snapshot - read consistent snapshots of the files, so that they may be in use by a running server\n";
+	std::cerr << "  --top - the number of largest chunks to list (default 10)\n";
+	std::cerr << "  --jobs - gather statistics on N threads (default 0, meaning one per CPU)\n";
+	std::cerr << "  path - a .mca or .mcr file, or a world directory whose region files in all dimensions are included\n";
+}
+}
+}
+
+/**
+ * \brief Entry point for the \c region-stat utility.
+ *
+ * \param[in] appname The name of the application.
+ *
+ * \param[in] args the command-line arguments.
+ *
+ * \return the application exit code.
+ */
+int mcwutil::region::stat(std::string_view appname, std::span<char *> args) {
+	// Check parameters.
+	bool json = false;
+	bool snapshot = false;
+	std::size_t top = 10;
+	unsigned int jobs = parallel::parse_jobs("0").value();
+	for(;;) {
+		if(!args.empty() && args[0] == "--json"sv) {
+			json = true;
+			args = args.subspan(1);
+		} else if(!args.empty() && args[0] == "--snapshot"sv) {
+			snapshot = true;
+			args = args.subspan(1);
+		} else if(args.size() >= 2 && args[0] == "--top"sv) {
+			try {
+				top = string::fromdecui(args[1]);
+			} catch(const std::system_error &) {
+				usage(appname);
+				return 1;
+			}
+			args = args.subspan(2);
+		} else if(args.size() >= 2 && args[0] == "--jobs"sv) {
+			jobs = parallel::parse_jobs(args[1]).value_or(0);
+			args = args.subspan(2);
+		} else {
+			break;
+		}
+	}
+	if(args.empty() || !jobs) {
+		usage(appname);
+		return 1;
+	}
+
+	// Expand world directories into their region files.
+	std::vector<std::filesystem::path> files;
+	for(const char *i : args) {
+		if(std::filesystem::is_directory(i)) {
+			for(const world::dimension &dim : world::find_dimensions(i)) {
+				for(const world::region_file &rf : dim.regions) {
+					files.push_back(rf.path);
+				}
+			}
+		} else {
+			files.emplace_back(i);
+		}
+	}
+
+	// Gather the statistics, in parallel across files, or across chunks if
+	// there is only one file.
+	std::time_t now = std::time(nullptr);
+	std::vector<stats> per_file(files.size());
+	if(files.size() == 1) {
+		per_file[0] = stat_file(files[0], top, jobs, now, snapshot);
+	} else {
+		parallel::for_each(files.size(), jobs, [&](std::size_t i) {
+			per_file[i] = stat_file(files[i], top, 1, now, snapshot);
+		});
+	}
+	stats total;
+	for(const stats &i : per_file) {
+		total.merge(i, top);
+	}
+
+	// Report them.
+	if(json) {
+		std::string out("{\"regions\":[");
+		for(std::size_t i = 0; i != files.size(); ++i) {
+			if(i) {
+				out += ',';
+			}
+			out += "{\"file\":" + json_string(files[i].string()) + ",\"stats\":" + json_stats(per_file[i]) + '}';
+		}
+		out += "],\"total\":" + json_stats(total) + "}\n";
+		std::cout << out;
+	} else {
+		for(std::size_t i = 0; i != files.size(); ++i) {
+			std::cout << text_stats(files[i].string(), per_file[i], files.size() == 1);
+		}
+		if(files.size() > 1) {
+			std::cout << text_stats("Total", total, true);
+		}
+	}
+
+	return total.unreadable_files ? 1 : 0;
+}
@@ -0,0 +1,168 @@
+#include <mcwutil/region/state.hpp>
+#include <mcwutil/util/codec.hpp>
+#include <mcwutil/util/file_descriptor.hpp>
+#include <mcwutil/util/hash.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <vector>
+
+using mcwutil::region::state;
+using namespace std::literals::string_view_literals;
+
+namespace mcwutil::region {
+namespace {
+/**
+ * \brief The magic number at the start of every state file.
+ */
+constexpr std::string_view MAGIC = "MCWUSTA2"sv;
+
+/**
+ * \brief The size of a single entry.
+ */
+constexpr std::size_t ENTRY_SIZE = 1 + 4 + 4;
+
+/**
+ * \brief The size of a state file.
+ */
+constexpr std::size_t FILE_SIZE = MAGIC.size() + 4 + 1024 * ENTRY_SIZE;
+}
+}
+
+/**
+ * \brief Computes the content hash of a chunk.
+ *
+ * \param[in] payload the compressed chunk data.
+ *
+ * \return the hash.
+ */
+uint32_t state::content_hash(std::span<const uint8_t> payload) {
+	return hash::xxh32(payload, 0);
+}
+
+/**
+ * \brief Computes the fingerprint of a run.
+ *
+ * \param[in] parts the strings identifying the run, such as the canonical
+ * paths of its input and output and the options affecting its output.
+ *
+ * \return the fingerprint.
+ */
+uint32_t state::fingerprint(std::span<const std::string> parts) {
+	uint32_t ret = 0;
+	for(const std::string &i : parts) {
+		uint8_t length[4];
+		codec::encode_integer(length, static_cast<uint32_t>(i.size()));
+		ret = hash::xxh32(length, ret);
+		ret = hash::xxh32(std::span(reinterpret_cast<const uint8_t *>(i.data()), i.size()), ret);
+	}
+	return ret;
+}
+
+/**
+ * \brief Loads a state file.
+ *
+ * If the file does not exist, or was recorded by a run with a different
+ * fingerprint, every chunk is considered to have changed.
+ *
+ * \param[in] filename the state file.
+ *
+ * \param[in] fingerprint the fingerprint of the current run, from \ref
+ * fingerprint.
+ *
+ * \exception std::runtime_error if the file exists but is malformed.
+ */
+state::state(const std::filesystem::path &filename, uint32_t fingerprint) :
+		filename_(filename),
+		fingerprint_(fingerprint),
+		entries_{} {
+	if(!std::filesystem::exists(filename_)) {
+		return;
+	}
+	file_descriptor fd = file_descriptor::create_open(filename_, O_RDONLY, 0);
+	struct stat stbuf;
+	fd.fstat(stbuf);
+	if(stbuf.st_size != static_cast<off_t>(FILE_SIZE)) {
+		throw std::runtime_error("Malformed state file: wrong size.");
+	}
+	std::vector<uint8_t> data(FILE_SIZE);
+	fd.read(data.data(), data.size());
+	if(!std::equal(MAGIC.begin(), MAGIC.end(), data.begin())) {
+		throw std::runtime_error("Malformed state file: bad magic number.");
+	}
+	if(codec::decode_integer<uint32_t>(&data[MAGIC.size()]) != fingerprint_) {
+		return;
+	}
+	for(unsigned int i = 0; i < 1024; ++i) {
+		const uint8_t *ptr = &data[MAGIC.size() + 4 + i * ENTRY_SIZE];
+		entries_[i].present = ptr[0] != 0;
+		entries_[i].timestamp = codec::decode_integer<uint32_t>(&ptr[1]);
+		entries_[i].hash = codec::decode_integer<uint32_t>(&ptr[5]);
+	}
+}
+
+/**
+ * \brief Checks whether a chunk is the same as when it was last recorded.
+ *
+ * \param[in] index the index of the chunk within the region.
+ *
+ * \param[in] timestamp the chunk’s current header timestamp.
+ *
+ * \param[in] hash the hash of the chunk’s current payload, from \ref content_hash.
+ *
+ * \return \c true if the chunk was recorded with the same timestamp and hash.
+ */
+bool state::unchanged(unsigned int index, uint32_t timestamp, uint32_t hash) const {
+	const entry &e = entries_[index];
+	return e.present && e.timestamp == timestamp && e.hash == hash;
+}
+
+/**
+ * \brief Records the state of a chunk.
+ *
+ * \param[in] index the index of the chunk within the region.
+ *
+ * \param[in] timestamp the chunk’s header timestamp.
+ *
+ * \param[in] hash the hash of the chunk’s payload, from \ref content_hash.
+ */
+void state::set(unsigned int index, uint32_t timestamp, uint32_t hash) {
+	entries_[index] = {true, timestamp, hash};
+}
+
+/**
+ * \brief Records that a chunk is absent.
+ *
+ * \param[in] index the index of the chunk within the region.
+ */
+void state::clear(unsigned int index) {
+	entries_[index] = {};
+}
+
+/**
+ * \brief Writes the state back to its file.
+ *
+ * The file is replaced atomically, so an interrupted run leaves the previous
+ * state intact.
+ */
+void state::save() const {
+	std::vector<uint8_t> data(FILE_SIZE);
+	std::copy(MAGIC.begin(), MAGIC.end(), data.begin());
+	codec::encode_integer(&data[MAGIC.size()], fingerprint_);
+	for(unsigned int i = 0; i < 1024; ++i) {
+		uint8_t *ptr = &data[MAGIC.size() + 4 + i * ENTRY_SIZE];
+		ptr[0] = entries_[i].present ? 1 : 0;
+		codec::encode_integer(&ptr[1], entries_[i].timestamp);
+		codec::encode_integer(&ptr[5], entries_[i].hash);
+	}
+	std::filesystem::path temp_filename(filename_);
+	temp_filename += ".tmp";
+	file_descriptor fd = file_descriptor::create_open(temp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	fd.write(data.data(), data.size());
+	fd.close();
+	std::filesystem::rename(temp_filename, filename_);
+}
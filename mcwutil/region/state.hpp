@@ -0,0 +1,74 @@
+#ifndef REGION_STATE_H
+#define REGION_STATE_H
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+
+namespace mcwutil::region {
+/**
+ * \brief A record of the chunks of one region as they stood at the end of a
+ * previous run, used to skip chunks that have not changed since.
+ *
+ * Each chunk is identified by its header timestamp and a hash of its
+ * compressed payload. The state as a whole carries a fingerprint of the run
+ * that produced it, covering the files involved and any options affecting the
+ * output; a state recorded under a different fingerprint is ignored. All
+ * integers are big-endian. The file consists of the eight-byte magic number
+ * \c MCWUSTA2, the fingerprint (32 bits), and 1024 nine-byte entries, each
+ * being a present flag (8 bits), the timestamp (32 bits), and the hash (32
+ * bits).
+ */
+class state final {
+	public:
+	static std::uint32_t content_hash(std::span<const std::uint8_t> payload);
+	static std::uint32_t fingerprint(std::span<const std::string> parts);
+
+	explicit state(const std::filesystem::path &filename, std::uint32_t fingerprint);
+
+	bool unchanged(unsigned int index, std::uint32_t timestamp, std::uint32_t hash) const;
+	void set(unsigned int index, std::uint32_t timestamp, std::uint32_t hash);
+	void clear(unsigned int index);
+	void save() const;
+
+	private:
+	/**
+	 * \brief The recorded state of a single chunk.
+	 */
+	struct entry final {
+		/**
+		 * \brief Whether the chunk was present.
+		 */
+		bool present;
+
+		/**
+		 * \brief The chunk’s header timestamp.
+		 */
+		std::uint32_t timestamp;
+
+		/**
+		 * \brief The hash of the chunk’s compressed payload.
+		 */
+		std::uint32_t hash;
+	};
+
+	/**
+	 * \brief The state file.
+	 */
+	std::filesystem::path filename_;
+
+	/**
+	 * \brief The fingerprint of the current run.
+	 */
+	std::uint32_t fingerprint_;
+
+	/**
+	 * \brief The recorded state of every chunk.
+	 */
+	std::array<entry, 1024> entries_;
+};
+}
+
+#endif
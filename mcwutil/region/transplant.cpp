@@ -0,0 +1,200 @@
+#include <mcwutil/calc.hpp>
+#include <mcwutil/region/compression.hpp>
+#include <mcwutil/region/external.hpp>
+#include <mcwutil/region/reader.hpp>
+#include <mcwutil/region/region.hpp>
+#include <mcwutil/region/writer.hpp>
+#include <mcwutil/util/file_descriptor.hpp>
+#include <mcwutil/util/string.hpp>
+#include <algorithm>
+#include <bitset>
+#include <fcntl.h>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+using namespace std::literals::string_view_literals;
+
+namespace mcwutil::region {
+namespace {
+/**
+ * \brief The chunks to copy, grouped by region.
+ *
+ * The key is the region’s X and Z coordinates; the value has one bit per
+ * chunk index within the region.
+ */
+using selection = std::map<std::pair<int, int>, std::bitset<1024>>;
+
+/**
+ * \brief Adds a chunk, or a rectangle of chunks, to a selection.
+ *
+ * \param[in, out] chunks the selection to add to.
+ *
+ * \param[in] spec either <code>X,Z</code> or <code>X1,Z1:X2,Z2</code>, where
+ * the latter names an inclusive rectangle.
+ *
+ * \param[in] scale the number of units per chunk along each axis: 1 if the
+ * coordinates are of chunks, or 16 if they are of blocks.
+ *
+ * \exception std::invalid_argument if \p spec is malformed.
+ */
+void select(selection &chunks, std::string_view spec, int scale) {
+	std::size_t colon = spec.find(':');
+	std::optional<coordinates> first = parse_coordinates(spec.substr(0, colon));
+	std::optional<coordinates> last = colon == std::string_view::npos ? first : parse_coordinates(spec.substr(colon + 1));
+	if(!first || !last) {
+		throw std::invalid_argument("coordinates are not of the form X,Z");
+	}
+	int x1 = calc::divfloor(std::min(first->x, last->x), scale), x2 = calc::divfloor(std::max(first->x, last->x), scale);
+	int z1 = calc::divfloor(std::min(first->z, last->z), scale), z2 = calc::divfloor(std::max(first->z, last->z), scale);
+	for(int rz = calc::divfloor(z1, 32); rz <= calc::divfloor(z2, 32); ++rz) {
+		for(int rx = calc::divfloor(x1, 32); rx <= calc::divfloor(x2, 32); ++rx) {
+			std::bitset<1024> &indices = chunks[{rx, rz}];
+			for(int z = std::max(z1, rz * 32); z <= std::min(z2, rz * 32 + 31); ++z) {
+				for(int x = std::max(x1, rx * 32); x <= std::min(x2, rx * 32 + 31); ++x) {
+					indices.set(static_cast<std::size_t>(calc::real_mod(x, 32) + 32 * calc::real_mod(z, 32)));
+				}
+			}
+		}
+	}
+}
+
+/**
+ * \brief Copies selected chunks from one region file to another.
+ *
+ * \param[in] source_filename the region file to copy from, which need not
+ * exist.
+ *
+ * \param[in] dest_filename the region file to copy into, which is created if
+ * needed.
+ *
+ * \param[in] indices the chunks to copy.
+ *
+ * \return the number of chunks copied and the number removed.
+ */
+std::pair<unsigned int, unsigned int> transplant_region(const std::filesystem::path &source_filename, const std::filesystem::path &dest_filename, const std::bitset<1024> &indices) {
+	std::optional<reader> source;
+	if(std::filesystem::exists(source_filename)) {
+		source.emplace(source_filename);
+	}
+	if(!std::filesystem::exists(dest_filename)) {
+		// There is nothing to remove from a region that does not exist, so
+		// only create one if there is something to put in it.
+		bool any = false;
+		for(unsigned int i = 0; i < 1024 && !any; ++i) {
+			any = indices[i] && source && source->present(i);
+		}
+		if(!any) {
+			return {0, 0};
+		}
+		std::filesystem::create_directories(dest_filename.parent_path());
+	} else if(source && std::filesystem::equivalent(source_filename, dest_filename)) {
+		throw std::runtime_error("Source and destination are the same region file.");
+	}
+
+	writer dest(file_descriptor::create_open(dest_filename, O_RDWR | O_CREAT, 0666), dest_filename);
+	unsigned int copied = 0, removed = 0;
+	for(unsigned int i = 0; i < 1024; ++i) {
+		if(!indices[i]) {
+			continue;
+		}
+		if(source && source->present(i)) {
+			uint8_t compression_type = source->compression(i);
+			if(!valid_compression(compression_type)) {
+				throw std::runtime_error("Malformed chunk: unrecognized compression type.");
+			}
+			dest.write(i, source->payload(i), compression_type, source->timestamp(i));
+			++copied;
+		} else if(dest.sector_offset(i) || dest.sector_count(i)) {
+			dest.remove(i);
+			++removed;
+		}
+	}
+	dest.close();
+	return {copied, removed};
+}
+
+/**
+ * \brief Displays the usage help text.
+ *
+ * \param[in] appname The name of the application.
+ */
+void usage(std::string_view appname) {
+	std::cerr << "Usage:\n";
+	std::cerr << appname << " region-transplant [--dimension dimension] [--blocks] sourceworld destworld chunks [chunks ...]\n";
+	std::cerr << '\n';
+	std::cerr << "Copies chunks from one world into another, modifying the destination region files in place.\n";
+	std::cerr << "The compressed chunk data is copied as-is, along with its timestamp. A selected chunk that is absent\n";
+	std::cerr << "from the source is removed from the destination, so the selected area ends up exactly as in the source.\n";
+	std::cerr << '\n';
+	std::cerr << "Arguments:\n";
+	std::cerr << "  --dimension - the dimension directory relative to the worlds (e.g. DIM-1), or . for the overworld (default)\n";
+	std::cerr << "  --blocks - the coordinates are of blocks rather than chunks; every chunk containing part of the area is copied\n";
+	std::cerr << "  sourceworld - the world directory to copy from, such as a backup\n";
+	std::cerr << "  destworld - the world directory to copy into\n";
+	std::cerr << "  chunks - a chunk as X,Z, or an inclusive rectangle of chunks as X1,Z1:X2,Z2\n";
+}
+}
+}
+
+/**
+ * \brief Entry point for the \c region-transplant utility.
+ *
+ * \param[in] appname The name of the application.
+ *
+ * \param[in] args the command-line arguments.
+ *
+ * \return the application exit code.
+ */
+int mcwutil::region::transplant(std::string_view appname, std::span<char *> args) {
+	// Check parameters.
+	std::filesystem::path dimension(".");
+	int scale = 1;
+	for(;;) {
+		if(args.size() >= 2 && args[0] == "--dimension"sv) {
+			dimension = args[1];
+			args = args.subspan(2);
+		} else if(!args.empty() && args[0] == "--blocks"sv) {
+			scale = 16;
+			args = args.subspan(1);
+		} else {
+			break;
+		}
+	}
+	if(args.size() < 3) {
+		usage(appname);
+		return 1;
+	}
+	selection chunks;
+	for(const char *i : args.subspan(2)) {
+		try {
+			select(chunks, i, scale);
+		} catch(const std::invalid_argument &) {
+			usage(appname);
+			return 1;
+		}
+	}
+
+	// Copy the chunks one region at a time.
+	std::filesystem::path source_directory = std::filesystem::path(args[0]) / dimension / "region";
+	std::filesystem::path dest_directory = std::filesystem::path(args[1]) / dimension / "region";
+	unsigned int copied = 0, removed = 0;
+	for(const auto &[region_coords, indices] : chunks) {
+		std::string name("r.");
+		name += string::todecs(region_coords.first);
+		name += '.';
+		name += string::todecs(region_coords.second);
+		name += ".mca";
+		auto [region_copied, region_removed] = transplant_region(source_directory / name, dest_directory / name, indices);
+		copied += region_copied;
+		removed += region_removed;
+	}
+	std::cout << copied << " chunk(s) copied, " << removed << " removed.\n";
+
+	return 0;
+}
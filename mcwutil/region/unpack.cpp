@@ -1,25 +1,94 @@
+#include <mcwutil/region/bundle.hpp>
+#include <mcwutil/region/compression.hpp>
+#include <mcwutil/region/metadata.hpp>
+#include <mcwutil/region/reader.hpp>
 #include <mcwutil/region/region.hpp>
-#include <mcwutil/util/codec.hpp>
+#include <mcwutil/region/state.hpp>
 #include <mcwutil/util/file_descriptor.hpp>
+#include <mcwutil/util/io_batch.hpp>
+#include <mcwutil/util/parallel.hpp>
 #include <mcwutil/util/string.hpp>
-#include <mcwutil/util/xml.hpp>
 #include <cerrno>
 #include <cstddef>
 #include <cstdio>
 #include <fcntl.h>
 #include <filesystem>
 #include <iostream>
-#include <libxml/tree.h>
+#include <optional>
 #include <stdexcept>
 #include <string>
 #include <string_view>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <utility>
+#include <vector>
 
 using namespace std::literals::string_literals;
 using namespace std::literals::string_view_literals;
 
+namespace mcwutil::region {
+namespace {
+/**
+ * \brief A chunk file to be written.
+ */
+struct chunk_file final {
+	/**
+	 * \brief The name of the file.
+	 */
+	std::filesystem::path filename;
+
+	/**
+	 * \brief The data to write, as a view into the region.
+	 */
+	std::span<const uint8_t> payload;
+
+	/**
+	 * \brief The position of the data within the region file, or nothing if
+	 * the data is in an external chunk file.
+	 */
+	std::optional<off_t> region_offset;
+};
+
+/**
+ * \brief Writes a sequence of chunk files.
+ *
+ * Data is copied out of the region file within the kernel where possible.
+ * Whatever cannot be copied that way, including external chunks, is written
+ * from the mapping through a batch, each file being kept open until its write
+ * has completed. The batch queues at most as many writes as there are
+ * reserved slots, so the descriptors never move while queued.
+ *
+ * \param[in] files the files to write.
+ *
+ * \param[in] region_fd the region file from which the chunks come.
+ */
+void write_chunk_files(std::span<const chunk_file> files, const file_descriptor &region_fd) {
+	io_batch batch;
+	std::vector<file_descriptor> fds;
+	fds.reserve(64);
+	bool kernel_copy = true;
+	for(const chunk_file &i : files) {
+		if(fds.size() == 64) {
+			batch.flush();
+			fds.clear();
+		}
+		file_descriptor fd = file_descriptor::create_open(i.filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		std::size_t copied = 0;
+		if(kernel_copy && i.region_offset) {
+			copied = region_fd.copy_range(*i.region_offset, fd, 0, i.payload.size());
+			kernel_copy = copied == i.payload.size();
+		}
+		if(copied != i.payload.size()) {
+			fds.push_back(std::move(fd));
+			batch.pwrite(fds.back(), i.payload.data() + copied, i.payload.size() - copied, static_cast<off_t>(copied));
+		}
+	}
+	batch.flush();
+}
+}
+}
+
 /**
  * \brief Entry point for the \c region-unpack utility.
  *
@@ -31,15 +100,46 @@ using namespace std::literals::string_view_literals;
  */
 int mcwutil::region::unpack(std::string_view appname, std::span<char *> args) {
 	// Check parameters.
-	if(args.size() != 2) {
+	bool to_bundle = false;
+	bool binary_metadata = false;
+	bool snapshot = false;
+	std::optional<std::filesystem::path> state_filename;
+	unsigned int jobs = 1;
+	for(;;) {
+		if(!args.empty() && args[0] == "--bundle"sv) {
+			to_bundle = true;
+			args = args.subspan(1);
+		} else if(!args.empty() && args[0] == "--snapshot"sv) {
+			snapshot = true;
+			args = args.subspan(1);
+		} else if(!args.empty() && args[0] == "--binary-metadata"sv) {
+			binary_metadata = true;
+			args = args.subspan(1);
+		} else if(args.size() >= 2 && args[0] == "--state"sv) {
+			state_filename = args[1];
+			args = args.subspan(2);
+		} else if(args.size() >= 2 && args[0] == "--jobs"sv) {
+			jobs = parallel::parse_jobs(args[1]).value_or(0);
+			args = args.subspan(2);
+		} else {
+			break;
+		}
+	}
+	if(args.size() != 2 || (to_bundle && (state_filename || binary_metadata)) || !jobs) {
 		std::cerr << "Usage:\n";
-		std::cerr << appname << " region-unpack regionfile outdir\n";
+		std::cerr << appname << " region-unpack [--bundle | [--binary-metadata] [--state statefile]] [--snapshot] [--jobs N] regionfile outdir\n";
 		std::cerr << '\n';
 		std::cerr << "Unpacks a region file into its constituent chunks.\n";
 		std::cerr << '\n';
 		std::cerr << "Arguments:\n";
+		std::cerr << "  --bundle - write a single bundle file instead of a directory of chunk files\n";
+		std::cerr << "  --binary-metadata - write metadata.bin, which is faster to build and parse, instead of metadata.xml\n";
+		std::cerr << "  --state - skip writing chunk files left unchanged since the run that last updated statefile, if that run\n";
+		std::cerr << "            unpacked the same regionfile into the same outdir\n";
+		std::cerr << "  --snapshot - unpack a consistent snapshot of regionfile, so that it may be in use by a running server\n";
+		std::cerr << "  --jobs - write chunk files on N threads (0 means one per CPU); the output is the same either way\n";
 		std::cerr << "  regionfile - the .mcr file to unpack\n";
-		std::cerr << "  outdir - the directory to unpack into\n";
+		std::cerr << "  outdir - the directory to unpack into, or the bundle file to create if --bundle is given\n";
 		return 1;
 	}
 
@@ -48,80 +148,72 @@ int mcwutil::region::unpack(std::string_view appname, std::span<char *> args) {
 	const char *output_directory = args[1];
 
 	// Open the region file.
-	file_descriptor region_fd = file_descriptor::create_open(region_filename, O_RDONLY, 0);
-
-	// Read the header.
-	uint8_t header[8192];
-	region_fd.pread(header, sizeof(header), 0);
+	reader region(region_filename, snapshot);
 
-	// Iterate the chunks, filling in the metadata document and extracting the chunks to files.
-	auto metadata_document = xml::empty();
-	xml::internal_subset(*metadata_document, u8"minecraft-region-metadata", nullptr, u8"urn:uuid:5e7a5ee0-2a7b-11e1-9e08-1c4bd68d068e");
-	xmlNode &metadata_root_elt = xml::node_create_root(*metadata_document, u8"minecraft-region-metadata");
-	for(unsigned int i = 0; i < 1024; ++i) {
-		// Decode the header for this chunk.
-		uint32_t offset_sectors = codec::decode_integer<uint32_t, 3>(&header[i * 4]);
-		uint8_t size_sectors = codec::decode_integer<uint8_t>(&header[i * 4 + 3]);
-		uint32_t timestamp = codec::decode_integer<uint32_t>(&header[4096 + i * 4]);
-
-		// Sanity check.
-		if((offset_sectors && !size_sectors) || (size_sectors && !offset_sectors)) {
-			throw std::runtime_error("Malformed region header: chunk is half-present.");
-		}
-
-		// Construct a metadata element.
-		xmlNode &metadata_chunk_elt = xml::node_append_child(metadata_root_elt, u8"chunk");
-		xml::node_attr(metadata_chunk_elt, u8"index", string::l2u(string::todecu(i)).c_str());
-
-		if(offset_sectors) {
-			// Record the chunk's metadata.
-			xml::node_attr(metadata_chunk_elt, u8"present", u8"1");
-			xml::node_attr(metadata_chunk_elt, u8"timestamp", string::l2u(string::todecu(timestamp)).c_str());
+	// If requested, write a bundle and stop.
+	if(to_bundle) {
+		bundle::write(region, output_directory);
+		return 0;
+	}
 
-			// Compute the location and size of the chunk.
-			off_t offset_bytes = static_cast<off_t>(offset_sectors) * 4096;
-			std::size_t rough_size_bytes = static_cast<std::size_t>(size_sectors) * 4096;
+	// Load the state of the previous run, if requested. The state is only
+	// valid for the same region and output directory.
+	std::optional<state> previous;
+	if(state_filename) {
+		std::vector<std::string> identity{"region-unpack", std::filesystem::weakly_canonical(region_filename).string(), std::filesystem::weakly_canonical(output_directory).string()};
+		previous.emplace(*state_filename, state::fingerprint(identity));
+	}
 
-			// Read the chunk's data.
-			uint8_t chunk_data[rough_size_bytes];
-			region_fd.pread(chunk_data, rough_size_bytes, offset_bytes);
+	// The chunk files to write.
+	std::vector<chunk_file> chunk_files;
 
-			// Extract and sanity-check the chunk's header.
-			uint32_t precise_size_bytes = codec::decode_integer<uint32_t>(&chunk_data[0]);
-			if(precise_size_bytes < 1) {
-				throw std::runtime_error("Malformed chunk: precise size < 1.");
-			}
-			if(precise_size_bytes > rough_size_bytes) {
-				throw std::runtime_error("Malformed chunk: precise size > rough size.");
-			}
-			uint8_t compression_type = codec::decode_integer<uint8_t>(&chunk_data[4]);
-			if(compression_type != 2) {
+	// Iterate the chunks, collecting the chunk files to write.
+	for(unsigned int i = 0; i < 1024; ++i) {
+		if(region.present(i)) {
+			// Locate and sanity-check the chunk's data.
+			std::span<const uint8_t> payload = region.payload(i);
+			uint8_t compression_type = region.compression(i);
+			if(!valid_compression(compression_type)) {
 				throw std::runtime_error("Malformed chunk: unrecognized compression type.");
 			}
-			std::size_t payload_size_bytes = precise_size_bytes - 1;
-			const void *payload = &chunk_data[5];
 
-			// Copy the chunk's data out to a file.
+			// Copy the chunk's data out to a file, unless the previous run
+			// already wrote the same data and the file is still there.
 			std::string name_part("chunk-"s);
 			name_part += string::todecu(i, 4);
-			name_part += ".nbt.zlib"sv;
+			name_part += compression_extension(static_cast<compression>(compression_type));
 			std::filesystem::path chunk_filename(output_directory);
 			chunk_filename /= name_part;
-			file_descriptor chunk_fd = file_descriptor::create_open(chunk_filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-			chunk_fd.write(payload, payload_size_bytes);
-			chunk_fd.close();
-		} else {
-			// Mark the chunk as non-present in the metadata document.
-			xml::node_attr(metadata_chunk_elt, u8"present", u8"0");
+			uint32_t hash = previous ? state::content_hash(payload) : 0;
+			if(!previous || !previous->unchanged(i, region.timestamp(i), hash) || !std::filesystem::exists(chunk_filename)) {
+				std::optional<off_t> region_offset;
+				if(!region.external(i)) {
+					region_offset = payload.data() - region.file().data();
+				}
+				chunk_files.push_back({std::move(chunk_filename), payload, region_offset});
+			}
+			if(previous) {
+				previous->set(i, region.timestamp(i), hash);
+			}
+		} else if(previous) {
+			previous->clear(i);
 		}
 	}
 
+	// Write the chunk files, giving each job a contiguous share.
+	parallel::for_each(jobs, jobs, [&chunk_files, &region, jobs](std::size_t job) {
+		std::size_t first = chunk_files.size() * job / jobs;
+		std::size_t last = chunk_files.size() * (job + 1) / jobs;
+		write_chunk_files(std::span(chunk_files).subspan(first, last - first), region.fd());
+	});
+
 	// Write out the metadata file.
-	std::filesystem::path metadata_filename(output_directory);
-	metadata_filename /= "metadata.xml";
-	file_descriptor metadata_fd = file_descriptor::create_open(metadata_filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-	xml::write(*metadata_document, metadata_fd);
-	metadata_fd.close();
+	save_metadata(output_directory, region, binary_metadata);
+
+	// Record what was unpacked, for the next run.
+	if(previous) {
+		previous->save();
+	}
 
 	return 0;
 }
@@ -0,0 +1,237 @@
+#include <mcwutil/nbt/nbt.hpp>
+#include <mcwutil/region/compression.hpp>
+#include <mcwutil/region/reader.hpp>
+#include <mcwutil/region/region.hpp>
+#include <mcwutil/util/parallel.hpp>
+#include <mcwutil/util/string.hpp>
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std::literals::string_view_literals;
+
+namespace mcwutil::region {
+namespace {
+/**
+ * \brief The outcome of verifying one region file.
+ */
+struct file_report final {
+	/**
+	 * \brief The report lines, one per chunk.
+	 */
+	std::string text;
+
+	/**
+	 * \brief The number of chunks checked.
+	 */
+	std::size_t chunks;
+
+	/**
+	 * \brief The number of problems found.
+	 */
+	std::size_t errors;
+};
+
+/**
+ * \brief Appends one line to a report.
+ *
+ * \param[in, out] report the report.
+ *
+ * \param[in] filename the region file.
+ *
+ * \param[in] index the chunk index, or nothing for a problem with the file
+ * as a whole.
+ *
+ * \param[in] error the problem found, or an empty string if there is none.
+ */
+void report_line(file_report &report, std::string_view filename, std::optional<unsigned int> index, std::string_view error) {
+	report.text += filename;
+	report.text += '\t';
+	report.text += index ? string::todecu(*index) : "-"sv;
+	report.text += error.empty() ? "\tok\t-\n"sv : "\terror\t"sv;
+	if(!error.empty()) {
+		report.text += error;
+		report.text += '\n';
+		++report.errors;
+	}
+}
+
+/**
+ * \brief Checks a chunk’s payload end to end.
+ *
+ * \param[in] region the region containing the chunk.
+ *
+ * \param[in] index the index of the chunk within the region.
+ *
+ * \return the problem found, or an empty string if the chunk is sound.
+ */
+std::string verify_chunk(const reader &region, unsigned int index) {
+	try {
+		std::span<const uint8_t> payload = region.payload(index);
+		uint8_t compression_type = region.compression(index);
+		if(!valid_compression(compression_type)) {
+			throw std::runtime_error("Malformed chunk: unrecognized compression type.");
+		}
+		nbt::validate(decompress(payload, static_cast<compression>(compression_type)));
+		return {};
+	} catch(const std::exception &exp) {
+		return exp.what();
+	}
+}
+
+/**
+ * \brief Checks a region file.
+ *
+ * \param[in] filename the region file.
+ *
+ * \param[in] jobs the number of threads on which to check chunks.
+ *
+ * \param[in] snapshot whether to read from a consistent snapshot of the file.
+ *
+ * \return the report.
+ */
+file_report verify_file(const char *filename, unsigned int jobs, bool snapshot) {
+	file_report report{{}, 0, 0};
+	std::optional<reader> region;
+	try {
+		region.emplace(filename, snapshot);
+	} catch(const std::exception &exp) {
+		report_line(report, filename, std::nullopt, exp.what());
+		return report;
+	}
+
+	// Check the header: each chunk must lie wholly after the header, within
+	// the file (allowing a final partial sector), and clear of every other
+	// chunk.
+	std::array<std::string, 1024> errors;
+	std::size_t file_sectors = (region->file().size() + 4095) / 4096;
+	std::optional<unsigned int> previous;
+	for(unsigned int i : region->offset_order()) {
+		uint32_t offset = region->sector_offset(i);
+		uint8_t count = region->sector_count(i);
+		if(!offset || !count) {
+			errors[i] = "Malformed region header: chunk is half-present.";
+		} else if(offset < 2) {
+			errors[i] = "Malformed region header: chunk overlaps header.";
+		} else if(offset + count > file_sectors) {
+			errors[i] = "Malformed region header: chunk sectors beyond end of file.";
+		}
+		if(previous && offset < region->sector_offset(*previous) + region->sector_count(*previous)) {
+			std::string message = "Malformed region header: chunk overlaps chunk ";
+			errors[*previous] = message + string::todecu(i) + '.';
+			errors[i] = message + string::todecu(*previous) + '.';
+		}
+		if(!previous || offset + count > region->sector_offset(*previous) + region->sector_count(*previous)) {
+			previous = i;
+		}
+	}
+
+	// Check the payloads of the chunks whose locations are sound.
+	const std::vector<unsigned int> &order = region->offset_order();
+	parallel::for_each(order.size(), jobs, [&region, &errors, &order](std::size_t i) {
+		if(errors[order[i]].empty()) {
+			errors[order[i]] = verify_chunk(*region, order[i]);
+		}
+	});
+
+	for(unsigned int i = 0; i < 1024; ++i) {
+		if(region->present(i)) {
+			report_line(report, filename, i, errors[i]);
+			++report.chunks;
+		}
+	}
+	return report;
+}
+}
+}
+
+/**
+ * \brief Entry point for the \c region-verify utility.
+ *
+ * \param[in] appname The name of the application.
+ *
+ * \param[in] args the command-line arguments.
+ *
+ * \return the application exit code.
+ */
+int mcwutil::region::verify(std::string_view appname, std::span<char *> args) {
+	// Check parameters.
+	unsigned int jobs = parallel::parse_jobs("0").value();
+	bool errors_only = false;
+	bool snapshot = false;
+	for(;;) {
+		if(args.size() >= 2 && args[0] == "--jobs"sv) {
+			jobs = parallel::parse_jobs(args[1]).value_or(0);
+			args = args.subspan(2);
+		} else if(!args.empty() && args[0] == "--errors-only"sv) {
+			errors_only = true;
+			args = args.subspan(1);
+		} else if(!args.empty() && args[0] == "--snapshot"sv) {
+			snapshot = true;
+			args = args.subspan(1);
+		} else {
+			break;
+		}
+	}
+	if(args.empty() || !jobs) {
+		std::cerr << "Usage:\n";
+		std::cerr << appname << " region-verify [--jobs N] [--errors-only] [--snapshot] regionfile [regionfile ...]\n";
+		std::cerr << '\n';
+		std::cerr << "Checks region files for corruption: the header is checked for overlapping and out-of-bounds chunks,\n";
+		std::cerr << "and every chunk is fully decompressed and its NBT structure walked.\n";
+		std::cerr << '\n';
+		std::cerr << "Arguments:\n";
+		std::cerr << "  --jobs - check on N threads (default 0, meaning one per CPU)\n";
+		std::cerr << "  --errors-only - report only chunks with problems\n";
+		std::cerr << "  --snapshot - check consistent snapshots of the files, so that they may be in use by a running server\n";
+		std::cerr << "  regionfile - a .mca or .mcr file to check\n";
+		std::cerr << '\n';
+		std::cerr << "One line is printed per chunk, with tab-separated fields: file, chunk index (- for the file as a whole),\n";
+		std::cerr << "ok or error, and the problem found (- if none). A summary line follows.\n";
+		std::cerr << "The exit code is 0 if no problems were found, or 2 if any were.\n";
+		return 1;
+	}
+
+	// Check the files. A single file is checked chunk by chunk in parallel;
+	// several files are checked in parallel, a window at a time so that
+	// reports are printed in order without all being held at once.
+	std::size_t chunks = 0, errors = 0;
+	std::size_t window = args.size() == 1 ? 1 : std::size_t{jobs} * 4;
+	for(std::size_t first = 0; first < args.size(); first += window) {
+		std::size_t count = std::min(window, args.size() - first);
+		std::vector<file_report> reports(count);
+		if(args.size() == 1) {
+			reports[0] = verify_file(args[0], jobs, snapshot);
+		} else {
+			parallel::for_each(count, jobs, [&reports, &args, first, snapshot](std::size_t i) {
+				reports[i] = verify_file(args[first + i], 1, snapshot);
+			});
+		}
+		for(const file_report &i : reports) {
+			if(errors_only) {
+				for(std::string_view text = i.text; !text.empty();) {
+					std::string_view line = text.substr(0, text.find('\n') + 1);
+					if(line.find("\terror\t"sv) != std::string_view::npos) {
+						std::cout << line;
+					}
+					text.remove_prefix(line.size());
+				}
+			} else {
+				std::cout << i.text;
+			}
+			chunks += i.chunks;
+			errors += i.errors;
+		}
+	}
+	std::cout << args.size() << " files, " << chunks << " chunks checked, " << errors << " problems found\n";
+
+	return errors ? 2 : 0;
+}
@@ -0,0 +1,501 @@
+#include <mcwutil/region/compression.hpp>
+#include <mcwutil/region/external.hpp>
+#include <mcwutil/region/reader.hpp>
+#include <mcwutil/region/writer.hpp>
+#include <mcwutil/util/codec.hpp>
+#include <algorithm>
+#include <cassert>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <system_error>
+#include <vector>
+
+using mcwutil::region::writer;
+
+/**
+ * \brief Prepares to build a replacement for a region file.
+ *
+ * The new region is written to a temporary file alongside the final one, so
+ * that the file it replaces may be read, even by the caller, until \ref
+ * commit is called.
+ *
+ * \param[in] filename the name the region file will finally have, which must
+ * be of the form <code>r.X.Z.mca</code> if any external chunks are written.
+ *
+ * \return the writer.
+ */
+writer writer::replace(const std::filesystem::path &filename) {
+	std::filesystem::path temp_filename(filename);
+	temp_filename += ".tmp";
+	return writer(file_descriptor::create_open(temp_filename, O_RDWR | O_TRUNC | O_CREAT, 0666), filename, temp_filename);
+}
+
+/**
+ * \brief Prepares to modify a region file.
+ *
+ * If the file is empty, an empty header is written to it.
+ *
+ * \param[in] fd the region file, which must be open for reading and writing.
+ *
+ * \param[in] filename the name the region file will finally have, which must
+ * be of the form <code>r.X.Z.mca</code> if any external chunks are written, or
+ * empty to reject chunks too large for the region.
+ *
+ * \exception std::runtime_error if the file is too short to hold a header.
+ */
+writer::writer(file_descriptor &&fd, const std::filesystem::path &filename) :
+		writer(std::move(fd), filename, {}) {
+}
+
+/**
+ * \brief Prepares to modify a region file, which may be a replacement for
+ * another.
+ *
+ * \param[in] fd the region file, which must be open for reading and writing.
+ *
+ * \param[in] filename the name the region file will finally have.
+ *
+ * \param[in] temp_filename the name of the file \p fd refers to if it is to
+ * be renamed to \p filename on commit, or empty if \p fd refers to \p
+ * filename itself.
+ *
+ * \exception std::runtime_error if the file is too short to hold a header.
+ */
+writer::writer(file_descriptor &&fd, const std::filesystem::path &filename, const std::filesystem::path &temp_filename) :
+		fd_(std::move(fd)),
+		filename_(filename),
+		temp_filename_(temp_filename),
+		header_{},
+		staged_{} {
+	struct stat stbuf;
+	fd_.fstat(stbuf);
+	if(!stbuf.st_size) {
+		fd_.pwrite(header_.data(), header_.size(), 0);
+		stbuf.st_size = static_cast<off_t>(header_.size());
+	} else if(stbuf.st_size < static_cast<off_t>(header_.size())) {
+		throw std::runtime_error("Malformed region file: header truncated.");
+	} else {
+		fd_.pread(header_.data(), header_.size(), 0);
+	}
+
+	// Build the free sector bitmap. The two header sectors are always in use.
+	used_.resize(static_cast<std::size_t>((stbuf.st_size + 4095) / 4096), false);
+	mark(0, 2, true);
+	for(unsigned int i = 0; i < 1024; ++i) {
+		uint32_t offset = entry_offset(i);
+		uint8_t count = sector_count(i);
+		if(offset && count) {
+			if(offset + count > used_.size()) {
+				used_.resize(offset + count, false);
+			}
+			mark(offset, count, true);
+		}
+	}
+}
+
+/**
+ * \brief Removes the temporary files of a replacement region that was never
+ * committed.
+ */
+writer::~writer() {
+	if(!temp_filename_.empty()) {
+		std::error_code ec;
+		std::filesystem::remove(temp_filename_, ec);
+		for(unsigned int i = 0; i < 1024; ++i) {
+			if(staged_[i]) {
+				std::filesystem::remove(staged_filename(i), ec);
+			}
+		}
+	}
+}
+
+/**
+ * \brief Writes a chunk, replacing any existing copy.
+ *
+ * \param[in] index the index of the chunk within the region.
+ *
+ * \param[in] payload the compressed chunk data, not including the length and
+ * compression type.
+ *
+ * \param[in] compression the compression type byte.
+ *
+ * \param[in] timestamp the last-modified time to record for the chunk.
+ *
+ * \exception std::runtime_error if the chunk is too large for a region file
+ * and the writer has no file name from which to derive an external file name.
+ */
+void writer::write(unsigned int index, std::span<const uint8_t> payload, uint8_t compression, uint32_t timestamp) {
+	if((5 + payload.size() + 4095) / 4096 > 255 && !filename_.empty()) {
+		// Replace the external file rather than overwriting it, since its
+		// old contents may still be mapped by a reader. A replacement region
+		// leaves it under its temporary name until committed.
+		std::filesystem::path temp_filename = staged_filename(index);
+		file_descriptor external_fd = file_descriptor::create_open(temp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		external_fd.write(payload.data(), payload.size());
+		external_fd.close();
+		if(temp_filename_.empty()) {
+			std::filesystem::rename(temp_filename, external_filename(filename_, index));
+		} else {
+			staged_[index] = true;
+		}
+		write_external(index, compression, timestamp);
+	} else {
+		bool was_external = entry_external(index);
+		place(index, payload, compression, timestamp);
+		if(was_external) {
+			remove_external(index);
+		}
+	}
+}
+
+/**
+ * \brief Records a chunk whose payload has already been written to its
+ * external file, replacing any existing copy in the region.
+ *
+ * \param[in] index the index of the chunk within the region.
+ *
+ * \param[in] compression the compression type byte, without the \ref
+ * COMPRESSION_EXTERNAL flag.
+ *
+ * \param[in] timestamp the last-modified time to record for the chunk.
+ */
+void writer::write_external(unsigned int index, uint8_t compression, uint32_t timestamp) {
+	place(index, {}, static_cast<uint8_t>(compression | COMPRESSION_EXTERNAL), timestamp);
+}
+
+/**
+ * \brief Allocates space for a chunk whose payload the caller will write.
+ *
+ * The chunk’s header entry and length prefix are written immediately. This
+ * allows a whole region to be laid out first and its payloads then copied in
+ * any order, or on several threads at once.
+ *
+ * \param[in] index the index of the chunk within the region, which must not
+ * be present.
+ *
+ * \param[in] payload_size the size of the compressed chunk data, not
+ * including the length and compression type.
+ *
+ * \param[in] compression the compression type byte, including any flags.
+ *
+ * \param[in] timestamp the last-modified time to record for the chunk.
+ *
+ * \return the position in the file at which to write the payload.
+ *
+ * \exception std::runtime_error if the chunk is too large for a region file.
+ */
+off_t writer::reserve(unsigned int index, std::size_t payload_size, uint8_t compression, uint32_t timestamp) {
+	assert(!entry_offset(index));
+	std::size_t needed = (5 + payload_size + 4095) / 4096;
+	if(needed > 255) {
+		throw std::runtime_error("Chunk too large for region file.");
+	}
+	uint32_t offset = allocate(needed, 0, 0);
+	uint8_t chunk_header[5];
+	codec::encode_integer(&chunk_header[0], static_cast<uint32_t>(payload_size + 1));
+	codec::encode_integer(&chunk_header[4], compression);
+	off_t offset_bytes = static_cast<off_t>(offset) * 4096;
+	fd_.pwrite(chunk_header, sizeof(chunk_header), offset_bytes);
+	if(offset + needed > used_.size()) {
+		used_.resize(offset + needed, false);
+		fd_.ftruncate(static_cast<off_t>(used_.size()) * 4096);
+	}
+	write_entry(index, offset, static_cast<uint8_t>(needed), timestamp);
+	mark(offset, static_cast<uint32_t>(needed), true);
+	return offset_bytes + static_cast<off_t>(sizeof(chunk_header));
+}
+
+/**
+ * \brief Returns the name under which the caller should write a chunk’s
+ * external file.
+ *
+ * For a replacement region, this is a temporary name; the file is renamed
+ * into place on \ref commit, or removed if the writer is destroyed first.
+ * The caller must also record the chunk with \ref write_external.
+ *
+ * \param[in] index the index of the chunk within the region.
+ *
+ * \return the name of the file to write.
+ */
+std::filesystem::path writer::stage_external(unsigned int index) {
+	if(temp_filename_.empty()) {
+		return external_filename(filename_, index);
+	}
+	std::filesystem::path ret = staged_filename(index);
+	staged_[index] = true;
+	return ret;
+}
+
+/**
+ * \brief Writes a chunk into the region file itself, replacing any existing
+ * copy.
+ *
+ * \param[in] index the index of the chunk within the region.
+ *
+ * \param[in] payload the compressed chunk data, not including the length and
+ * compression type.
+ *
+ * \param[in] compression the compression type byte, including any flags.
+ *
+ * \param[in] timestamp the last-modified time to record for the chunk.
+ *
+ * \exception std::runtime_error if the chunk is too large for a region file.
+ */
+void writer::place(unsigned int index, std::span<const uint8_t> payload, uint8_t compression, uint32_t timestamp) {
+	std::size_t needed = (5 + payload.size() + 4095) / 4096;
+	if(needed > 255) {
+		throw std::runtime_error("Chunk too large for region file.");
+	}
+	uint32_t old_offset = entry_offset(index);
+	uint8_t old_count = sector_count(index);
+
+	// Reuse the old sectors if the chunk still fits; otherwise find a new
+	// home that does not overlap the old one, so the old copy stays intact
+	// until the header entry is updated.
+	uint32_t offset;
+	if(old_offset && needed <= old_count) {
+		offset = old_offset;
+	} else {
+		offset = allocate(needed, old_offset, old_count);
+	}
+
+	// Write the data, extending the file to a sector boundary if needed.
+	uint8_t chunk_header[5];
+	codec::encode_integer(&chunk_header[0], static_cast<uint32_t>(payload.size() + 1));
+	codec::encode_integer(&chunk_header[4], compression);
+	off_t offset_bytes = static_cast<off_t>(offset) * 4096;
+	fd_.pwrite(chunk_header, sizeof(chunk_header), offset_bytes);
+	fd_.pwrite(payload.data(), payload.size(), offset_bytes + 5);
+	if(offset + needed > used_.size()) {
+		used_.resize(offset + needed, false);
+		fd_.ftruncate(static_cast<off_t>(used_.size()) * 4096);
+	}
+
+	// Point the header at the new copy, then release whatever is left over.
+	write_entry(index, offset, static_cast<uint8_t>(needed), timestamp);
+	if(old_offset) {
+		mark(old_offset, old_count, false);
+	}
+	mark(offset, static_cast<uint32_t>(needed), true);
+}
+
+/**
+ * \brief Removes a chunk from the region.
+ *
+ * \param[in] index the index of the chunk within the region.
+ */
+void writer::remove(unsigned int index) {
+	uint32_t old_offset = entry_offset(index);
+	uint8_t old_count = sector_count(index);
+	bool was_external = entry_external(index);
+	write_entry(index, 0, 0, 0);
+	if(old_offset) {
+		mark(old_offset, old_count, false);
+	}
+	if(was_external) {
+		remove_external(index);
+	}
+}
+
+/**
+ * \brief Closes the region file.
+ */
+void writer::close() {
+	fd_.close();
+}
+
+/**
+ * \brief Moves a replacement region and its external chunk files into place.
+ *
+ * The region is renamed first, then the external files it refers to, and
+ * finally the external files of the region it replaced are removed, except
+ * for those the new region also stores externally.
+ *
+ * \pre The writer was created by \ref replace.
+ */
+void writer::commit() {
+	// Find the chunks that the old region stores externally and the new one
+	// does not. An old region, or chunks of one, that cannot be read have no
+	// external files worth keeping track of.
+	std::vector<unsigned int> stale;
+	if(std::filesystem::exists(filename_)) {
+		try {
+			reader old(filename_);
+			for(unsigned int i = 0; i < 1024; ++i) {
+				try {
+					if(old.present(i) && old.external(i) && !entry_external(i)) {
+						stale.push_back(i);
+					}
+				} catch(const std::runtime_error &) {
+					// Malformed location; leave the chunk alone.
+				}
+			}
+		} catch(const std::runtime_error &) {
+			// Malformed header; replace the file outright.
+		}
+	}
+
+	fd_.close();
+	std::filesystem::rename(temp_filename_, filename_);
+	temp_filename_.clear();
+	for(unsigned int i = 0; i < 1024; ++i) {
+		if(staged_[i]) {
+			std::filesystem::rename(staged_filename(i), external_filename(filename_, i));
+			staged_[i] = false;
+		}
+	}
+	for(unsigned int i : stale) {
+		std::filesystem::remove(external_filename(filename_, i));
+	}
+}
+
+/**
+ * \brief Returns the temporary name under which a chunk’s external file is
+ * written.
+ *
+ * \param[in] index the index of the chunk within the region.
+ *
+ * \return the name of the temporary file.
+ */
+std::filesystem::path writer::staged_filename(unsigned int index) const {
+	std::filesystem::path ret = external_filename(filename_, index);
+	ret += ".tmp";
+	return ret;
+}
+
+/**
+ * \brief Removes the external file of the current copy of a chunk.
+ *
+ * \param[in] index the index of the chunk within the region.
+ */
+void writer::remove_external(unsigned int index) {
+	if(temp_filename_.empty()) {
+		std::filesystem::remove(external_filename(filename_, index));
+	} else {
+		// A replacement region only stores externally the chunks it wrote
+		// itself, whose files are still under their temporary names.
+		std::filesystem::remove(staged_filename(index));
+		staged_[index] = false;
+	}
+}
+
+/**
+ * \brief Returns the offset of a chunk from the cached header.
+ *
+ * \param[in] index the index of the chunk within the region.
+ *
+ * \return the offset, in sectors.
+ */
+uint32_t writer::entry_offset(unsigned int index) const {
+	return codec::decode_integer<uint32_t, 3>(&header_[index * 4]);
+}
+
+/**
+ * \brief Checks whether the current copy of a chunk is stored externally.
+ *
+ * \param[in] index the index of the chunk within the region.
+ *
+ * \return \c true if the chunk is present, its compression type has the \ref
+ * COMPRESSION_EXTERNAL flag, and the writer knows where its external file
+ * is.
+ */
+bool writer::entry_external(unsigned int index) const {
+	uint32_t offset = entry_offset(index);
+	if(!offset || !sector_count(index) || filename_.empty()) {
+		return false;
+	}
+	uint8_t compression;
+	try {
+		fd_.pread(&compression, 1, static_cast<off_t>(offset) * 4096 + 4);
+	} catch(const std::runtime_error &) {
+		// The chunk lies beyond the end of the file, so it cannot be valid.
+		return false;
+	}
+	return (compression & COMPRESSION_EXTERNAL) != 0;
+}
+
+/**
+ * \brief Finds the first run of free sectors of a given length.
+ *
+ * \param[in] count the number of sectors needed.
+ *
+ * \param[in] avoid_first the first sector of a range that must not be
+ * returned even if it is free.
+ *
+ * \param[in] avoid_count the length of the range to avoid.
+ *
+ * \return the first sector of the run, which may lie partly or wholly beyond
+ * the current end of the file.
+ */
+uint32_t writer::allocate(std::size_t count, uint32_t avoid_first, uint32_t avoid_count) {
+	auto usable = [this, avoid_first, avoid_count](std::size_t sector) {
+		if(sector >= avoid_first && sector < static_cast<std::size_t>(avoid_first) + avoid_count) {
+			return false;
+		}
+		return sector >= used_.size() || !used_[sector];
+	};
+	std::size_t run_start = 2, run_length = 0;
+	for(std::size_t i = 2;; ++i) {
+		if(run_length == count) {
+			break;
+		}
+		if(i >= used_.size() && i >= static_cast<std::size_t>(avoid_first) + avoid_count) {
+			// Everything from here onwards is free.
+			if(!run_length) {
+				run_start = i;
+			}
+			break;
+		}
+		if(usable(i)) {
+			if(!run_length) {
+				run_start = i;
+			}
+			++run_length;
+		} else {
+			run_length = 0;
+		}
+	}
+	if(run_start + count > 0xFFFFFF) {
+		throw std::runtime_error("Region file too large.");
+	}
+	return static_cast<uint32_t>(run_start);
+}
+
+/**
+ * \brief Marks a range of sectors as used or free.
+ *
+ * \param[in] first the first sector to mark.
+ *
+ * \param[in] count the number of sectors to mark.
+ *
+ * \param[in] used \c true to mark the sectors used, or \c false to mark them
+ * free.
+ */
+void writer::mark(uint32_t first, uint32_t count, bool used) {
+	std::size_t last = std::min(static_cast<std::size_t>(first) + count, used_.size());
+	for(std::size_t i = first; i < last; ++i) {
+		used_[i] = used;
+	}
+}
+
+/**
+ * \brief Updates and writes out the header entries for one chunk.
+ *
+ * \param[in] index the index of the chunk within the region.
+ *
+ * \param[in] offset the offset, in sectors, of the chunk.
+ *
+ * \param[in] count the number of sectors allocated to the chunk.
+ *
+ * \param[in] timestamp the last-modified time of the chunk.
+ */
+void writer::write_entry(unsigned int index, uint32_t offset, uint8_t count, uint32_t timestamp) {
+	uint8_t *location = &header_[index * 4];
+	codec::encode_integer<uint32_t, 3>(location, offset);
+	codec::encode_integer(location + 3, count);
+	uint8_t *time = &header_[4096 + index * 4];
+	codec::encode_integer(time, timestamp);
+	fd_.pwrite(location, 4, static_cast<off_t>(index) * 4);
+	fd_.pwrite(time, 4, 4096 + static_cast<off_t>(index) * 4);
+}
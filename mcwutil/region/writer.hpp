@@ -0,0 +1,149 @@
+#ifndef REGION_WRITER_H
+#define REGION_WRITER_H
+
+#include <mcwutil/util/file_descriptor.hpp>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <sys/types.h>
+#include <vector>
+
+namespace mcwutil::region {
+/**
+ * \brief Modifies individual chunks of a region file in place.
+ *
+ * A bitmap of free sectors is built from the header at construction. A chunk
+ * that still fits in its old sectors is rewritten where it is; otherwise it
+ * is moved to the first free run of sectors large enough to hold it, or to
+ * the end of the file. Only the affected header entries are rewritten.
+ *
+ * A chunk too large to fit in 255 sectors is stored in an external
+ * <code>c.X.Z.mcc</code> file, leaving only a one-sector stub in the region.
+ *
+ * A writer created by \ref replace instead builds a new region in a temporary
+ * file, with its external chunk files under temporary names too. Nothing
+ * visible under the final names changes until \ref commit; if the writer is
+ * destroyed first, the temporary files are removed.
+ */
+class writer final {
+	public:
+	static writer replace(const std::filesystem::path &filename);
+
+	explicit writer(file_descriptor &&fd, const std::filesystem::path &filename = {});
+	~writer();
+
+	// This class is not copyable.
+	explicit writer(const writer &) = delete;
+	void operator=(const writer &) = delete;
+
+	/**
+	 * \brief Returns the offset of a chunk.
+	 *
+	 * \param[in] index the index of the chunk within the region.
+	 *
+	 * \return the offset, in 4 KiB sectors, of the chunk, or zero if absent.
+	 */
+	uint32_t sector_offset(unsigned int index) const {
+		return entry_offset(index);
+	}
+
+	/**
+	 * \brief Returns the number of sectors allocated to a chunk.
+	 *
+	 * \param[in] index the index of the chunk within the region.
+	 *
+	 * \return the number of 4 KiB sectors allocated to the chunk, or zero if
+	 * absent.
+	 */
+	uint8_t sector_count(unsigned int index) const {
+		return header_[index * 4 + 3];
+	}
+
+	/**
+	 * \brief Checks whether a chunk is stored externally.
+	 *
+	 * \param[in] index the index of the chunk within the region.
+	 *
+	 * \return \c true if the chunk is present and its payload is in its
+	 * <code>c.X.Z.mcc</code> file, or \c false if not.
+	 */
+	bool external(unsigned int index) const {
+		return entry_external(index);
+	}
+
+	/**
+	 * \brief Returns the size of the file.
+	 *
+	 * \return the size, in 4 KiB sectors, of the file.
+	 */
+	uint32_t file_sectors() const {
+		return static_cast<uint32_t>(used_.size());
+	}
+
+	/**
+	 * \brief Returns the underlying file.
+	 *
+	 * \return the file descriptor.
+	 */
+	const file_descriptor &fd() const {
+		return fd_;
+	}
+
+	void write(unsigned int index, std::span<const uint8_t> payload, uint8_t compression, uint32_t timestamp);
+	void write_external(unsigned int index, uint8_t compression, uint32_t timestamp);
+	off_t reserve(unsigned int index, std::size_t payload_size, uint8_t compression, uint32_t timestamp);
+	std::filesystem::path stage_external(unsigned int index);
+	void remove(unsigned int index);
+	void close();
+	void commit();
+
+	private:
+	/**
+	 * \brief The open region file.
+	 */
+	file_descriptor fd_;
+
+	/**
+	 * \brief The name the region file will finally have, from which external
+	 * chunk file names are derived, or empty if external chunks are not
+	 * supported.
+	 */
+	std::filesystem::path filename_;
+
+	/**
+	 * \brief The temporary file holding a replacement region until it is
+	 * committed, or empty if the region is modified in place.
+	 */
+	std::filesystem::path temp_filename_;
+
+	/**
+	 * \brief A copy of the header.
+	 */
+	std::array<uint8_t, 8192> header_;
+
+	/**
+	 * \brief Which sectors of the file are in use, by sector number.
+	 */
+	std::vector<bool> used_;
+
+	/**
+	 * \brief Which chunks of a replacement region have external files written
+	 * under temporary names, waiting to be renamed into place on commit.
+	 */
+	std::array<bool, 1024> staged_;
+
+	explicit writer(file_descriptor &&fd, const std::filesystem::path &filename, const std::filesystem::path &temp_filename);
+	std::filesystem::path staged_filename(unsigned int index) const;
+	void remove_external(unsigned int index);
+	uint32_t entry_offset(unsigned int index) const;
+	bool entry_external(unsigned int index) const;
+	void place(unsigned int index, std::span<const uint8_t> payload, uint8_t compression, uint32_t timestamp);
+	uint32_t allocate(std::size_t count, uint32_t avoid_first, uint32_t avoid_count);
+	void mark(uint32_t first, uint32_t count, bool used);
+	void write_entry(unsigned int index, uint32_t offset, uint8_t count, uint32_t timestamp);
+};
+}
+
+#endif
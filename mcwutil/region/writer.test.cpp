@@ -0,0 +1,307 @@
+#include <mcwutil/region/compression.hpp>
+#include <mcwutil/region/reader.hpp>
+#include <mcwutil/region/writer.hpp>
+#include <mcwutil/util/codec.hpp>
+#include <mcwutil/util/file_descriptor.hpp>
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <string>
+#include <sys/stat.h>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace mcwutil::region {
+namespace {
+/**
+ * \brief Verifies that chunks are placed in, and moved between, the right
+ * sectors.
+ */
+class writer_test final : public CppUnit::TestFixture {
+	public:
+	CPPUNIT_TEST_SUITE(writer_test);
+	CPPUNIT_TEST(test_empty);
+	CPPUNIT_TEST(test_append);
+	CPPUNIT_TEST(test_reuse_in_place);
+	CPPUNIT_TEST(test_relocate);
+	CPPUNIT_TEST(test_relocate_skips_old_range);
+	CPPUNIT_TEST(test_remove);
+	CPPUNIT_TEST(test_reserve);
+	CPPUNIT_TEST(test_existing_file);
+	CPPUNIT_TEST(test_replace_empty_file);
+	CPPUNIT_TEST_SUITE_END();
+
+	private:
+	void test_empty();
+	void test_append();
+	void test_reuse_in_place();
+	void test_relocate();
+	void test_relocate_skips_old_range();
+	void test_remove();
+	void test_reserve();
+	void test_existing_file();
+	void test_replace_empty_file();
+};
+
+/**
+ * \brief Opens an anonymous temporary file.
+ *
+ * \return the file.
+ */
+file_descriptor temporary_file() {
+	return file_descriptor::create_open(std::filesystem::temp_directory_path(), O_RDWR | O_TMPFILE, 0600);
+}
+
+/**
+ * \brief Builds a payload that, with its five-byte chunk header, fills a
+ * number of sectors.
+ *
+ * \param[in] sectors the number of sectors to fill.
+ *
+ * \param[in] fill the byte to fill the payload with.
+ *
+ * \return the payload.
+ */
+std::vector<uint8_t> payload(std::size_t sectors, uint8_t fill) {
+	return std::vector<uint8_t>(sectors * 4096 - 5, fill);
+}
+
+/**
+ * \brief Returns the size of a file.
+ *
+ * \param[in] fd the file.
+ *
+ * \return the size, in bytes.
+ */
+off_t file_size(const file_descriptor &fd) {
+	struct stat stbuf;
+	fd.fstat(stbuf);
+	return stbuf.st_size;
+}
+
+/**
+ * \brief Checks that a chunk’s header entry and data are as expected on disk.
+ *
+ * \param[in] w the writer.
+ *
+ * \param[in] index the index of the chunk.
+ *
+ * \param[in] offset the expected offset, in sectors.
+ *
+ * \param[in] count the expected number of sectors.
+ *
+ * \param[in] fill the byte the payload is expected to be filled with.
+ */
+void check_chunk(const writer &w, unsigned int index, uint32_t offset, uint8_t count, uint8_t fill) {
+	CPPUNIT_ASSERT_EQUAL(offset, w.sector_offset(index));
+	CPPUNIT_ASSERT_EQUAL(count, w.sector_count(index));
+	uint8_t entry[4];
+	w.fd().pread(entry, sizeof(entry), static_cast<off_t>(index) * 4);
+	uint32_t disk_offset = codec::decode_integer<uint32_t, 3>(entry);
+	CPPUNIT_ASSERT_EQUAL(offset, disk_offset);
+	CPPUNIT_ASSERT_EQUAL(count, entry[3]);
+	std::vector<uint8_t> data(static_cast<std::size_t>(count) * 4096);
+	w.fd().pread(data.data(), data.size(), static_cast<off_t>(offset) * 4096);
+	uint32_t length = codec::decode_integer<uint32_t>(data.data());
+	CPPUNIT_ASSERT_EQUAL(static_cast<uint32_t>(data.size() - 4), length);
+	CPPUNIT_ASSERT_EQUAL(static_cast<uint8_t>(COMPRESSION_ZLIB), data[4]);
+	CPPUNIT_ASSERT_EQUAL(fill, data[5]);
+	CPPUNIT_ASSERT_EQUAL(fill, data.back());
+}
+}
+}
+
+/**
+ * \brief Tests that an empty file is given an empty header.
+ */
+void mcwutil::region::writer_test::test_empty() {
+	writer w(temporary_file());
+	CPPUNIT_ASSERT_EQUAL(uint32_t{2}, w.file_sectors());
+	CPPUNIT_ASSERT_EQUAL(off_t{8192}, file_size(w.fd()));
+	for(unsigned int i = 0; i != 1024; ++i) {
+		CPPUNIT_ASSERT_EQUAL(uint32_t{0}, w.sector_offset(i));
+	}
+}
+
+/**
+ * \brief Tests that chunks written to a file with no free sectors are
+ * appended.
+ */
+void mcwutil::region::writer_test::test_append() {
+	writer w(temporary_file());
+	w.write(0, payload(1, 0xA0), COMPRESSION_ZLIB, 1);
+	w.write(5, payload(3, 0xA5), COMPRESSION_ZLIB, 1);
+	check_chunk(w, 0, 2, 1, 0xA0);
+	check_chunk(w, 5, 3, 3, 0xA5);
+	CPPUNIT_ASSERT_EQUAL(uint32_t{6}, w.file_sectors());
+	CPPUNIT_ASSERT_EQUAL(off_t{6 * 4096}, file_size(w.fd()));
+}
+
+/**
+ * \brief Tests that a chunk that still fits in its sectors is rewritten in
+ * place, and that any sectors it no longer needs are freed.
+ */
+void mcwutil::region::writer_test::test_reuse_in_place() {
+	writer w(temporary_file());
+	w.write(0, payload(3, 0xA0), COMPRESSION_ZLIB, 1);
+	w.write(1, payload(1, 0xA1), COMPRESSION_ZLIB, 1);
+	w.write(0, payload(2, 0xB0), COMPRESSION_ZLIB, 2);
+	check_chunk(w, 0, 2, 2, 0xB0);
+	check_chunk(w, 1, 5, 1, 0xA1);
+	CPPUNIT_ASSERT_EQUAL(uint32_t{6}, w.file_sectors());
+
+	// The chunk’s third sector is free again.
+	w.write(2, payload(1, 0xA2), COMPRESSION_ZLIB, 1);
+	check_chunk(w, 2, 4, 1, 0xA2);
+	CPPUNIT_ASSERT_EQUAL(uint32_t{6}, w.file_sectors());
+}
+
+/**
+ * \brief Tests that a chunk that outgrows its sectors is moved to the first
+ * free run large enough, and that its old sectors become free.
+ */
+void mcwutil::region::writer_test::test_relocate() {
+	writer w(temporary_file());
+	w.write(0, payload(1, 0xA0), COMPRESSION_ZLIB, 1);
+	w.write(1, payload(1, 0xA1), COMPRESSION_ZLIB, 1);
+
+	// There is no free run inside the file, so chunk 0 moves to the end.
+	w.write(0, payload(2, 0xB0), COMPRESSION_ZLIB, 2);
+	check_chunk(w, 0, 4, 2, 0xB0);
+	check_chunk(w, 1, 3, 1, 0xA1);
+	CPPUNIT_ASSERT_EQUAL(uint32_t{6}, w.file_sectors());
+
+	// Sector 2 is now free, and is used for the next chunk that fits.
+	w.write(2, payload(1, 0xA2), COMPRESSION_ZLIB, 1);
+	check_chunk(w, 2, 2, 1, 0xA2);
+	CPPUNIT_ASSERT_EQUAL(uint32_t{6}, w.file_sectors());
+}
+
+/**
+ * \brief Tests that a chunk that is moved never overlaps its old sectors,
+ * even when they and the sectors after them are free, so that the old copy
+ * stays intact until the header points elsewhere.
+ */
+void mcwutil::region::writer_test::test_relocate_skips_old_range() {
+	writer w(temporary_file());
+	w.write(0, payload(1, 0xA0), COMPRESSION_ZLIB, 1);
+	w.write(1, payload(2, 0xA1), COMPRESSION_ZLIB, 1);
+	w.write(2, payload(1, 0xA2), COMPRESSION_ZLIB, 1);
+	w.remove(1);
+
+	// Sectors 3 and 4 are free, and chunk 0 at sector 2 grows to three
+	// sectors: sectors 2 to 4 would do, but include the old copy.
+	w.write(0, payload(3, 0xB0), COMPRESSION_ZLIB, 2);
+	check_chunk(w, 0, 6, 3, 0xB0);
+	check_chunk(w, 2, 5, 1, 0xA2);
+	CPPUNIT_ASSERT_EQUAL(uint32_t{9}, w.file_sectors());
+
+	// Sectors 2 to 4 are all free now.
+	w.write(3, payload(3, 0xA3), COMPRESSION_ZLIB, 1);
+	check_chunk(w, 3, 2, 3, 0xA3);
+	CPPUNIT_ASSERT_EQUAL(uint32_t{9}, w.file_sectors());
+}
+
+/**
+ * \brief Tests that removing a chunk clears its header entry and frees its
+ * sectors.
+ */
+void mcwutil::region::writer_test::test_remove() {
+	writer w(temporary_file());
+	w.write(0, payload(2, 0xA0), COMPRESSION_ZLIB, 1);
+	w.write(1, payload(1, 0xA1), COMPRESSION_ZLIB, 1);
+	w.remove(0);
+	CPPUNIT_ASSERT_EQUAL(uint32_t{0}, w.sector_offset(0));
+	CPPUNIT_ASSERT_EQUAL(uint8_t{0}, w.sector_count(0));
+	uint8_t entry[8];
+	w.fd().pread(entry, 4, 0);
+	w.fd().pread(entry + 4, 4, 4096);
+	for(uint8_t i : entry) {
+		CPPUNIT_ASSERT_EQUAL(uint8_t{0}, i);
+	}
+	w.write(2, payload(2, 0xA2), COMPRESSION_ZLIB, 1);
+	check_chunk(w, 2, 2, 2, 0xA2);
+	CPPUNIT_ASSERT_EQUAL(uint32_t{5}, w.file_sectors());
+}
+
+/**
+ * \brief Tests that reserved chunks are laid out one after another, ready for
+ * their payloads to be written in any order.
+ */
+void mcwutil::region::writer_test::test_reserve() {
+	writer w(temporary_file());
+	std::vector<uint8_t> first = payload(2, 0xA7), second = payload(1, 0xA3);
+	off_t first_offset = w.reserve(7, first.size(), COMPRESSION_ZLIB, 1);
+	off_t second_offset = w.reserve(3, second.size(), COMPRESSION_ZLIB, 1);
+	CPPUNIT_ASSERT_EQUAL(off_t{2 * 4096 + 5}, first_offset);
+	CPPUNIT_ASSERT_EQUAL(off_t{4 * 4096 + 5}, second_offset);
+	CPPUNIT_ASSERT_EQUAL(uint32_t{5}, w.file_sectors());
+	w.fd().pwrite(second.data(), second.size(), second_offset);
+	w.fd().pwrite(first.data(), first.size(), first_offset);
+	check_chunk(w, 7, 2, 2, 0xA7);
+	check_chunk(w, 3, 4, 1, 0xA3);
+}
+
+/**
+ * \brief Tests that the free sectors of an existing file are found from its
+ * header.
+ */
+void mcwutil::region::writer_test::test_existing_file() {
+	file_descriptor fd = temporary_file();
+	{
+		writer w(temporary_file());
+		w.write(0, payload(1, 0xA0), COMPRESSION_ZLIB, 1);
+		w.write(1, payload(2, 0xA1), COMPRESSION_ZLIB, 1);
+		w.write(2, payload(1, 0xA2), COMPRESSION_ZLIB, 1);
+		w.remove(1);
+		std::vector<uint8_t> contents(static_cast<std::size_t>(file_size(w.fd())));
+		w.fd().pread(contents.data(), contents.size(), 0);
+		fd.pwrite(contents.data(), contents.size(), 0);
+	}
+
+	writer w(std::move(fd));
+	CPPUNIT_ASSERT_EQUAL(uint32_t{6}, w.file_sectors());
+	check_chunk(w, 0, 2, 1, 0xA0);
+	check_chunk(w, 2, 5, 1, 0xA2);
+	w.write(3, payload(2, 0xA3), COMPRESSION_ZLIB, 1);
+	check_chunk(w, 3, 3, 2, 0xA3);
+	CPPUNIT_ASSERT_EQUAL(uint32_t{6}, w.file_sectors());
+}
+
+/**
+ * \brief Tests that a replacement region can be committed over an empty file
+ * and over a file too short to be a region file.
+ */
+void mcwutil::region::writer_test::test_replace_empty_file() {
+	std::string name = (std::filesystem::temp_directory_path() / "mcwutil-test-XXXXXX").string();
+	if(!mkdtemp(name.data())) {
+		throw std::system_error(errno, std::system_category(), "mkdtemp");
+	}
+	const std::filesystem::path directory = name;
+	const std::filesystem::path filename = directory / "r.0.0.mca";
+	try {
+		for(off_t size : {off_t{0}, off_t{100}}) {
+			file_descriptor::create_open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666).ftruncate(size);
+			writer w = writer::replace(filename);
+			w.write(0, payload(1, 0xA0), COMPRESSION_ZLIB, 1);
+			w.commit();
+			CPPUNIT_ASSERT(!std::filesystem::exists(directory / "r.0.0.mca.tmp"));
+			reader r(filename);
+			CPPUNIT_ASSERT(r.present(0));
+			CPPUNIT_ASSERT(!r.present(1));
+		}
+	} catch(...) {
+		std::filesystem::remove_all(directory);
+		throw;
+	}
+	std::filesystem::remove_all(directory);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(mcwutil::region::writer_test);
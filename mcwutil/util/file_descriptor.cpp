@@ -1,4 +1,5 @@
 #include <mcwutil/util/file_descriptor.hpp>
+#include <array>
 #include <cerrno>
 #include <cstdlib>
 #include <fcntl.h>
@@ -127,6 +128,29 @@ void file_descriptor::read(void *buf, std::size_t count) const {
 	}
 }
 
+/**
+ * \brief Reads whatever data is available from the current file position,
+ * up to a limit.
+ *
+ * \pre this descriptor is open.
+ *
+ * \param[out] buf where to store the read bytes.
+ *
+ * \param[in] count the maximum number of bytes to read.
+ *
+ * \return the number of bytes read, which is zero only at end of file.
+ */
+std::size_t file_descriptor::read_some(void *buf, std::size_t count) const {
+	for(;;) {
+		ssize_t rc = ::read(fd_, buf, count);
+		if(rc >= 0) {
+			return static_cast<std::size_t>(rc);
+		} else if(errno != EINTR) {
+			throw std::system_error(errno, std::system_category(), "read");
+		}
+	}
+}
+
 /**
  * \brief Writes data to the current file position.
  *
@@ -201,6 +225,102 @@ void file_descriptor::pwrite(const void *buf, std::size_t count, off_t offset) c
 	}
 }
 
+namespace {
+/**
+ * \brief Copies data between files within the kernel, using \c
+ * copy_file_range(2).
+ *
+ * \param[in] in the file to read from.
+ *
+ * \param[in, out] in_offset the position in \p in at which to begin reading,
+ * which is advanced past the copied data, or null to use and advance the file
+ * position.
+ *
+ * \param[in] out the file to write to.
+ *
+ * \param[in, out] out_offset the position in \p out at which to begin
+ * writing, which is advanced past the copied data.
+ *
+ * \param[in] count the number of bytes to copy.
+ *
+ * \return the number of bytes copied, which is less than \p count only if the
+ * kernel cannot copy between these two files.
+ */
+std::size_t kernel_copy(int in, off_t *in_offset, int out, off_t *out_offset, std::size_t count) {
+	std::size_t copied = 0;
+	while(copied != count) {
+		ssize_t rc = ::copy_file_range(in, in_offset, out, out_offset, count - copied, 0);
+		if(rc < 0) {
+			if(errno == EINTR) {
+				continue;
+			} else if(errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP) {
+				break;
+			} else {
+				throw std::system_error(errno, std::system_category(), "copy_file_range");
+			}
+		} else if(!rc) {
+			throw std::runtime_error("copy_file_range: unexpected EOF");
+		}
+		copied += static_cast<std::size_t>(rc);
+	}
+	return copied;
+}
+}
+
+/**
+ * \brief Copies data from the current position to an arbitrary position in
+ * another file.
+ *
+ * The data is copied within the kernel where possible, which lets
+ * filesystems that support it share extents rather than duplicating them.
+ * Otherwise it passes through a fixed-size buffer, so arbitrarily large
+ * amounts may be copied.
+ *
+ * \pre this descriptor and \p dest are open.
+ *
+ * \param[in] dest the file to write to.
+ *
+ * \param[in] offset the position in \p dest at which to begin writing.
+ *
+ * \param[in] count the number of bytes to copy.
+ */
+void file_descriptor::copy_to(const file_descriptor &dest, off_t offset, std::size_t count) const {
+	std::size_t copied = kernel_copy(fd_, nullptr, dest.fd_, &offset, count);
+	count -= copied;
+	std::array<uint8_t, 65536> buffer;
+	while(count) {
+		std::size_t n = std::min(count, buffer.size());
+		read(buffer.data(), n);
+		dest.pwrite(buffer.data(), n, offset);
+		count -= n;
+		offset += static_cast<off_t>(n);
+	}
+}
+
+/**
+ * \brief Copies data between arbitrary positions in two files, within the
+ * kernel.
+ *
+ * Neither file’s position is used or changed.
+ *
+ * \pre this descriptor and \p dest are open.
+ *
+ * \param[in] offset the position in this file at which to begin reading.
+ *
+ * \param[in] dest the file to write to.
+ *
+ * \param[in] dest_offset the position in \p dest at which to begin writing.
+ *
+ * \param[in] count the number of bytes to copy.
+ *
+ * \return the number of bytes copied; if this is less than \p count, the
+ * kernel cannot copy between these two files and the caller must copy the
+ * rest itself.
+ */
+std::size_t file_descriptor::copy_range(off_t offset, const file_descriptor &dest, off_t dest_offset, std::size_t count) const {
+	return kernel_copy(fd_, &offset, dest.fd_, &dest_offset, count);
+}
+
 /**
  * \brief Obtains file metadata.
  *
@@ -227,6 +347,36 @@ void file_descriptor::ftruncate(off_t length) const {
 	}
 }
 
+/**
+ * \brief Waits until the file’s data has reached stable storage.
+ *
+ * \pre this descriptor is open.
+ */
+void file_descriptor::fdatasync() const {
+	if(::fdatasync(fd_) < 0) {
+		throw std::system_error(errno, std::system_category(), "fdatasync");
+	}
+}
+
+/**
+ * \brief Allocates disk space for part of the file, extending it if needed.
+ *
+ * Allocating a file’s space up front lets the filesystem place it
+ * contiguously. This is only a hint, so filesystems that cannot preallocate
+ * are silently left alone.
+ *
+ * \pre this descriptor is open.
+ *
+ * \param[in] offset the position of the first byte to allocate.
+ *
+ * \param[in] length the number of bytes to allocate.
+ */
+void file_descriptor::preallocate(off_t offset, off_t length) const {
+	if(::fallocate(fd_, 0, offset, length) < 0 && errno != EOPNOTSUPP && errno != ENOSYS) {
+		throw std::system_error(errno, std::system_category(), "fallocate");
+	}
+}
+
 /**
  * \brief Constructs a new file_descriptor by calling \c open(2).
  *
@@ -25,11 +25,16 @@ class file_descriptor {
 	int fd() const;
 	void close();
 	void read(void *buf, std::size_t count) const;
+	std::size_t read_some(void *buf, std::size_t count) const;
 	void write(const void *buf, std::size_t count) const;
 	void pread(void *buf, std::size_t count, off_t offset) const;
 	void pwrite(const void *buf, std::size_t count, off_t offset) const;
+	void copy_to(const file_descriptor &dest, off_t offset, std::size_t count) const;
+	std::size_t copy_range(off_t offset, const file_descriptor &dest, off_t dest_offset, std::size_t count) const;
 	void fstat(struct stat &stbuf) const;
 	void ftruncate(off_t length) const;
+	void fdatasync() const;
+	void preallocate(off_t offset, off_t length) const;
 
 	private:
 	/**
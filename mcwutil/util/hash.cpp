@@ -0,0 +1,91 @@
+#include <mcwutil/util/hash.hpp>
+#include <bit>
+#include <cstddef>
+
+namespace mcwutil::hash {
+namespace {
+constexpr std::uint32_t XXH_PRIME1 = 2654435761U;
+constexpr std::uint32_t XXH_PRIME2 = 2246822519U;
+constexpr std::uint32_t XXH_PRIME3 = 3266489917U;
+constexpr std::uint32_t XXH_PRIME4 = 668265263U;
+constexpr std::uint32_t XXH_PRIME5 = 374761393U;
+
+/**
+ * \brief Extracts a little-endian 32-bit integer from a data buffer.
+ *
+ * \param[in] buffer the data to extract from.
+ *
+ * \return the integer.
+ */
+std::uint32_t read_le32(const std::uint8_t *buffer) {
+	return static_cast<std::uint32_t>(buffer[0]) | static_cast<std::uint32_t>(buffer[1]) << 8 | static_cast<std::uint32_t>(buffer[2]) << 16 | static_cast<std::uint32_t>(buffer[3]) << 24;
+}
+
+/**
+ * \brief Mixes one 32-bit lane of input into an XXH32 accumulator.
+ *
+ * \param[in] acc the accumulator.
+ *
+ * \param[in] input the input lane.
+ *
+ * \return the new accumulator value.
+ */
+std::uint32_t xxh32_round(std::uint32_t acc, std::uint32_t input) {
+	acc += input * XXH_PRIME2;
+	acc = std::rotl(acc, 13);
+	acc *= XXH_PRIME1;
+	return acc;
+}
+}
+}
+
+/**
+ * \brief Computes the XXH32 hash of a byte string.
+ *
+ * \param[in] data the data to hash.
+ *
+ * \param[in] seed the seed value.
+ *
+ * \return the hash.
+ */
+std::uint32_t mcwutil::hash::xxh32(std::span<const std::uint8_t> data, std::uint32_t seed) {
+	const std::uint8_t *ptr = data.data();
+	std::size_t left = data.size();
+	std::uint32_t h;
+	if(left >= 16) {
+		std::uint32_t v1 = seed + XXH_PRIME1 + XXH_PRIME2;
+		std::uint32_t v2 = seed + XXH_PRIME2;
+		std::uint32_t v3 = seed;
+		std::uint32_t v4 = seed - XXH_PRIME1;
+		while(left >= 16) {
+			v1 = xxh32_round(v1, read_le32(ptr));
+			v2 = xxh32_round(v2, read_le32(ptr + 4));
+			v3 = xxh32_round(v3, read_le32(ptr + 8));
+			v4 = xxh32_round(v4, read_le32(ptr + 12));
+			ptr += 16;
+			left -= 16;
+		}
+		h = std::rotl(v1, 1) + std::rotl(v2, 7) + std::rotl(v3, 12) + std::rotl(v4, 18);
+	} else {
+		h = seed + XXH_PRIME5;
+	}
+	h += static_cast<std::uint32_t>(data.size());
+	while(left >= 4) {
+		h += read_le32(ptr) * XXH_PRIME3;
+		h = std::rotl(h, 17) * XXH_PRIME4;
+		ptr += 4;
+		left -= 4;
+	}
+	while(left) {
+		h += *ptr * XXH_PRIME5;
+		h = std::rotl(h, 11) * XXH_PRIME1;
+		++ptr;
+		--left;
+	}
+	h ^= h >> 15;
+	h *= XXH_PRIME2;
+	h ^= h >> 13;
+	h *= XXH_PRIME3;
+	h ^= h >> 16;
+	return h;
+}
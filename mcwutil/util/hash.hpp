@@ -0,0 +1,16 @@
+#ifndef UTIL_HASH_H
+#define UTIL_HASH_H
+
+#include <cstdint>
+#include <span>
+
+namespace mcwutil {
+/**
+ * \brief Symbols related to non-cryptographic hashing of byte strings.
+ */
+namespace hash {
+std::uint32_t xxh32(std::span<const std::uint8_t> data, std::uint32_t seed);
+}
+}
+
+#endif
@@ -0,0 +1,64 @@
+#include <mcwutil/util/hash.hpp>
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cstdint>
+#include <numeric>
+#include <string_view>
+#include <vector>
+
+using namespace std::literals::string_view_literals;
+
+namespace mcwutil::hash {
+namespace {
+/**
+ * \brief Verifies that XXH32 hashing works properly.
+ */
+class xxh32_test final : public CppUnit::TestFixture {
+	public:
+	CPPUNIT_TEST_SUITE(xxh32_test);
+	CPPUNIT_TEST(test_short);
+	CPPUNIT_TEST(test_long);
+	CPPUNIT_TEST_SUITE_END();
+
+	private:
+	void test_short();
+	void test_long();
+};
+
+/**
+ * \brief Hashes a string.
+ *
+ * \param[in] s the string to hash.
+ *
+ * \param[in] seed the seed value.
+ *
+ * \return the hash.
+ */
+std::uint32_t xxh32_string(std::string_view s, std::uint32_t seed) {
+	return xxh32(std::span(reinterpret_cast<const std::uint8_t *>(s.data()), s.size()), seed);
+}
+}
+}
+
+/**
+ * \brief Tests hashing inputs shorter than one 16-byte stripe.
+ */
+void mcwutil::hash::xxh32_test::test_short() {
+	CPPUNIT_ASSERT_EQUAL(std::uint32_t{0x02CC5D05}, xxh32_string(""sv, 0));
+	CPPUNIT_ASSERT_EQUAL(std::uint32_t{0x550D7456}, xxh32_string("a"sv, 0));
+	CPPUNIT_ASSERT_EQUAL(std::uint32_t{0x32D153FF}, xxh32_string("abc"sv, 0));
+	CPPUNIT_ASSERT_EQUAL(std::uint32_t{0x4D4CB222}, xxh32_string("abc"sv, 0x9747B28C));
+}
+
+/**
+ * \brief Tests hashing inputs of at least one 16-byte stripe.
+ */
+void mcwutil::hash::xxh32_test::test_long() {
+	CPPUNIT_ASSERT_EQUAL(std::uint32_t{0xE2293B2F}, xxh32_string("Nobody inspects the spammish repetition"sv, 0));
+	std::vector<std::uint8_t> counting(100);
+	std::iota(counting.begin(), counting.end(), 0);
+	CPPUNIT_ASSERT_EQUAL(std::uint32_t{0x6BCB75C0}, xxh32(counting, 0x9747B28C));
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(mcwutil::hash::xxh32_test);
@@ -0,0 +1,337 @@
+#include <mcwutil/util/file_descriptor.hpp>
+#include <mcwutil/util/io_batch.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sched.h>
+#include <system_error>
+#include <unistd.h>
+
+using mcwutil::io_batch;
+
+namespace mcwutil {
+namespace {
+/**
+ * \brief The largest transfer submitted as a single operation.
+ *
+ * The length field of a submission is 32 bits wide; anything left over is
+ * completed synchronously like any other short transfer.
+ */
+constexpr std::size_t MAX_TRANSFER = 1U << 30;
+
+/**
+ * \brief Returns a pointer to a field within a mapped ring.
+ *
+ * \param[in] ring the base of the ring.
+ *
+ * \param[in] offset the offset of the field, as reported by the kernel.
+ *
+ * \return the field.
+ */
+unsigned int *ring_field(void *ring, std::uint32_t offset) {
+	return reinterpret_cast<unsigned int *>(static_cast<std::uint8_t *>(ring) + offset);
+}
+
+/**
+ * \brief Writes the unfinished part of a queued write synchronously.
+ *
+ * Any failure is recorded rather than thrown, so that the rest of the batch
+ * can still finish.
+ *
+ * \param[in] fd the file to write to.
+ *
+ * \param[in] buf the data to write.
+ *
+ * \param[in] count the number of bytes to write.
+ *
+ * \param[in] offset the position in the file at which to begin writing.
+ *
+ * \param[in, out] error the first failure in the batch, or null if there has
+ * been none yet.
+ */
+void write_sync(const file_descriptor &fd, const std::uint8_t *buf, std::size_t count, off_t offset, std::exception_ptr &error) {
+	try {
+		fd.pwrite(buf, count, offset);
+	} catch(...) {
+		if(!error) {
+			error = std::current_exception();
+		}
+	}
+}
+}
+}
+
+/**
+ * \brief Sets up a batch.
+ *
+ * If io_uring cannot be set up, for example because the kernel is too old or
+ * a sandbox forbids it, or if the kernel cannot probe for or does not support
+ * positioned writes, the batch falls back to immediate operations.
+ *
+ * \param[in] depth the number of operations to queue before submitting them
+ * automatically.
+ */
+io_batch::io_batch(unsigned int depth) :
+		ring_fd_(-1),
+		depth_(std::max(depth, 1U)),
+		sq_ring_(MAP_FAILED),
+		sq_ring_size_(0),
+		cq_ring_(MAP_FAILED),
+		cq_ring_size_(0),
+		sqes_(MAP_FAILED),
+		sqes_size_(0),
+		sq_tail_(nullptr),
+		sq_mask_(nullptr),
+		sq_array_(nullptr),
+		cq_head_(nullptr),
+		cq_tail_(nullptr),
+		cq_mask_(nullptr),
+		cqes_(nullptr) {
+	io_uring_params params;
+	std::memset(&params, 0, sizeof(params));
+	long fd = syscall(__NR_io_uring_setup, depth_, &params);
+	if(fd < 0) {
+		return;
+	}
+	ring_fd_ = static_cast<int>(fd);
+	depth_ = params.sq_entries;
+
+	// Map the rings and the submission queue entries.
+	sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if(single_mmap) {
+		sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+	}
+	sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+	if(sq_ring_ != MAP_FAILED) {
+		cq_ring_ = single_mmap ? sq_ring_ : mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+	}
+	if(cq_ring_ != MAP_FAILED) {
+		sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+		sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+	}
+	if(sqes_ == MAP_FAILED) {
+		unmap();
+		return;
+	}
+
+	sq_tail_ = ring_field(sq_ring_, params.sq_off.tail);
+	sq_mask_ = ring_field(sq_ring_, params.sq_off.ring_mask);
+	sq_array_ = ring_field(sq_ring_, params.sq_off.array);
+	cq_head_ = ring_field(cq_ring_, params.cq_off.head);
+	cq_tail_ = ring_field(cq_ring_, params.cq_off.tail);
+	cq_mask_ = ring_field(cq_ring_, params.cq_off.ring_mask);
+	cqes_ = static_cast<std::uint8_t *>(cq_ring_) + params.cq_off.cqes;
+	if(!probe()) {
+		unmap();
+		return;
+	}
+	pending_.reserve(depth_);
+}
+
+/**
+ * \brief Tears down the batch.
+ *
+ * Writes queued since the last call to \ref flush are discarded.
+ */
+io_batch::~io_batch() {
+	unmap();
+}
+
+/**
+ * \brief Queues a write.
+ *
+ * \param[in] fd the file to write to.
+ *
+ * \param[in] buf the data to write.
+ *
+ * \param[in] count the number of bytes to write.
+ *
+ * \param[in] offset the position in the file at which to begin writing.
+ */
+void io_batch::pwrite(const file_descriptor &fd, const void *buf, std::size_t count, off_t offset) {
+	if(batching()) {
+		queue({&fd, static_cast<const std::uint8_t *>(buf), count, offset});
+	} else {
+		fd.pwrite(buf, count, offset);
+	}
+}
+
+/**
+ * \brief Submits all queued writes and waits for them to finish.
+ *
+ * Writes the kernel completes only partially, or rejects as unsupported, are
+ * finished synchronously. If the kernel is temporarily out of resources,
+ * completions are reaped and submission is retried. If submission fails
+ * outright, the writes already submitted are waited for, the rest are
+ * performed synchronously, and the batch stops using io_uring.
+ *
+ * \exception std::system_error if any write failed; all writes have
+ * finished, successfully or otherwise, before this is thrown.
+ */
+void io_batch::flush() {
+	if(pending_.empty()) {
+		return;
+	}
+	// Fill in one submission queue entry per write.
+	unsigned int tail = *sq_tail_;
+	for(std::size_t i = 0; i != pending_.size(); ++i) {
+		const request &req = pending_[i];
+		unsigned int slot = tail & *sq_mask_;
+		io_uring_sqe &sqe = static_cast<io_uring_sqe *>(sqes_)[slot];
+		std::memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode = IORING_OP_WRITE;
+		sqe.fd = req.fd->fd();
+		sqe.addr = reinterpret_cast<std::uintptr_t>(req.buf);
+		sqe.len = static_cast<std::uint32_t>(std::min(req.count, MAX_TRANSFER));
+		sqe.off = static_cast<std::uint64_t>(req.offset);
+		sqe.user_data = i;
+		sq_array_[slot] = slot;
+		++tail;
+	}
+	std::atomic_ref<unsigned int>(*sq_tail_).store(tail, std::memory_order_release);
+
+	// Submit them and reap completions until all have finished. The kernel
+	// consumes submissions in order, so the last to_submit entries are
+	// exactly those it has not yet taken.
+	unsigned int to_submit = static_cast<unsigned int>(pending_.size());
+	std::size_t completed = 0;
+	std::exception_ptr error;
+	bool abandon = false;
+	while(completed != pending_.size()) {
+		std::size_t in_flight = pending_.size() - to_submit - completed;
+		long rc = syscall(__NR_io_uring_enter, ring_fd_, to_submit, 1U, IORING_ENTER_GETEVENTS, nullptr, 0);
+		if(rc >= 0) {
+			to_submit -= static_cast<unsigned int>(rc);
+			reap(completed, error);
+		} else if(errno == EINTR) {
+			// Just retry.
+		} else if((errno == EAGAIN || errno == EBUSY) && in_flight) {
+			// Make room by reaping what has finished, then retry.
+			std::size_t before = completed;
+			reap(completed, error);
+			if(completed == before) {
+				sched_yield();
+			}
+		} else {
+			if(!error && errno != EAGAIN && errno != EBUSY) {
+				error = std::make_exception_ptr(std::system_error(errno, std::system_category(), "io_uring_enter"));
+			}
+			abandon = true;
+			break;
+		}
+	}
+
+	if(abandon) {
+		// Wait for whatever the kernel has already taken, then write the rest
+		// synchronously and give up on the ring.
+		while(completed != pending_.size() - to_submit) {
+			std::size_t before = completed;
+			reap(completed, error);
+			if(completed == before) {
+				sched_yield();
+			}
+		}
+		for(std::size_t i = pending_.size() - to_submit; i != pending_.size(); ++i) {
+			const request &req = pending_[i];
+			write_sync(*req.fd, req.buf, req.count, req.offset, error);
+		}
+		unmap();
+	}
+
+	pending_.clear();
+	if(error) {
+		std::rethrow_exception(error);
+	}
+}
+
+/**
+ * \brief Asks the kernel whether it supports positioned writes through
+ * io_uring.
+ *
+ * Kernels from 5.1 to 5.5 set up a ring but reject \c IORING_OP_WRITE on
+ * every submission; they also lack the probe, so failing it is taken as a
+ * lack of support.
+ *
+ * \return \c true if writes can be submitted, or \c false if not.
+ */
+bool io_batch::probe() {
+	constexpr unsigned int OPS = 256;
+	std::vector<io_uring_probe_op> buffer(OPS + (sizeof(io_uring_probe) + sizeof(io_uring_probe_op) - 1) / sizeof(io_uring_probe_op));
+	io_uring_probe *p = reinterpret_cast<io_uring_probe *>(buffer.data());
+	if(syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PROBE, p, OPS) < 0) {
+		return false;
+	}
+	return p->ops_len > IORING_OP_WRITE && (p->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED);
+}
+
+/**
+ * \brief Reaps whatever completions are available without waiting.
+ *
+ * Writes the kernel completed only partially, or rejected as unsupported,
+ * are finished synchronously.
+ *
+ * \param[in, out] completed the number of writes in the batch that have
+ * finished, which is advanced by the number reaped.
+ *
+ * \param[in, out] error the first failure in the batch, or null if there has
+ * been none yet.
+ */
+void io_batch::reap(std::size_t &completed, std::exception_ptr &error) {
+	unsigned int head = *cq_head_;
+	unsigned int cq_tail = std::atomic_ref<unsigned int>(*cq_tail_).load(std::memory_order_acquire);
+	for(; head != cq_tail; ++head, ++completed) {
+		const io_uring_cqe &cqe = static_cast<const io_uring_cqe *>(cqes_)[head & *cq_mask_];
+		const request &req = pending_[cqe.user_data];
+		if(cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP) {
+			write_sync(*req.fd, req.buf, req.count, req.offset, error);
+		} else if(cqe.res < 0) {
+			if(!error) {
+				error = std::make_exception_ptr(std::system_error(-cqe.res, std::system_category(), "pwrite"));
+			}
+		} else if(static_cast<std::size_t>(cqe.res) < req.count) {
+			std::size_t done = static_cast<std::size_t>(cqe.res);
+			write_sync(*req.fd, req.buf + done, req.count - done, req.offset + static_cast<off_t>(done), error);
+		}
+	}
+	std::atomic_ref<unsigned int>(*cq_head_).store(head, std::memory_order_release);
+}
+
+/**
+ * \brief Queues a write, first submitting the batch if it is full.
+ *
+ * \param[in] req the write.
+ */
+void io_batch::queue(const request &req) {
+	if(pending_.size() == depth_) {
+		flush();
+	}
+	pending_.push_back(req);
+}
+
+/**
+ * \brief Releases the rings and closes the io_uring instance.
+ */
+void io_batch::unmap() {
+	if(sqes_ != MAP_FAILED) {
+		munmap(sqes_, sqes_size_);
+		sqes_ = MAP_FAILED;
+	}
+	if(cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+		munmap(cq_ring_, cq_ring_size_);
+	}
+	cq_ring_ = MAP_FAILED;
+	if(sq_ring_ != MAP_FAILED) {
+		munmap(sq_ring_, sq_ring_size_);
+		sq_ring_ = MAP_FAILED;
+	}
+	if(ring_fd_ >= 0) {
+		::close(ring_fd_);
+		ring_fd_ = -1;
+	}
+}
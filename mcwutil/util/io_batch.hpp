@@ -0,0 +1,169 @@
+#ifndef UTIL_IO_BATCH_H
+#define UTIL_IO_BATCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <sys/types.h>
+#include <vector>
+
+namespace mcwutil {
+class file_descriptor;
+
+/**
+ * \brief A batch of positioned writes, submitted together.
+ *
+ * Where the kernel supports io_uring, queued operations are submitted in a
+ * single system call and their completions reaped together, so that many
+ * small transfers cost a handful of system calls rather than one each. Where
+ * it does not, each operation is performed immediately through \ref
+ * file_descriptor. The kernel is asked which operations it supports before
+ * the ring is used, and any write it rejects as unsupported is performed
+ * synchronously instead.
+ *
+ * Queued operations may be performed in any order and at any time up to the
+ * next call to \ref flush, so the caller must keep every buffer and file
+ * descriptor alive, and must not queue overlapping operations, until then.
+ */
+class io_batch final {
+	public:
+	explicit io_batch(unsigned int depth = 64);
+	~io_batch();
+
+	// This class is not copyable.
+	explicit io_batch(const io_batch &) = delete;
+	void operator=(const io_batch &) = delete;
+
+	/**
+	 * \brief Returns whether operations are being batched.
+	 *
+	 * \return \c true if io_uring is in use, or \c false if operations are
+	 * performed immediately.
+	 */
+	bool batching() const {
+		return ring_fd_ >= 0;
+	}
+
+	void pwrite(const file_descriptor &fd, const void *buf, std::size_t count, off_t offset);
+	void flush();
+
+	private:
+	/**
+	 * \brief A queued write.
+	 */
+	struct request final {
+		/**
+		 * \brief The file to write to.
+		 */
+		const file_descriptor *fd;
+
+		/**
+		 * \brief The data to write.
+		 */
+		const std::uint8_t *buf;
+
+		/**
+		 * \brief The number of bytes to write.
+		 */
+		std::size_t count;
+
+		/**
+		 * \brief The position in the file at which to begin writing.
+		 */
+		off_t offset;
+	};
+
+	/**
+	 * \brief The io_uring instance, or −1 if io_uring is unavailable.
+	 */
+	int ring_fd_;
+
+	/**
+	 * \brief The number of submission queue entries.
+	 */
+	unsigned int depth_;
+
+	/**
+	 * \brief The mapped submission queue ring.
+	 */
+	void *sq_ring_;
+
+	/**
+	 * \brief The size of \ref sq_ring_.
+	 */
+	std::size_t sq_ring_size_;
+
+	/**
+	 * \brief The mapped completion queue ring, which may be the same mapping
+	 * as \ref sq_ring_.
+	 */
+	void *cq_ring_;
+
+	/**
+	 * \brief The size of \ref cq_ring_.
+	 */
+	std::size_t cq_ring_size_;
+
+	/**
+	 * \brief The mapped submission queue entries.
+	 */
+	void *sqes_;
+
+	/**
+	 * \brief The size of \ref sqes_.
+	 */
+	std::size_t sqes_size_;
+
+	/**
+	 * \brief The submission queue tail, advanced by this process as entries
+	 * are queued.
+	 */
+	unsigned int *sq_tail_;
+
+	/**
+	 * \brief The mask applied to submission queue positions to find ring
+	 * slots.
+	 */
+	unsigned int *sq_mask_;
+
+	/**
+	 * \brief The submission queue’s array of indices into \ref sqes_.
+	 */
+	unsigned int *sq_array_;
+
+	/**
+	 * \brief The completion queue head, advanced by this process as
+	 * completions are consumed.
+	 */
+	unsigned int *cq_head_;
+
+	/**
+	 * \brief The completion queue tail, advanced by the kernel as operations
+	 * complete.
+	 */
+	unsigned int *cq_tail_;
+
+	/**
+	 * \brief The mask applied to completion queue positions to find entries
+	 * in \ref cqes_.
+	 */
+	unsigned int *cq_mask_;
+
+	/**
+	 * \brief The completion queue entries.
+	 */
+	void *cqes_;
+
+	/**
+	 * \brief The operations queued since the last flush.
+	 */
+	std::vector<request> pending_;
+
+	void queue(const request &req);
+	bool probe();
+	void reap(std::size_t &completed, std::exception_ptr &error);
+	void unmap();
+};
+}
+
+#endif
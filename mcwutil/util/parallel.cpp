@@ -0,0 +1,104 @@
+#include <mcwutil/util/parallel.hpp>
+#include <mcwutil/util/string.hpp>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+/**
+ * \brief Parses the value of a <code>\-\-jobs</code> option.
+ *
+ * \param[in] value the option value, a number of threads, where zero means
+ * one per hardware thread.
+ *
+ * \return the number of threads to use, which is at least one, or nothing if
+ * \p value is not a number.
+ */
+std::optional<unsigned int> mcwutil::parallel::parse_jobs(std::string_view value) {
+	unsigned int jobs;
+	try {
+		jobs = string::fromdecui(value);
+	} catch(const std::system_error &) {
+		return std::nullopt;
+	}
+	if(!jobs) {
+		jobs = std::max(std::thread::hardware_concurrency(), 1U);
+	}
+	return jobs;
+}
+
+/**
+ * \brief Calls a function once for each integer in a range, on a pool of
+ * threads.
+ *
+ * Items are handed out in increasing order, but may finish in any order. If
+ * \p jobs is one, every item is run on the calling thread.
+ *
+ * \param[in] count the number of items; \p fn is called with each integer
+ * from zero to \p count − 1.
+ *
+ * \param[in] jobs the maximum number of threads to use.
+ *
+ * \param[in] fn the function to call, which must be safe to call from several
+ * threads at once.
+ *
+ * \exception any exception thrown by \p fn; once one has been thrown, no
+ * further items are started, and the first is rethrown after all running
+ * items have finished.
+ *
+ * \exception std::system_error if a thread cannot be started, in which case
+ * no further items are started and the threads already started are joined
+ * first.
+ */
+void mcwutil::parallel::for_each(std::size_t count, unsigned int jobs, const std::function<void(std::size_t)> &fn) {
+	std::size_t threads = std::min<std::size_t>(jobs, count);
+	if(threads <= 1) {
+		for(std::size_t i = 0; i != count; ++i) {
+			fn(i);
+		}
+		return;
+	}
+
+	std::atomic<std::size_t> next(0);
+	std::atomic<bool> failed(false);
+	std::exception_ptr error;
+	std::mutex error_mutex;
+	auto worker = [&]() {
+		for(std::size_t i = next++; i < count && !failed; i = next++) {
+			try {
+				fn(i);
+			} catch(...) {
+				std::lock_guard<std::mutex> lock(error_mutex);
+				if(!error) {
+					error = std::current_exception();
+				}
+				failed = true;
+			}
+		}
+	};
+	std::vector<std::thread> pool;
+	pool.reserve(threads - 1);
+	try {
+		for(std::size_t i = 1; i != threads; ++i) {
+			pool.emplace_back(worker);
+		}
+	} catch(...) {
+		// The threads already started must be joined before they are
+		// destroyed; stop them handing out further items first.
+		failed = true;
+		for(std::thread &i : pool) {
+			i.join();
+		}
+		throw;
+	}
+	worker();
+	for(std::thread &i : pool) {
+		i.join();
+	}
+	if(error) {
+		std::rethrow_exception(error);
+	}
+}
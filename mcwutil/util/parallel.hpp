@@ -0,0 +1,20 @@
+#ifndef UTIL_PARALLEL_H
+#define UTIL_PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <string_view>
+
+namespace mcwutil {
+/**
+ * \brief Symbols related to running independent work items on several
+ * threads.
+ */
+namespace parallel {
+std::optional<unsigned int> parse_jobs(std::string_view value);
+void for_each(std::size_t count, unsigned int jobs, const std::function<void(std::size_t)> &fn);
+}
+}
+
+#endif
@@ -0,0 +1,248 @@
+#include <mcwutil/calc.hpp>
+#include <mcwutil/region/compact.hpp>
+#include <mcwutil/region/external.hpp>
+#include <mcwutil/region/reader.hpp>
+#include <mcwutil/region/writer.hpp>
+#include <mcwutil/util/file_descriptor.hpp>
+#include <mcwutil/world/dimensions.hpp>
+#include <mcwutil/world/world.hpp>
+#include <algorithm>
+#include <fcntl.h>
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <vector>
+
+using namespace std::literals::string_view_literals;
+
+namespace mcwutil::world {
+namespace {
+/**
+ * \brief An inclusive rectangle of chunks.
+ */
+struct box final {
+	/**
+	 * \brief The smallest X coordinate of a chunk in the box.
+	 */
+	int x1;
+
+	/**
+	 * \brief The smallest Z coordinate of a chunk in the box.
+	 */
+	int z1;
+
+	/**
+	 * \brief The largest X coordinate of a chunk in the box.
+	 */
+	int x2;
+
+	/**
+	 * \brief The largest Z coordinate of a chunk in the box.
+	 */
+	int z2;
+
+	/**
+	 * \brief Checks whether a chunk is inside the box.
+	 *
+	 * \param[in] x the X coordinate of the chunk.
+	 *
+	 * \param[in] z the Z coordinate of the chunk.
+	 *
+	 * \return \c true if the chunk is inside, or \c false if not.
+	 */
+	bool contains(int x, int z) const {
+		return x1 <= x && x <= x2 && z1 <= z && z <= z2;
+	}
+};
+
+/**
+ * \brief The outcome of cropping a dimension.
+ */
+struct crop_result final {
+	/**
+	 * \brief The number of chunks removed, including those in deleted region
+	 * files.
+	 */
+	unsigned int chunks_removed = 0;
+
+	/**
+	 * \brief The number of region files deleted because no chunks were left
+	 * in them.
+	 */
+	unsigned int regions_deleted = 0;
+
+	/**
+	 * \brief The number of bytes by which compaction shrank the remaining
+	 * region files.
+	 */
+	off_t bytes_reclaimed = 0;
+};
+
+/**
+ * \brief Deletes a region file along with any external chunk files it uses.
+ *
+ * \param[in] filename the region file.
+ *
+ * \return the number of chunks the region held.
+ */
+unsigned int delete_region(const std::filesystem::path &filename) {
+	unsigned int chunks;
+	{
+		region::reader region(filename);
+		chunks = static_cast<unsigned int>(region.offset_order().size());
+		for(unsigned int i : region.offset_order()) {
+			if(region.external(i)) {
+				std::filesystem::remove(region::external_filename(filename, i));
+			}
+		}
+	}
+	std::filesystem::remove(filename);
+	return chunks;
+}
+
+/**
+ * \brief Crops one region file.
+ *
+ * \param[in] rf the region file.
+ *
+ * \param[in] bounds the chunks to keep.
+ *
+ * \param[in] compact whether to compact the file if any chunks are removed.
+ *
+ * \param[in, out] result the tally to add to.
+ */
+void crop_region(const region_file &rf, const box &bounds, bool compact, crop_result &result) {
+	// A region entirely inside the box is left alone, and one entirely
+	// outside it is deleted without looking at its chunks.
+	int first_x = rf.x * 32, first_z = rf.z * 32;
+	if(bounds.contains(first_x, first_z) && bounds.contains(first_x + 31, first_z + 31)) {
+		return;
+	}
+	if(first_x + 31 < bounds.x1 || bounds.x2 < first_x || first_z + 31 < bounds.z1 || bounds.z2 < first_z) {
+		result.chunks_removed += delete_region(rf.path);
+		++result.regions_deleted;
+		return;
+	}
+
+	// Otherwise, zero the header entries of the chunks outside the box.
+	unsigned int removed = 0, remaining = 0;
+	{
+		region::writer region(file_descriptor::create_open(rf.path, O_RDWR, 0), rf.path);
+		for(unsigned int i = 0; i < 1024; ++i) {
+			if(region.sector_offset(i) || region.sector_count(i)) {
+				int x = rf.x * 32 + static_cast<int>(i % 32);
+				int z = rf.z * 32 + static_cast<int>(i / 32);
+				if(bounds.contains(x, z)) {
+					++remaining;
+				} else {
+					region.remove(i);
+					++removed;
+				}
+			}
+		}
+		region.close();
+	}
+	result.chunks_removed += removed;
+
+	// Delete the region if nothing is left in it, or compact it if asked.
+	if(!remaining) {
+		std::filesystem::remove(rf.path);
+		++result.regions_deleted;
+	} else if(removed && compact) {
+		result.bytes_reclaimed += region::compact_file(rf.path);
+	}
+}
+
+/**
+ * \brief Displays the usage help text.
+ *
+ * \param[in] appname The name of the application.
+ */
+void usage(std::string_view appname) {
+	std::cerr << "Usage:\n";
+	std::cerr << appname << " world-crop [--dimension dimension] [--blocks] [--compact] worlddir X1,Z1:X2,Z2\n";
+	std::cerr << '\n';
+	std::cerr << "Removes every chunk outside a rectangle from a world, in place. Only region headers are rewritten;\n";
+	std::cerr << "region files left with no chunks are deleted. The world must not be in use by a running server.\n";
+	std::cerr << '\n';
+	std::cerr << "Arguments:\n";
+	std::cerr << "  --dimension - the dimension directory relative to worlddir (e.g. DIM-1), or . for the overworld (default)\n";
+	std::cerr << "  --blocks - the corners are block coordinates; every chunk containing part of the rectangle is kept\n";
+	std::cerr << "  --compact - compact the region files that lost chunks, as region-compact\n";
+	std::cerr << "  worlddir - the world directory to crop\n";
+	std::cerr << "  X1,Z1:X2,Z2 - opposite corners of the rectangle of chunks to keep, inclusive\n";
+}
+}
+}
+
+/**
+ * \brief Entry point for the \c world-crop utility.
+ *
+ * \param[in] appname The name of the application.
+ *
+ * \param[in] args the command-line arguments.
+ *
+ * \return the application exit code.
+ */
+int mcwutil::world::crop(std::string_view appname, std::span<char *> args) {
+	// Check parameters.
+	std::string dimension_name(".");
+	int scale = 1;
+	bool compact = false;
+	for(;;) {
+		if(args.size() >= 2 && args[0] == "--dimension"sv) {
+			dimension_name = args[1];
+			args = args.subspan(2);
+		} else if(!args.empty() && args[0] == "--blocks"sv) {
+			scale = 16;
+			args = args.subspan(1);
+		} else if(!args.empty() && args[0] == "--compact"sv) {
+			compact = true;
+			args = args.subspan(1);
+		} else {
+			break;
+		}
+	}
+	if(args.size() != 2) {
+		usage(appname);
+		return 1;
+	}
+	std::string_view spec(args[1]);
+	std::size_t colon = spec.find(':');
+	std::optional<region::coordinates> first = region::parse_coordinates(spec.substr(0, colon));
+	std::optional<region::coordinates> last = colon == std::string_view::npos ? std::nullopt : region::parse_coordinates(spec.substr(colon + 1));
+	if(!first || !last) {
+		usage(appname);
+		return 1;
+	}
+	box bounds{
+		calc::divfloor(std::min(first->x, last->x), scale),
+		calc::divfloor(std::min(first->z, last->z), scale),
+		calc::divfloor(std::max(first->x, last->x), scale),
+		calc::divfloor(std::max(first->z, last->z), scale),
+	};
+
+	// Find the dimension.
+	std::vector<dimension> dimensions = find_dimensions(args[0]);
+	auto dim = std::find_if(dimensions.begin(), dimensions.end(), [&dimension_name](const dimension &d) { return d.name == dimension_name; });
+	if(dim == dimensions.end()) {
+		std::cerr << "No region files found in dimension " << dimension_name << ".\n";
+		return 1;
+	}
+
+	// Crop each region.
+	crop_result result;
+	for(const region_file &rf : dim->regions) {
+		crop_region(rf, bounds, compact, result);
+	}
+	std::cout << result.chunks_removed << " chunk(s) removed, " << result.regions_deleted << " region file(s) deleted";
+	if(compact) {
+		std::cout << ", " << result.bytes_reclaimed << " bytes reclaimed by compaction";
+	}
+	std::cout << ".\n";
+
+	return 0;
+}
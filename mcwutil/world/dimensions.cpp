@@ -0,0 +1,74 @@
+#include <mcwutil/region/external.hpp>
+#include <mcwutil/world/dimensions.hpp>
+#include <algorithm>
+#include <string_view>
+#include <utility>
+
+using namespace std::literals::string_view_literals;
+
+namespace mcwutil::world {
+namespace {
+/**
+ * \brief Adds a dimension to a list, if its region directory exists.
+ *
+ * \param[in, out] dims the list to add to.
+ *
+ * \param[in] name the name of the dimension.
+ *
+ * \param[in] region_directory the directory holding the region files.
+ */
+void add_dimension(std::vector<dimension> &dims, std::string name, const std::filesystem::path &region_directory) {
+	if(!std::filesystem::is_directory(region_directory)) {
+		return;
+	}
+	dimension dim{std::move(name), region_directory, {}};
+	for(const std::filesystem::directory_entry &i : std::filesystem::directory_iterator(region_directory)) {
+		if(i.is_regular_file()) {
+			if(std::optional<region::coordinates> coords = region::parse_region_filename(i.path())) {
+				dim.regions.push_back({i.path(), coords->x, coords->z});
+			}
+		}
+	}
+	std::sort(dim.regions.begin(), dim.regions.end(), [](const region_file &x, const region_file &y) {
+		return x.x != y.x ? x.x < y.x : x.z < y.z;
+	});
+	dims.push_back(std::move(dim));
+}
+}
+}
+
+/**
+ * \brief Finds all the dimensions in a world and the region files in each.
+ *
+ * The overworld is in <code>region</code>. Old-style dimensions are in
+ * <code>DIM*</code><code>/region</code>, and namespaced dimensions are in
+ * <code>dimensions/</code><em>namespace</em><code>/</code><em>name</em><code>/region</code>.
+ *
+ * \param[in] world_directory the world directory.
+ *
+ * \return the dimensions, sorted by name.
+ */
+std::vector<mcwutil::world::dimension> mcwutil::world::find_dimensions(const std::filesystem::path &world_directory) {
+	std::vector<dimension> dims;
+	add_dimension(dims, ".", world_directory / "region");
+	for(const std::filesystem::directory_entry &i : std::filesystem::directory_iterator(world_directory)) {
+		std::string name = i.path().filename().string();
+		if(i.is_directory() && name.starts_with("DIM"sv)) {
+			add_dimension(dims, name, i.path() / "region");
+		}
+	}
+	std::filesystem::path namespaced = world_directory / "dimensions";
+	if(std::filesystem::is_directory(namespaced)) {
+		for(const std::filesystem::directory_entry &ns : std::filesystem::directory_iterator(namespaced)) {
+			if(ns.is_directory()) {
+				for(const std::filesystem::directory_entry &i : std::filesystem::directory_iterator(ns.path())) {
+					if(i.is_directory()) {
+						add_dimension(dims, (std::filesystem::path("dimensions") / ns.path().filename() / i.path().filename()).string(), i.path() / "region");
+					}
+				}
+			}
+		}
+	}
+	std::sort(dims.begin(), dims.end(), [](const dimension &x, const dimension &y) { return x.name < y.name; });
+	return dims;
+}
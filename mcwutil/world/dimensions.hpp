@@ -0,0 +1,53 @@
+#ifndef WORLD_DIMENSIONS_H
+#define WORLD_DIMENSIONS_H
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace mcwutil::world {
+/**
+ * \brief A region file found in a world.
+ */
+struct region_file final {
+	/**
+	 * \brief The path to the file.
+	 */
+	std::filesystem::path path;
+
+	/**
+	 * \brief The X coordinate of the region.
+	 */
+	int x;
+
+	/**
+	 * \brief The Z coordinate of the region.
+	 */
+	int z;
+};
+
+/**
+ * \brief A dimension found in a world.
+ */
+struct dimension final {
+	/**
+	 * \brief The name of the dimension, which is the path of its directory
+	 * relative to the world directory, or “.” for the overworld.
+	 */
+	std::string name;
+
+	/**
+	 * \brief The path to the directory holding the dimension’s region files.
+	 */
+	std::filesystem::path region_directory;
+
+	/**
+	 * \brief The region files in the dimension, sorted by X then Z.
+	 */
+	std::vector<region_file> regions;
+};
+
+std::vector<dimension> find_dimensions(const std::filesystem::path &world_directory);
+}
+
+#endif
@@ -0,0 +1,477 @@
+#include <mcwutil/util/codec.hpp>
+#include <mcwutil/util/file_descriptor.hpp>
+#include <mcwutil/util/mapped_file.hpp>
+#include <mcwutil/util/string.hpp>
+#include <mcwutil/world/dimensions.hpp>
+#include <mcwutil/world/world.hpp>
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <system_error>
+#include <tuple>
+#include <vector>
+
+using namespace std::literals::string_view_literals;
+
+namespace mcwutil::world {
+namespace {
+/**
+ * \brief The magic number at the start of an index file.
+ */
+constexpr std::string_view MAGIC = "MCWUWIDX"sv;
+
+/**
+ * \brief The size of the index file header.
+ *
+ * The header is the magic number, the number of dimensions, and the number of
+ * records, each count being four bytes.
+ */
+constexpr std::size_t HEADER_SIZE = 16;
+
+/**
+ * \brief The size of one record.
+ *
+ * A record is a two-byte dimension number, a four-byte chunk X coordinate, a
+ * four-byte chunk Z coordinate, a four-byte timestamp, a three-byte sector
+ * offset, and a one-byte sector count, all big-endian. Records are sorted by
+ * dimension, then X, then Z, and follow the header directly so that the
+ * record array can be binary-searched in place. The dimension names follow
+ * the records, each as a two-byte length and the UTF-8 bytes.
+ */
+constexpr std::size_t RECORD_SIZE = 18;
+
+/**
+ * \brief One chunk’s entry in the index.
+ */
+struct record final {
+	/**
+	 * \brief The position of the chunk’s dimension in the index file’s list
+	 * of dimension names.
+	 */
+	unsigned int dimension;
+
+	/**
+	 * \brief The chunk X coordinate.
+	 */
+	int x;
+
+	/**
+	 * \brief The chunk Z coordinate.
+	 */
+	int z;
+
+	/**
+	 * \brief The chunk’s timestamp from the region header.
+	 */
+	uint32_t timestamp;
+
+	/**
+	 * \brief The offset of the chunk within its region file, in sectors.
+	 */
+	uint32_t sector_offset;
+
+	/**
+	 * \brief The number of sectors the chunk occupies.
+	 */
+	uint8_t sector_count;
+
+	/**
+	 * \brief Returns the sort key of the record.
+	 */
+	std::tuple<unsigned int, int, int> key() const {
+		return {dimension, x, z};
+	}
+
+	/**
+	 * \brief Encodes the record.
+	 *
+	 * \param[out] buf the buffer to encode into, which must be \ref
+	 * RECORD_SIZE bytes long.
+	 */
+	void encode(uint8_t *buf) const {
+		codec::encode_integer(&buf[0], static_cast<uint16_t>(dimension));
+		codec::encode_integer(&buf[2], static_cast<uint32_t>(x));
+		codec::encode_integer(&buf[6], static_cast<uint32_t>(z));
+		codec::encode_integer(&buf[10], timestamp);
+		codec::encode_integer<uint32_t, 3>(&buf[14], sector_offset);
+		codec::encode_integer(&buf[17], sector_count);
+	}
+
+	/**
+	 * \brief Decodes a record.
+	 *
+	 * \param[in] buf the buffer to decode from, which must be \ref
+	 * RECORD_SIZE bytes long.
+	 *
+	 * \return the record.
+	 */
+	static record decode(const uint8_t *buf) {
+		return {
+			codec::decode_integer<uint16_t>(&buf[0]),
+			static_cast<int32_t>(codec::decode_integer<uint32_t>(&buf[2])),
+			static_cast<int32_t>(codec::decode_integer<uint32_t>(&buf[6])),
+			codec::decode_integer<uint32_t>(&buf[10]),
+			codec::decode_integer<uint32_t, 3>(&buf[14]),
+			codec::decode_integer<uint8_t>(&buf[17]),
+		};
+	}
+};
+
+/**
+ * \brief A read-only view of an index file.
+ */
+class index_file final {
+	public:
+	explicit index_file(const char *filename);
+
+	/**
+	 * \brief Returns the number of records.
+	 */
+	std::size_t size() const {
+		return count_;
+	}
+
+	/**
+	 * \brief Returns a record.
+	 *
+	 * \param[in] i the position of the record.
+	 */
+	record operator[](std::size_t i) const {
+		return record::decode(&records_[i * RECORD_SIZE]);
+	}
+
+	/**
+	 * \brief Returns the names of the dimensions.
+	 */
+	const std::vector<std::string> &dimensions() const {
+		return dimensions_;
+	}
+
+	std::size_t lower_bound(unsigned int dimension, int x, int z) const;
+
+	private:
+	/**
+	 * \brief The open index file.
+	 */
+	file_descriptor fd_;
+
+	/**
+	 * \brief The mapping of the whole index file.
+	 */
+	mapped_file mapping_;
+
+	/**
+	 * \brief The first encoded record, within \ref mapping_.
+	 */
+	const uint8_t *records_;
+
+	/**
+	 * \brief The number of records.
+	 */
+	std::size_t count_;
+
+	/**
+	 * \brief The names of the dimensions, indexed by dimension number.
+	 */
+	std::vector<std::string> dimensions_;
+};
+
+/**
+ * \brief Maps an index file and checks that it is well-formed.
+ *
+ * \param[in] filename the index file to open.
+ *
+ * \exception std::runtime_error if the file is malformed.
+ */
+index_file::index_file(const char *filename) :
+		fd_(file_descriptor::create_open(filename, O_RDONLY, 0)),
+		mapping_(fd_) {
+	std::span<const uint8_t> data(static_cast<const uint8_t *>(mapping_.data()), mapping_.size());
+	if(data.size() < HEADER_SIZE || std::memcmp(data.data(), MAGIC.data(), MAGIC.size())) {
+		throw std::runtime_error("Malformed index file: bad header.");
+	}
+	uint32_t dimension_count = codec::decode_integer<uint32_t>(&data[8]);
+	count_ = codec::decode_integer<uint32_t>(&data[12]);
+	if((data.size() - HEADER_SIZE) / RECORD_SIZE < count_) {
+		throw std::runtime_error("Malformed index file: records truncated.");
+	}
+	records_ = &data[HEADER_SIZE];
+	data = data.subspan(HEADER_SIZE + count_ * RECORD_SIZE);
+	for(uint32_t i = 0; i < dimension_count; ++i) {
+		if(data.size() < 2 || data.size() - 2 < codec::decode_integer<uint16_t>(&data[0])) {
+			throw std::runtime_error("Malformed index file: dimension names truncated.");
+		}
+		std::size_t length = codec::decode_integer<uint16_t>(&data[0]);
+		dimensions_.emplace_back(reinterpret_cast<const char *>(&data[2]), length);
+		data = data.subspan(2 + length);
+	}
+
+	// Records are sorted by dimension, so only the last can name a dimension
+	// that does not exist.
+	if(count_ && (*this)[count_ - 1].dimension >= dimensions_.size()) {
+		throw std::runtime_error("Malformed index file: record refers to nonexistent dimension.");
+	}
+}
+
+/**
+ * \brief Finds the first record not ordered before a given position.
+ *
+ * \param[in] dimension the dimension number.
+ *
+ * \param[in] x the chunk X coordinate.
+ *
+ * \param[in] z the chunk Z coordinate.
+ *
+ * \return the position of the first record whose key is at least the given
+ * one, or \ref size if there is none.
+ */
+std::size_t index_file::lower_bound(unsigned int dimension, int x, int z) const {
+	std::tuple<unsigned int, int, int> key(dimension, x, z);
+	std::size_t low = 0, high = count_;
+	while(low < high) {
+		std::size_t mid = low + (high - low) / 2;
+		if((*this)[mid].key() < key) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+/**
+ * \brief Reads the header of one region file and adds its chunks to a list of
+ * records.
+ *
+ * Only the 8 KiB header is read; the chunk data is not touched.
+ *
+ * \param[in] rf the region file.
+ *
+ * \param[in] dimension the dimension number.
+ *
+ * \param[in, out] records the list to add to.
+ *
+ * \exception std::runtime_error if the file is too short to hold a header.
+ */
+void index_region(const region_file &rf, unsigned int dimension, std::vector<record> &records) {
+	file_descriptor fd = file_descriptor::create_open(rf.path, O_RDONLY, 0);
+	struct stat stbuf;
+	fd.fstat(stbuf);
+	if(!stbuf.st_size) {
+		return;
+	}
+	std::array<uint8_t, 8192> header;
+	if(stbuf.st_size < static_cast<off_t>(header.size())) {
+		throw std::runtime_error("Malformed region file: header truncated.");
+	}
+	fd.pread(header.data(), header.size(), 0);
+	for(unsigned int i = 0; i < 1024; ++i) {
+		uint32_t offset = codec::decode_integer<uint32_t, 3>(&header[i * 4]);
+		uint8_t count = header[i * 4 + 3];
+		if(offset || count) {
+			records.push_back({
+				dimension,
+				rf.x * 32 + static_cast<int>(i % 32),
+				rf.z * 32 + static_cast<int>(i / 32),
+				codec::decode_integer<uint32_t>(&header[4096 + i * 4]),
+				offset,
+				count,
+			});
+		}
+	}
+}
+
+/**
+ * \brief Builds an index file.
+ *
+ * Region files that cannot be read are reported and left out of the index.
+ *
+ * \param[in] world_directory the world to index.
+ *
+ * \param[in] index_filename the index file to create or replace.
+ *
+ * \return \c true if every region file was indexed, or \c false if any could
+ * not be read.
+ */
+bool build(const std::filesystem::path &world_directory, const std::filesystem::path &index_filename) {
+	std::vector<dimension> dims = find_dimensions(world_directory);
+	if(dims.size() > 0xFFFF) {
+		throw std::runtime_error("Too many dimensions.");
+	}
+
+	// Collect the records.
+	std::vector<record> records;
+	std::size_t unreadable = 0;
+	for(std::size_t i = 0; i < dims.size(); ++i) {
+		for(const region_file &j : dims[i].regions) {
+			try {
+				index_region(j, static_cast<unsigned int>(i), records);
+			} catch(const std::exception &exp) {
+				std::cerr << j.path.string() + ": " + exp.what() + '\n';
+				++unreadable;
+			}
+		}
+	}
+	std::sort(records.begin(), records.end(), [](const record &x, const record &y) { return x.key() < y.key(); });
+	if(records.size() > 0xFFFFFFFF) {
+		throw std::runtime_error("Too many chunks.");
+	}
+
+	// Encode the file.
+	std::vector<uint8_t> buffer(HEADER_SIZE + records.size() * RECORD_SIZE);
+	std::copy(MAGIC.begin(), MAGIC.end(), buffer.begin());
+	codec::encode_integer(&buffer[8], static_cast<uint32_t>(dims.size()));
+	codec::encode_integer(&buffer[12], static_cast<uint32_t>(records.size()));
+	for(std::size_t i = 0; i < records.size(); ++i) {
+		records[i].encode(&buffer[HEADER_SIZE + i * RECORD_SIZE]);
+	}
+	for(const dimension &i : dims) {
+		if(i.name.size() > 0xFFFF) {
+			throw std::runtime_error("Dimension name too long.");
+		}
+		uint8_t length[2];
+		codec::encode_integer(length, static_cast<uint16_t>(i.name.size()));
+		buffer.insert(buffer.end(), length, length + 2);
+		buffer.insert(buffer.end(), i.name.begin(), i.name.end());
+	}
+
+	// Write it via a temporary file, so a reader never sees a partial index.
+	std::filesystem::path temp_filename(index_filename);
+	temp_filename += ".tmp";
+	file_descriptor fd = file_descriptor::create_open(temp_filename, O_WRONLY | O_TRUNC | O_CREAT, 0666);
+	fd.write(buffer.data(), buffer.size());
+	fd.close();
+	std::filesystem::rename(temp_filename, index_filename);
+
+	std::cout << records.size() << " chunks in " << dims.size() << " dimensions indexed";
+	if(unreadable) {
+		std::cout << ", " << unreadable << " unreadable region files skipped";
+	}
+	std::cout << '\n';
+	return !unreadable;
+}
+
+/**
+ * \brief Prints one record.
+ *
+ * \param[in] index the index file the record came from.
+ *
+ * \param[in] r the record.
+ */
+void print(const index_file &index, const record &r) {
+	std::cout << index.dimensions()[r.dimension] << ' ' << r.x << ' ' << r.z << ' ' << r.sector_offset << ' ' << static_cast<unsigned int>(r.sector_count) << ' ' << r.timestamp << '\n';
+}
+
+/**
+ * \brief Answers a lookup or range query.
+ *
+ * \param[in] index_filename the index file.
+ *
+ * \param[in] dimension_name the name of the dimension to search.
+ *
+ * \param[in] x1 the smallest chunk X coordinate to report.
+ *
+ * \param[in] z1 the smallest chunk Z coordinate to report.
+ *
+ * \param[in] x2 the largest chunk X coordinate to report.
+ *
+ * \param[in] z2 the largest chunk Z coordinate to report.
+ *
+ * \return \c true if any chunks were found, or \c false if not.
+ */
+bool query(const char *index_filename, std::string_view dimension_name, int x1, int z1, int x2, int z2) {
+	index_file index(index_filename);
+	const std::vector<std::string> &dims = index.dimensions();
+	auto dim = std::find(dims.begin(), dims.end(), dimension_name);
+	if(dim == dims.end()) {
+		return false;
+	}
+	unsigned int dimension = static_cast<unsigned int>(dim - dims.begin());
+
+	// Records are sorted by X then Z, so the X range is one contiguous run
+	// that starts at a single binary search; records in it outside the Z
+	// range are skipped.
+	bool found = false;
+	for(std::size_t i = index.lower_bound(dimension, x1, std::numeric_limits<int>::min()); i < index.size(); ++i) {
+		record r = index[i];
+		if(r.dimension != dimension || r.x > x2) {
+			break;
+		}
+		if(r.z >= z1 && r.z <= z2) {
+			print(index, r);
+			found = true;
+		}
+	}
+	return found;
+}
+
+/**
+ * \brief Displays the usage help text.
+ *
+ * \param[in] appname The name of the application.
+ */
+void usage(std::string_view appname) {
+	std::cerr << "Usage:\n";
+	std::cerr << appname << " world-index build worlddir indexfile\n";
+	std::cerr << appname << " world-index query indexfile dimension x z [x2 z2]\n";
+	std::cerr << '\n';
+	std::cerr << "Builds or queries an index of the chunks in every region file of a world.\n";
+	std::cerr << "Building reads only the header of each region file.\n";
+	std::cerr << '\n';
+	std::cerr << "Arguments:\n";
+	std::cerr << "  worlddir - the world directory to index\n";
+	std::cerr << "  indexfile - the index file to create or query\n";
+	std::cerr << "  dimension - the dimension directory relative to worlddir (e.g. DIM-1), or . for the overworld\n";
+	std::cerr << "  x, z - the chunk coordinates to look up, or one corner of the range to scan\n";
+	std::cerr << "  x2, z2 - the opposite corner of the range to scan, inclusive\n";
+	std::cerr << '\n';
+	std::cerr << "Each chunk found is printed as: dimension x z sectoroffset sectorcount timestamp\n";
+	std::cerr << "Region files that cannot be read are reported and skipped when building.\n";
+	std::cerr << "When building, the exit code is 0 if every region file was indexed, or 2 if any were skipped.\n";
+	std::cerr << "When querying, the exit code is 0 if any chunk was found, or 2 if none were.\n";
+}
+}
+}
+
+/**
+ * \brief Entry point for the \c world-index utility.
+ *
+ * \param[in] appname The name of the application.
+ *
+ * \param[in] args the command-line arguments.
+ *
+ * \return the application exit code.
+ */
+int mcwutil::world::index(std::string_view appname, std::span<char *> args) {
+	if(args.size() == 3 && args[0] == "build"sv) {
+		return build(args[1], args[2]) ? 0 : 2;
+	} else if((args.size() == 5 || args.size() == 7) && args[0] == "query"sv) {
+		int x1, z1, x2, z2;
+		try {
+			x1 = x2 = string::fromdecs32(args[3]);
+			z1 = z2 = string::fromdecs32(args[4]);
+			if(args.size() == 7) {
+				x2 = string::fromdecs32(args[5]);
+				z2 = string::fromdecs32(args[6]);
+			}
+		} catch(const std::system_error &) {
+			usage(appname);
+			return 1;
+		}
+		return query(args[1], args[2], std::min(x1, x2), std::min(z1, z2), std::max(x1, x2), std::max(z1, z2)) ? 0 : 2;
+	} else {
+		usage(appname);
+		return 1;
+	}
+}
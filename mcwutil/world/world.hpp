@@ -0,0 +1,18 @@
+#ifndef WORLD_WORLD_H
+#define WORLD_WORLD_H
+
+#include <span>
+#include <string_view>
+
+namespace mcwutil {
+/**
+ * \brief Symbols related to whole worlds, made up of many region files across
+ * one or more dimensions.
+ */
+namespace world {
+int crop(std::string_view appname, std::span<char *> args);
+int index(std::string_view appname, std::span<char *> args);
+}
+}
+
+#endif
@@ -1,11 +1,661 @@
+#include <mcwutil/util/codec.hpp>
 #include <mcwutil/util/file_descriptor.hpp>
+#include <mcwutil/util/parallel.hpp>
 #include <mcwutil/zlib_utils.hpp>
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <fcntl.h>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <new>
+#include <optional>
+#include <span>
 #include <stdexcept>
+#include <string_view>
+#include <utility>
 #include <vector>
 #include <zlib.h>
+#ifdef MCWUTIL_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
+using namespace std::literals::string_view_literals;
+
+namespace mcwutil::zlib {
+namespace {
+/**
+ * \brief The library used for whole-buffer operations.
+ */
+#ifdef MCWUTIL_LIBDEFLATE
+backend selected_backend = BACKEND_LIBDEFLATE;
+#else
+backend selected_backend = BACKEND_ZLIB;
+#endif
+
+#ifdef MCWUTIL_LIBDEFLATE
+/**
+ * \brief Frees a libdeflate compressor.
+ */
+struct compressor_deleter final {
+	void operator()(libdeflate_compressor *c) const {
+		libdeflate_free_compressor(c);
+	}
+};
+
+/**
+ * \brief Frees a libdeflate decompressor.
+ */
+struct decompressor_deleter final {
+	void operator()(libdeflate_decompressor *d) const {
+		libdeflate_free_decompressor(d);
+	}
+};
+
+/**
+ * \brief Compresses an in-memory buffer with libdeflate.
+ *
+ * A compressor is kept for each thread and level, as allocating one costs
+ * more than compressing a typical chunk.
+ *
+ * \param[in] input the data to compress.
+ *
+ * \param[in] level the compression level to use, from 0 to 12.
+ *
+ * \param[in] fmt the framing to wrap the compressed data in.
+ *
+ * \return the compressed data.
+ */
+std::vector<uint8_t> libdeflate_compress_buffer(std::span<const uint8_t> input, int level, format fmt) {
+	thread_local std::array<std::unique_ptr<libdeflate_compressor, compressor_deleter>, 13> compressors;
+	if(level < 0) {
+		level = 6;
+	}
+	if(level >= static_cast<int>(compressors.size())) {
+		throw std::logic_error("Internal error: compression level was invalid.");
+	}
+	std::unique_ptr<libdeflate_compressor, compressor_deleter> &compressor = compressors[static_cast<std::size_t>(level)];
+	if(!compressor) {
+		compressor.reset(libdeflate_alloc_compressor(level));
+		if(!compressor) {
+			throw std::bad_alloc();
+		}
+	}
+	std::vector<uint8_t> output;
+	if(fmt == FORMAT_GZIP) {
+		output.resize(libdeflate_gzip_compress_bound(compressor.get(), input.size()));
+		output.resize(libdeflate_gzip_compress(compressor.get(), input.data(), input.size(), output.data(), output.size()));
+	} else {
+		output.resize(libdeflate_zlib_compress_bound(compressor.get(), input.size()));
+		output.resize(libdeflate_zlib_compress(compressor.get(), input.data(), input.size(), output.data(), output.size()));
+	}
+	if(output.empty()) {
+		throw std::logic_error("Internal error: supposedly-sufficient compression buffer was insufficient.");
+	}
+	return output;
+}
+
+/**
+ * \brief The most that deflate can expand its input by.
+ */
+constexpr std::size_t MAX_DEFLATE_RATIO = 1032;
+
+/**
+ * \brief The weight given to each zlib stream’s expansion ratio in the
+ * running average used to guess the output size of the next.
+ */
+constexpr double RATIO_WEIGHT = 0.25;
+
+/**
+ * \brief The factor by which the guessed output size of a zlib stream exceeds
+ * what the running average predicts.
+ */
+constexpr double RATIO_HEADROOM = 1.25;
+
+/**
+ * \brief Decompresses an in-memory zlib or gzip stream with libdeflate.
+ *
+ * libdeflate needs the whole output buffer up front. A gzip stream records
+ * its uncompressed size, which is used as the first guess. A zlib stream does
+ * not, so a running average of how much recent zlib streams on this thread
+ * expanded by is used instead, with some headroom. Unlike the largest output
+ * seen so far, this follows the sizes of recent chunks, so one large chunk
+ * does not make every later small one allocate and clear a huge buffer.
+ * Either guess is capped at the most that deflate can expand the input to, so
+ * that a corrupt trailer cannot force a huge allocation. If the guess is too
+ * small, the buffer is doubled until the data fits.
+ *
+ * \param[in] input the zlib or gzip stream to decompress.
+ *
+ * \return the decompressed data.
+ */
+std::vector<uint8_t> libdeflate_decompress_buffer(std::span<const uint8_t> input) {
+	thread_local std::unique_ptr<libdeflate_decompressor, decompressor_deleter> decompressor;
+	thread_local double ratio = 4.0;
+	if(!decompressor) {
+		decompressor.reset(libdeflate_alloc_decompressor());
+		if(!decompressor) {
+			throw std::bad_alloc();
+		}
+	}
+	bool gzip = input.size() >= 2 && input[0] == 0x1F && input[1] == 0x8B;
+	std::size_t guess = static_cast<std::size_t>(static_cast<double>(input.size()) * ratio * RATIO_HEADROOM);
+	if(gzip && input.size() >= 18) {
+		guess = input[input.size() - 4] | std::size_t{input[input.size() - 3]} << 8 | std::size_t{input[input.size() - 2]} << 16 | std::size_t{input[input.size() - 1]} << 24;
+	}
+	guess = std::min(guess, input.size() * MAX_DEFLATE_RATIO);
+	std::vector<uint8_t> output(std::max<std::size_t>(guess, 4096));
+	for(;;) {
+		std::size_t input_used, output_used;
+		libdeflate_result rc = gzip ? libdeflate_gzip_decompress_ex(decompressor.get(), input.data(), input.size(), output.data(), output.size(), &input_used, &output_used) : libdeflate_zlib_decompress_ex(decompressor.get(), input.data(), input.size(), output.data(), output.size(), &input_used, &output_used);
+		switch(rc) {
+			case LIBDEFLATE_SUCCESS:
+				if(!gzip && input_used) {
+					ratio += (static_cast<double>(output_used) / static_cast<double>(input_used) - ratio) * RATIO_WEIGHT;
+				}
+				output.resize(output_used);
+				return output;
+			case LIBDEFLATE_INSUFFICIENT_SPACE:
+				output.resize(output.size() * 2);
+				break;
+			default:
+				throw std::runtime_error("inflate: malformed zlib stream.");
+		}
+	}
+}
+#endif
+
+/**
+ * \brief The size of the buffers used when streaming a file through zlib.
+ */
+constexpr std::size_t STREAM_BUFFER_SIZE = 65536;
+
+/**
+ * \brief Throws the exception corresponding to an inflate error code.
+ *
+ * \param[in] zlib_rc the code returned by \c inflate.
+ */
+[[noreturn]] void throw_inflate_error(int zlib_rc) {
+	switch(zlib_rc) {
+		case Z_MEM_ERROR:
+			throw std::bad_alloc();
+		case Z_BUF_ERROR:
+			throw std::runtime_error("inflate: truncated zlib stream.");
+		case Z_NEED_DICT:
+		case Z_DATA_ERROR:
+			throw std::runtime_error("inflate: malformed zlib stream.");
+		default:
+			throw std::logic_error("Internal error: inflate returned unknown error code.");
+	}
+}
+
+/**
+ * \brief Compresses a file into a zlib or gzip stream, a buffer at a time.
+ *
+ * \param[in] input the file to compress, read from its current position to
+ * the end.
+ *
+ * \param[in] output the file to write the stream to.
+ *
+ * \param[in] level the zlib compression level to use.
+ *
+ * \param[in] fmt the framing to wrap the compressed data in.
+ */
+void compress_stream(const file_descriptor &input, const file_descriptor &output, int level, format fmt) {
+	z_stream stream{};
+	switch(deflateInit2(&stream, level, Z_DEFLATED, fmt == FORMAT_GZIP ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY)) {
+		case Z_OK:
+			break;
+		case Z_MEM_ERROR:
+			throw std::bad_alloc();
+		case Z_STREAM_ERROR:
+			throw std::logic_error("Internal error: compression level was invalid.");
+		default:
+			throw std::logic_error("Internal error: deflateInit2 failed.");
+	}
+	std::unique_ptr<z_stream, decltype(&deflateEnd)> guard(&stream, &deflateEnd);
+	std::array<uint8_t, STREAM_BUFFER_SIZE> input_buffer, output_buffer;
+	int flush;
+	do {
+		std::size_t input_length = input.read_some(input_buffer.data(), input_buffer.size());
+		flush = input_length ? Z_NO_FLUSH : Z_FINISH;
+		stream.next_in = input_buffer.data();
+		stream.avail_in = static_cast<uInt>(input_length);
+		do {
+			stream.next_out = output_buffer.data();
+			stream.avail_out = static_cast<uInt>(output_buffer.size());
+			if(deflate(&stream, flush) == Z_STREAM_ERROR) {
+				throw std::logic_error("Internal error: deflate stream state was inconsistent.");
+			}
+			output.write(output_buffer.data(), output_buffer.size() - stream.avail_out);
+		} while(!stream.avail_out);
+	} while(flush != Z_FINISH);
+}
+
+/**
+ * \brief Decompresses a zlib or gzip stream from a file, a buffer at a time.
+ *
+ * The framing is detected automatically. Any data following the end of the
+ * stream is ignored.
+ *
+ * \param[in] input the file to decompress, read from its current position.
+ *
+ * \param[in] output the file to write the decompressed data to, or null to
+ * only check the stream.
+ */
+void decompress_stream(const file_descriptor &input, const file_descriptor *output) {
+	z_stream stream{};
+	switch(inflateInit2(&stream, 15 + 32)) {
+		case Z_OK:
+			break;
+		case Z_MEM_ERROR:
+			throw std::bad_alloc();
+		default:
+			throw std::logic_error("Internal error: inflateInit2 failed.");
+	}
+	std::unique_ptr<z_stream, decltype(&inflateEnd)> guard(&stream, &inflateEnd);
+	std::array<uint8_t, STREAM_BUFFER_SIZE> input_buffer, output_buffer;
+	for(int zlib_rc = Z_OK; zlib_rc != Z_STREAM_END;) {
+		std::size_t input_length = input.read_some(input_buffer.data(), input_buffer.size());
+		if(!input_length) {
+			throw_inflate_error(Z_BUF_ERROR);
+		}
+		stream.next_in = input_buffer.data();
+		stream.avail_in = static_cast<uInt>(input_length);
+		do {
+			stream.next_out = output_buffer.data();
+			stream.avail_out = static_cast<uInt>(output_buffer.size());
+			// Z_BUF_ERROR here only means the output buffer filled exactly and
+			// there was nothing more to do without further input.
+			zlib_rc = inflate(&stream, Z_NO_FLUSH);
+			if(zlib_rc != Z_OK && zlib_rc != Z_STREAM_END && zlib_rc != Z_BUF_ERROR) {
+				throw_inflate_error(zlib_rc);
+			}
+			if(output) {
+				output->write(output_buffer.data(), output_buffer.size() - stream.avail_out);
+			}
+		} while(zlib_rc != Z_STREAM_END && (stream.avail_in || !stream.avail_out));
+	}
+}
+
+/**
+ * \brief The amount of input compressed as one independent block when
+ * compressing in parallel.
+ */
+constexpr std::size_t PARALLEL_BLOCK_SIZE = 131072;
+
+/**
+ * \brief The size of the deflate window, and thus of the preceding data
+ * given to each parallel block as a dictionary.
+ */
+constexpr std::size_t WINDOW_SIZE = 32768;
+
+/**
+ * \brief One block of a parallel compression, once compressed.
+ */
+struct compressed_block final {
+	/**
+	 * \brief The raw deflate data.
+	 */
+	std::vector<uint8_t> data;
+
+	/**
+	 * \brief The Adler-32 or CRC-32 of the block’s uncompressed data.
+	 */
+	uLong check;
+};
+
+/**
+ * \brief Compresses one block of a larger input as raw deflate data that can
+ * be concatenated with its neighbours.
+ *
+ * A block other than the last ends with a sync flush, which aligns it to a
+ * byte boundary without ending the deflate stream.
+ *
+ * \param[in] dictionary the input immediately preceding the block, at most
+ * one window long.
+ *
+ * \param[in] input the block to compress.
+ *
+ * \param[in] level the zlib compression level to use.
+ *
+ * \param[in] fmt the framing the block will be wrapped in, which determines
+ * the checksum computed.
+ *
+ * \param[in] last whether this is the last block of the input.
+ *
+ * \return the compressed block.
+ */
+compressed_block deflate_block(std::span<const uint8_t> dictionary, std::span<const uint8_t> input, int level, format fmt, bool last) {
+	z_stream stream{};
+	switch(deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY)) {
+		case Z_OK:
+			break;
+		case Z_MEM_ERROR:
+			throw std::bad_alloc();
+		case Z_STREAM_ERROR:
+			throw std::logic_error("Internal error: compression level was invalid.");
+		default:
+			throw std::logic_error("Internal error: deflateInit2 failed.");
+	}
+	std::unique_ptr<z_stream, decltype(&deflateEnd)> guard(&stream, &deflateEnd);
+	if(!dictionary.empty()) {
+		deflateSetDictionary(&stream, dictionary.data(), static_cast<uInt>(dictionary.size()));
+	}
+
+	// The bound covers the data and a stream end; a sync flush marker is at
+	// most a few bytes more.
+	compressed_block ret;
+	ret.data.resize(deflateBound(&stream, static_cast<uLong>(input.size())) + 16);
+	stream.next_in = const_cast<Bytef *>(input.data());
+	stream.avail_in = static_cast<uInt>(input.size());
+	stream.next_out = ret.data.data();
+	stream.avail_out = static_cast<uInt>(ret.data.size());
+	int zlib_rc = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+	if(last ? zlib_rc != Z_STREAM_END : (zlib_rc != Z_OK || !stream.avail_out)) {
+		throw std::logic_error("Internal error: supposedly-sufficient compression buffer was insufficient.");
+	}
+	ret.data.resize(stream.total_out);
+	ret.check = fmt == FORMAT_GZIP ? crc32(crc32(0, nullptr, 0), input.data(), static_cast<uInt>(input.size())) : adler32(adler32(0, nullptr, 0), input.data(), static_cast<uInt>(input.size()));
+	return ret;
+}
+
+/**
+ * \brief Builds the header of a zlib or gzip stream, as zlib itself would
+ * for the same compression level.
+ *
+ * \param[in] level the zlib compression level in use.
+ *
+ * \param[in] fmt the framing.
+ *
+ * \return the header.
+ */
+std::vector<uint8_t> stream_header(int level, format fmt) {
+	if(fmt == FORMAT_GZIP) {
+		// Magic, method, no flags, no timestamp, extra flags, Unix.
+		uint8_t extra_flags = level == 9 ? 2 : level == 1 ? 4 : 0;
+		return {0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, extra_flags, 0x03};
+	} else {
+		// Deflate with a 32 KiB window, the level hint, and the check bits.
+		unsigned int level_hint = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+		unsigned int header = 0x7800 | (level_hint << 6);
+		header += 31 - header % 31;
+		return {static_cast<uint8_t>(header >> 8), static_cast<uint8_t>(header)};
+	}
+}
+}
+}
+
+/**
+ * \brief Parses a backend name given on the command line.
+ *
+ * \param[in] name the name, \c zlib or \c libdeflate.
+ *
+ * \return the backend, or nothing if \p name is not recognized.
+ */
+std::optional<mcwutil::zlib::backend> mcwutil::zlib::parse_backend(std::string_view name) {
+	if(name == "zlib"sv) {
+		return BACKEND_ZLIB;
+	} else if(name == "libdeflate"sv) {
+		return BACKEND_LIBDEFLATE;
+	} else {
+		return std::nullopt;
+	}
+}
+
+/**
+ * \brief Selects the library used for whole-buffer compression and
+ * decompression from now on.
+ *
+ * The default is libdeflate if support for it was built in, or zlib if not.
+ * Either way, the compressed data is in the same format.
+ *
+ * \param[in] b the backend to use.
+ *
+ * \exception std::runtime_error if \p b is libdeflate and support for it was
+ * not built in.
+ */
+void mcwutil::zlib::set_backend(backend b) {
+#ifndef MCWUTIL_LIBDEFLATE
+	if(b == BACKEND_LIBDEFLATE) {
+		throw std::runtime_error("libdeflate support was not built in.");
+	}
+#endif
+	selected_backend = b;
+}
+
+/**
+ * \brief Compresses an in-memory buffer into a zlib or gzip stream.
+ *
+ * \param[in] input the data to compress.
+ *
+ * \param[in] level the zlib compression level to use.
+ *
+ * \param[in] fmt the framing to wrap the compressed data in.
+ *
+ * \param[in] strat the deflate strategy to use. libdeflate has no strategies,
+ * so only the default strategy uses the libdeflate backend.
+ *
+ * \return the compressed data.
+ */
+std::vector<uint8_t> mcwutil::zlib::compress_buffer(std::span<const uint8_t> input, int level, format fmt, strategy strat) {
+#ifdef MCWUTIL_LIBDEFLATE
+	if(selected_backend == BACKEND_LIBDEFLATE && strat == STRATEGY_DEFAULT) {
+		return libdeflate_compress_buffer(input, level, fmt);
+	}
+#endif
+	if(input.size() > std::numeric_limits<uInt>::max()) {
+		throw std::runtime_error("Buffer too large to compress.");
+	}
+	z_stream stream{};
+	int zlib_strategy = strat == STRATEGY_FILTERED ? Z_FILTERED : strat == STRATEGY_RLE ? Z_RLE : Z_DEFAULT_STRATEGY;
+	switch(deflateInit2(&stream, level, Z_DEFLATED, fmt == FORMAT_GZIP ? 15 + 16 : 15, 8, zlib_strategy)) {
+		case Z_OK:
+			break;
+		case Z_MEM_ERROR:
+			throw std::bad_alloc();
+		case Z_STREAM_ERROR:
+			throw std::logic_error("Internal error: compression level was invalid.");
+		default:
+			throw std::logic_error("Internal error: deflateInit2 failed.");
+	}
+	std::vector<uint8_t> output(deflateBound(&stream, static_cast<uLong>(input.size())));
+	stream.next_in = const_cast<Bytef *>(input.data());
+	stream.avail_in = static_cast<uInt>(input.size());
+	stream.next_out = output.data();
+	stream.avail_out = static_cast<uInt>(output.size());
+	int zlib_rc = deflate(&stream, Z_FINISH);
+	output.resize(stream.total_out);
+	deflateEnd(&stream);
+	if(zlib_rc != Z_STREAM_END) {
+		throw std::logic_error("Internal error: supposedly-sufficient compression buffer was insufficient.");
+	}
+	return output;
+}
+
+/**
+ * \brief Compresses an in-memory buffer several ways and keeps the smallest
+ * result.
+ *
+ * A higher level does not always give smaller output, and which strategy
+ * wins depends on the data, so a handful of combinations are tried. With the
+ * libdeflate backend, its highest level is tried as well.
+ *
+ * \param[in] input the data to compress.
+ *
+ * \param[in] fmt the framing to wrap the compressed data in.
+ *
+ * \return the smallest compressed data found.
+ */
+std::vector<uint8_t> mcwutil::zlib::compress_buffer_smallest(std::span<const uint8_t> input, format fmt) {
+	static constexpr std::pair<int, strategy> CANDIDATES[] = {
+		{9, STRATEGY_DEFAULT},
+		{9, STRATEGY_FILTERED},
+		{6, STRATEGY_DEFAULT},
+		{6, STRATEGY_FILTERED},
+		{9, STRATEGY_RLE},
+	};
+	std::vector<uint8_t> best;
+	for(const auto &[level, strat] : CANDIDATES) {
+		std::vector<uint8_t> candidate = compress_buffer(input, level, fmt, strat);
+		if(best.empty() || candidate.size() < best.size()) {
+			best = std::move(candidate);
+		}
+	}
+#ifdef MCWUTIL_LIBDEFLATE
+	if(selected_backend == BACKEND_LIBDEFLATE) {
+		std::vector<uint8_t> candidate = libdeflate_compress_buffer(input, 12, fmt);
+		if(candidate.size() < best.size()) {
+			best = std::move(candidate);
+		}
+	}
+#endif
+	return best;
+}
+
+/**
+ * \brief Decompresses an in-memory zlib or gzip stream.
+ *
+ * The framing is detected automatically. The stream is inflated in a single
+ * pass, growing the output buffer as needed.
+ *
+ * \param[in] input the zlib or gzip stream to decompress.
+ *
+ * \return the decompressed data.
+ */
+std::vector<uint8_t> mcwutil::zlib::decompress_buffer(std::span<const uint8_t> input) {
+#ifdef MCWUTIL_LIBDEFLATE
+	if(selected_backend == BACKEND_LIBDEFLATE) {
+		return libdeflate_decompress_buffer(input);
+	}
+#endif
+	if(input.size() > std::numeric_limits<uInt>::max()) {
+		throw std::runtime_error("Buffer too large to decompress.");
+	}
+	z_stream stream{};
+	switch(inflateInit2(&stream, 15 + 32)) {
+		case Z_OK:
+			break;
+		case Z_MEM_ERROR:
+			throw std::bad_alloc();
+		default:
+			throw std::logic_error("Internal error: inflateInit2 failed.");
+	}
+	std::vector<uint8_t> output(std::max<std::size_t>(input.size() * 4, 4096));
+	stream.next_in = const_cast<Bytef *>(input.data());
+	stream.avail_in = static_cast<uInt>(input.size());
+	for(;;) {
+		if(stream.total_out == output.size()) {
+			output.resize(output.size() * 2);
+		}
+		std::size_t space = std::min<std::size_t>(output.size() - stream.total_out, std::numeric_limits<uInt>::max());
+		stream.next_out = output.data() + stream.total_out;
+		stream.avail_out = static_cast<uInt>(space);
+		int zlib_rc = inflate(&stream, Z_NO_FLUSH);
+		if(zlib_rc == Z_STREAM_END) {
+			break;
+		} else if(zlib_rc == Z_OK || (zlib_rc == Z_BUF_ERROR && !stream.avail_out)) {
+			// Keep going.
+		} else {
+			inflateEnd(&stream);
+			throw_inflate_error(zlib_rc);
+		}
+	}
+	output.resize(stream.total_out);
+	inflateEnd(&stream);
+	return output;
+}
+
+/**
+ * \brief Compresses a file into a zlib or gzip stream on several threads.
+ *
+ * As in pigz, the input is cut into fixed-size blocks, each compressed
+ * separately with the data preceding it as a dictionary, and the checksums
+ * of the blocks are combined into one for the whole stream. The output is a
+ * single ordinary stream, which is the same whatever the number of threads.
+ * Only a bounded number of blocks are held in memory at once.
+ *
+ * \param[in] input the file to compress, read from its current position to
+ * the end.
+ *
+ * \param[in] output the file to write the stream to.
+ *
+ * \param[in] level the zlib compression level to use.
+ *
+ * \param[in] fmt the framing to wrap the compressed data in.
+ *
+ * \param[in] jobs the number of threads to use.
+ */
+void mcwutil::zlib::compress_parallel(const file_descriptor &input, const file_descriptor &output, int level, format fmt, unsigned int jobs) {
+	std::vector<uint8_t> header = stream_header(level, fmt);
+	output.write(header.data(), header.size());
+
+	// Each batch holds the last window of the previous batch, followed by as
+	// many blocks as can usefully be compressed at once. One byte more than
+	// that is read, so that the last block can be recognized as such without
+	// relying on where the batches happen to end.
+	const std::size_t batch_size = std::size_t{jobs} * 4 * PARALLEL_BLOCK_SIZE;
+	std::vector<uint8_t> buffer;
+	std::size_t history = 0, carried = 0;
+	uLong check = fmt == FORMAT_GZIP ? crc32(0, nullptr, 0) : adler32(0, nullptr, 0);
+	uint64_t total = 0;
+	for(bool last = false; !last;) {
+		// Fill the batch, noticing whether the input ran out.
+		buffer.resize(history + batch_size + 1);
+		std::size_t filled = history + carried;
+		while(filled != buffer.size()) {
+			std::size_t n = input.read_some(buffer.data() + filled, buffer.size() - filled);
+			if(!n) {
+				last = true;
+				break;
+			}
+			filled += n;
+		}
+		std::size_t end = last ? filled : filled - 1;
+		std::size_t blocks = std::max<std::size_t>((end - history + PARALLEL_BLOCK_SIZE - 1) / PARALLEL_BLOCK_SIZE, 1);
+
+		// Compress the blocks.
+		std::vector<compressed_block> compressed(blocks);
+		parallel::for_each(blocks, jobs, [&](std::size_t i) {
+			std::size_t start = history + i * PARALLEL_BLOCK_SIZE;
+			std::size_t length = std::min(PARALLEL_BLOCK_SIZE, end - start);
+			std::size_t dictionary_start = start - std::min(start, WINDOW_SIZE);
+			std::span<const uint8_t> dictionary(buffer.data() + dictionary_start, start - dictionary_start);
+			compressed[i] = deflate_block(dictionary, std::span<const uint8_t>(buffer.data() + start, length), level, fmt, last && i == blocks - 1);
+		});
+
+		// Write them out in order.
+		for(std::size_t i = 0; i != blocks; ++i) {
+			std::size_t length = std::min(PARALLEL_BLOCK_SIZE, end - (history + i * PARALLEL_BLOCK_SIZE));
+			output.write(compressed[i].data.data(), compressed[i].data.size());
+			check = fmt == FORMAT_GZIP ? crc32_combine(check, compressed[i].check, static_cast<z_off_t>(length)) : adler32_combine(check, compressed[i].check, static_cast<z_off_t>(length));
+			total += length;
+		}
+
+		// Keep the last window as the dictionary for the next batch, followed
+		// by the extra byte.
+		std::size_t keep = std::min(end, WINDOW_SIZE);
+		std::copy(buffer.begin() + static_cast<std::ptrdiff_t>(end - keep), buffer.begin() + static_cast<std::ptrdiff_t>(filled), buffer.begin());
+		history = keep;
+		carried = filled - end;
+	}
+
+	// Write the trailer.
+	if(fmt == FORMAT_GZIP) {
+		uint8_t trailer[8];
+		for(std::size_t i = 0; i != 4; ++i) {
+			trailer[i] = static_cast<uint8_t>(check >> (8 * i));
+			trailer[4 + i] = static_cast<uint8_t>(total >> (8 * i));
+		}
+		output.write(trailer, sizeof(trailer));
+	} else {
+		uint8_t trailer[4];
+		codec::encode_integer<uint32_t, 4>(trailer, static_cast<uint32_t>(check));
+		output.write(trailer, sizeof(trailer));
+	}
+}
 
 /**
  * \brief Entry point for the \c zlib-compress utility.
@@ -18,45 +668,42 @@
  */
 int mcwutil::zlib::compress(std::string_view appname, std::span<char *> args) {
 	// Check parameters.
-	if(args.size() != 2) {
+	format fmt = FORMAT_ZLIB;
+	std::optional<unsigned int> jobs;
+	for(;;) {
+		if(!args.empty() && args[0] == "--gzip"sv) {
+			fmt = FORMAT_GZIP;
+			args = args.subspan(1);
+		} else if(args.size() >= 2 && args[0] == "--jobs"sv) {
+			jobs = parallel::parse_jobs(args[1]).value_or(0);
+			args = args.subspan(2);
+		} else {
+			break;
+		}
+	}
+	if(args.size() != 2 || jobs == 0U) {
 		std::cerr << "Usage:\n";
-		std::cerr << appname << " zlib-compress inputfile outputfile\n";
+		std::cerr << appname << " zlib-compress [--gzip] [--jobs N] inputfile outputfile\n";
 		std::cerr << '\n';
 		std::cerr << "Compresses a file with zlib.\n";
 		std::cerr << '\n';
 		std::cerr << "Arguments:\n";
+		std::cerr << "  --gzip - write a gzip stream rather than a zlib stream\n";
+		std::cerr << "  --jobs - compress 128 KiB blocks on N threads (0 means one per CPU), as pigz does; the output is a single\n";
+		std::cerr << "           ordinary stream, slightly larger than without this option, and the same for any N\n";
 		std::cerr << "  inputfile - the file to compress\n";
 		std::cerr << "  outputfile - the file to compress into\n";
 		return 1;
 	}
 
-	// Read input file.
+	// Stream the input file through the compressor.
 	file_descriptor input_fd = file_descriptor::create_open(args[0], O_RDONLY, 0);
-	struct stat stbuf;
-	input_fd.fstat(stbuf);
-	unsigned char input_buffer[stbuf.st_size];
-	input_fd.read(input_buffer, sizeof(input_buffer));
-
-	// Compress data.
-	unsigned char output_buffer[compressBound(sizeof(input_buffer))];
-	unsigned long output_length = sizeof(output_buffer);
-	int zlib_rc = compress2(output_buffer, &output_length, input_buffer, sizeof(input_buffer), 9);
-	switch(zlib_rc) {
-		case Z_OK:
-			break;
-		case Z_MEM_ERROR:
-			throw std::bad_alloc();
-		case Z_BUF_ERROR:
-			throw std::logic_error("Internal error: supposedly-sufficient compression buffer was insufficient.");
-		case Z_STREAM_ERROR:
-			throw std::logic_error("Internal error: known-valid compression level was invalid.");
-		default:
-			throw std::logic_error("Internal error: compress2 returned unknown error code.");
-	}
-
-	// Write output file.
 	file_descriptor output_fd = file_descriptor::create_open(args[1], O_WRONLY | O_TRUNC | O_CREAT, 0666);
-	output_fd.write(output_buffer, output_length);
+	if(jobs) {
+		compress_parallel(input_fd, output_fd, 9, fmt, *jobs);
+	} else {
+		compress_stream(input_fd, output_fd, 9, fmt);
+	}
 	output_fd.close();
 
 	return 0;
@@ -77,7 +724,7 @@ int mcwutil::zlib::decompress(std::string_view appname, std::span<char *> args)
 		std::cerr << "Usage:\n";
 		std::cerr << appname << " zlib-decompress inputfile outputfile\n";
 		std::cerr << '\n';
-		std::cerr << "Decompresses a zlib-compressed file.\n";
+		std::cerr << "Decompresses a zlib- or gzip-compressed file, detecting which automatically.\n";
 		std::cerr << '\n';
 		std::cerr << "Arguments:\n";
 		std::cerr << "  inputfile - the file to decompress\n";
@@ -85,43 +732,10 @@ int mcwutil::zlib::decompress(std::string_view appname, std::span<char *> args)
 		return 1;
 	}
 
-	// Read input file.
+	// Stream the input file through the decompressor.
 	file_descriptor input_fd = file_descriptor::create_open(args[0], O_RDONLY, 0);
-	struct stat stbuf;
-	input_fd.fstat(stbuf);
-	unsigned char input_buffer[stbuf.st_size];
-	input_fd.read(input_buffer, sizeof(input_buffer));
-
-	// Decompress data.
-	std::vector<unsigned char> output_buffer(sizeof(input_buffer) * 4);
-	bool done = false;
-	while(!done) {
-		unsigned long output_length = output_buffer.size();
-		int zlib_rc = uncompress(&output_buffer[0], &output_length, input_buffer, sizeof(input_buffer));
-		switch(zlib_rc) {
-			case Z_OK:
-				output_buffer.resize(output_length);
-				done = true;
-				break;
-
-			case Z_MEM_ERROR:
-				throw std::bad_alloc();
-
-			case Z_BUF_ERROR:
-				output_buffer.resize(output_buffer.size() * 2);
-				break;
-
-			case Z_DATA_ERROR:
-				throw std::runtime_error("uncompress: malformed zlib stream.");
-
-			default:
-				throw std::logic_error("Internal error: uncompress returned unknown error code.");
-		}
-	}
-
-	// Write output file.
 	file_descriptor output_fd = file_descriptor::create_open(args[1], O_WRONLY | O_TRUNC | O_CREAT, 0666);
-	output_fd.write(&output_buffer[0], output_buffer.size());
+	decompress_stream(input_fd, &output_fd);
 	output_fd.close();
 
 	return 0;
@@ -142,46 +756,16 @@ int mcwutil::zlib::check(std::string_view appname, std::span<char *> args) {
 		std::cerr << "Usage:\n";
 		std::cerr << appname << " zlib-check inputfile\n";
 		std::cerr << '\n';
-		std::cerr << "Decompresses a zlib-compressed file, discarding the contents.\n";
+		std::cerr << "Decompresses a zlib- or gzip-compressed file, discarding the contents.\n";
 		std::cerr << '\n';
 		std::cerr << "Arguments:\n";
 		std::cerr << "  inputfile - the file to decompress\n";
 		return 1;
 	}
 
-	// Read input file.
+	// Stream the input file through the decompressor, discarding the output.
 	file_descriptor input_fd = file_descriptor::create_open(args[0], O_RDONLY, 0);
-	struct stat stbuf;
-	input_fd.fstat(stbuf);
-	unsigned char input_buffer[stbuf.st_size];
-	input_fd.read(input_buffer, sizeof(input_buffer));
-
-	// Decompress data.
-	std::vector<unsigned char> output_buffer(sizeof(input_buffer) * 4);
-	bool done = false;
-	while(!done) {
-		unsigned long output_length = output_buffer.size();
-		int zlib_rc = uncompress(&output_buffer[0], &output_length, input_buffer, sizeof(input_buffer));
-		switch(zlib_rc) {
-			case Z_OK:
-				output_buffer.resize(output_length);
-				done = true;
-				break;
-
-			case Z_MEM_ERROR:
-				throw std::bad_alloc();
-
-			case Z_BUF_ERROR:
-				output_buffer.resize(output_buffer.size() * 2);
-				break;
-
-			case Z_DATA_ERROR:
-				throw std::runtime_error("uncompress: malformed zlib stream.");
-
-			default:
-				throw std::logic_error("Internal error: uncompress returned unknown error code.");
-		}
-	}
+	decompress_stream(input_fd, nullptr);
 
 	return 0;
 }
@@ -1,17 +1,84 @@
 #ifndef ZLIB_UTILS_H
 #define ZLIB_UTILS_H
 
+#include <mcwutil/util/file_descriptor.hpp>
+#include <cstdint>
+#include <optional>
 #include <span>
 #include <string_view>
+#include <vector>
 
 namespace mcwutil {
 /**
  * \brief Symbols related to the ZLib compression format.
  */
 namespace zlib {
+/**
+ * \brief The possible framings of a deflate stream.
+ */
+enum format {
+	/**
+	 * \brief A zlib stream (RFC 1950), with an Adler-32 checksum.
+	 */
+	FORMAT_ZLIB,
+
+	/**
+	 * \brief A gzip stream (RFC 1952), with a CRC-32 checksum.
+	 */
+	FORMAT_GZIP,
+};
+
+/**
+ * \brief The deflate strategies that may be requested.
+ */
+enum strategy {
+	/**
+	 * \brief The normal strategy, suited to most data.
+	 */
+	STRATEGY_DEFAULT,
+
+	/**
+	 * \brief Favours Huffman coding over string matching, which can suit data
+	 * made of small values with a somewhat random distribution.
+	 */
+	STRATEGY_FILTERED,
+
+	/**
+	 * \brief Limits matches to runs of a single repeated byte.
+	 */
+	STRATEGY_RLE,
+};
+
+/**
+ * \brief The libraries that can carry out whole-buffer compression and
+ * decompression.
+ *
+ * Streaming operations always use zlib.
+ */
+enum backend {
+	/**
+	 * \brief zlib itself.
+	 */
+	BACKEND_ZLIB,
+
+	/**
+	 * \brief libdeflate, which is faster on small buffers such as chunks, if
+	 * support for it was built in.
+	 */
+	BACKEND_LIBDEFLATE,
+};
+
+std::optional<backend> parse_backend(std::string_view name);
+void set_backend(backend b);
+
 int compress(std::string_view appname, std::span<char *> args);
 int decompress(std::string_view appname, std::span<char *> args);
 int check(std::string_view appname, std::span<char *> args);
+
+std::vector<uint8_t> compress_buffer(std::span<const uint8_t> input, int level, format fmt, strategy strat = STRATEGY_DEFAULT);
+std::vector<uint8_t> compress_buffer_smallest(std::span<const uint8_t> input, format fmt);
+std::vector<uint8_t> decompress_buffer(std::span<const uint8_t> input);
+void compress_parallel(const file_descriptor &input, const file_descriptor &output, int level, format fmt, unsigned int jobs);
 }
 }
 
@@ -0,0 +1,196 @@
+#include <mcwutil/util/codec.hpp>
+#include <mcwutil/util/file_descriptor.hpp>
+#include <mcwutil/zlib_utils.hpp>
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cstddef>
+#include <cstdint>
+#include <fcntl.h>
+#include <filesystem>
+#include <string_view>
+#include <sys/stat.h>
+#include <vector>
+#include <zlib.h>
+
+using namespace std::literals::string_view_literals;
+
+namespace mcwutil::zlib {
+namespace {
+/**
+ * \brief The size of the blocks that parallel compression cuts its input
+ * into.
+ */
+constexpr std::size_t BLOCK_SIZE = 131072;
+
+/**
+ * \brief Verifies that parallel compression produces valid streams.
+ */
+class compress_parallel_test final : public CppUnit::TestFixture {
+	public:
+	CPPUNIT_TEST_SUITE(compress_parallel_test);
+	CPPUNIT_TEST(test_round_trip_zlib);
+	CPPUNIT_TEST(test_round_trip_gzip);
+	CPPUNIT_TEST(test_trailer_zlib);
+	CPPUNIT_TEST(test_trailer_gzip);
+	CPPUNIT_TEST(test_jobs_independent);
+	CPPUNIT_TEST_SUITE_END();
+
+	private:
+	void test_round_trip_zlib();
+	void test_round_trip_gzip();
+	void test_trailer_zlib();
+	void test_trailer_gzip();
+	void test_jobs_independent();
+};
+
+/**
+ * \brief Generates compressible test data.
+ *
+ * The data is made of words picked pseudo-randomly from a small vocabulary,
+ * so that many matches reach back across block boundaries into the preceding
+ * window.
+ *
+ * \param[in] size the number of bytes to generate.
+ *
+ * \return the data.
+ */
+std::vector<uint8_t> make_data(std::size_t size) {
+	static constexpr std::string_view words[] = {"stone "sv, "dirt "sv, "grass "sv, "oak log "sv, "cobblestone "sv, "bedrock "sv, "water "sv, "lava "sv};
+	std::vector<uint8_t> ret;
+	ret.reserve(size);
+	uint32_t state = 12345;
+	while(ret.size() < size) {
+		state = state * 1103515245 + 12345;
+		std::string_view word = words[(state >> 16) % std::size(words)];
+		for(std::size_t i = 0; i != word.size() && ret.size() < size; ++i) {
+			ret.push_back(static_cast<uint8_t>(word[i]));
+		}
+	}
+	return ret;
+}
+
+/**
+ * \brief Opens an anonymous temporary file.
+ *
+ * \return the file.
+ */
+file_descriptor temporary_file() {
+	return file_descriptor::create_open(std::filesystem::temp_directory_path(), O_RDWR | O_TMPFILE, 0600);
+}
+
+/**
+ * \brief Compresses a buffer with \ref compress_parallel.
+ *
+ * \param[in] data the data to compress.
+ *
+ * \param[in] fmt the framing to use.
+ *
+ * \param[in] jobs the number of threads to use.
+ *
+ * \return the compressed stream.
+ */
+std::vector<uint8_t> compress(const std::vector<uint8_t> &data, format fmt, unsigned int jobs) {
+	file_descriptor input = temporary_file();
+	input.pwrite(data.data(), data.size(), 0);
+	file_descriptor output = temporary_file();
+	compress_parallel(input, output, 9, fmt, jobs);
+	struct stat stbuf;
+	output.fstat(stbuf);
+	std::vector<uint8_t> ret(static_cast<std::size_t>(stbuf.st_size));
+	output.pread(ret.data(), ret.size(), 0);
+	return ret;
+}
+
+/**
+ * \brief The input sizes to test, chosen to fall on either side of block and
+ * batch boundaries.
+ */
+const std::size_t sizes[] = {
+	0,
+	1,
+	1000,
+	BLOCK_SIZE - 1,
+	BLOCK_SIZE,
+	BLOCK_SIZE + 1,
+	3 * BLOCK_SIZE + 5,
+	8 * BLOCK_SIZE,
+	8 * BLOCK_SIZE + 1,
+	19 * BLOCK_SIZE + 7,
+};
+
+/**
+ * \brief Checks that inputs of every test size survive a round trip.
+ *
+ * \param[in] fmt the framing to use.
+ */
+void check_round_trip(format fmt) {
+	for(std::size_t size : sizes) {
+		std::vector<uint8_t> data = make_data(size);
+		CPPUNIT_ASSERT(data == decompress_buffer(compress(data, fmt, 2)));
+	}
+}
+}
+}
+
+/**
+ * \brief Tests compressing inputs of various sizes into zlib streams.
+ */
+void mcwutil::zlib::compress_parallel_test::test_round_trip_zlib() {
+	check_round_trip(FORMAT_ZLIB);
+}
+
+/**
+ * \brief Tests compressing inputs of various sizes into gzip streams.
+ */
+void mcwutil::zlib::compress_parallel_test::test_round_trip_gzip() {
+	check_round_trip(FORMAT_GZIP);
+}
+
+/**
+ * \brief Tests that the Adler-32 combined from the blocks is that of the
+ * whole input.
+ */
+void mcwutil::zlib::compress_parallel_test::test_trailer_zlib() {
+	for(std::size_t size : sizes) {
+		std::vector<uint8_t> data = make_data(size);
+		std::vector<uint8_t> compressed = compress(data, FORMAT_ZLIB, 2);
+		uLong expected = adler32(adler32(0, nullptr, 0), data.data(), static_cast<uInt>(data.size()));
+		uint32_t check = codec::decode_integer<uint32_t, 4>(&compressed[compressed.size() - 4]);
+		CPPUNIT_ASSERT_EQUAL(static_cast<uint32_t>(expected), check);
+	}
+}
+
+/**
+ * \brief Tests that the CRC-32 combined from the blocks, and the length, are
+ * those of the whole input.
+ */
+void mcwutil::zlib::compress_parallel_test::test_trailer_gzip() {
+	for(std::size_t size : sizes) {
+		std::vector<uint8_t> data = make_data(size);
+		std::vector<uint8_t> compressed = compress(data, FORMAT_GZIP, 2);
+		uLong expected_crc = crc32(crc32(0, nullptr, 0), data.data(), static_cast<uInt>(data.size()));
+		uint32_t crc = 0;
+		uint32_t length = 0;
+		for(std::size_t i = 0; i != 4; ++i) {
+			crc |= uint32_t{compressed[compressed.size() - 8 + i]} << (8 * i);
+			length |= uint32_t{compressed[compressed.size() - 4 + i]} << (8 * i);
+		}
+		CPPUNIT_ASSERT_EQUAL(static_cast<uint32_t>(expected_crc), crc);
+		CPPUNIT_ASSERT_EQUAL(static_cast<uint32_t>(size), length);
+	}
+}
+
+/**
+ * \brief Tests that the output does not depend on the number of threads,
+ * which changes where batches end.
+ */
+void mcwutil::zlib::compress_parallel_test::test_jobs_independent() {
+	std::vector<uint8_t> data = make_data(19 * BLOCK_SIZE + 7);
+	std::vector<uint8_t> expected = compress(data, FORMAT_ZLIB, 1);
+	for(unsigned int jobs : {2U, 3U, 5U}) {
+		CPPUNIT_ASSERT(expected == compress(data, FORMAT_ZLIB, jobs));
+	}
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(mcwutil::zlib::compress_parallel_test);
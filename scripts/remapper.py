@@ -10,7 +10,6 @@ import subprocess
 import sys
 import tempfile
 import xml.etree.ElementTree
-import zlib
 
 class ConfigFile(object):
 	def load(base_dir, file_info):
@@ -743,15 +742,9 @@ def run(mcwutil_path, vanilla_block_ranges, vanilla_item_ranges, mod_info, remap
 									# Print progress.
 									print("\rProcessing region {}… chunk {} ({}/{})…".format(region, chunk, done + 1, len(chunks)), end="")
 
-									# We could shell out to mcwutil zlib-decompress, but doing it in-process is faster than forking.
-									with open(os.path.join(work_dir, "chunk-" + chunk + ".nbt.zlib"), "rb") as fp:
-										compressed_data = fp.read()
-									plain_data = zlib.decompress(compressed_data)
-									with open(os.path.join(work_dir, "chunk.nbt"), "wb") as fp:
-										fp.write(plain_data)
-
-									# Shell out to mcwutil nbt-to-xml.
-									subprocess.check_call([mcwutil_path, "nbt-to-xml", os.path.join(work_dir, "chunk.nbt"), os.path.join(work_dir, "chunk.xml")])
+									# Shell out to mcwutil nbt-to-xml, which reads the zlib-compressed chunk directly.
+									chunk_file = os.path.join(work_dir, "chunk-" + chunk + ".nbt.zlib")
+									subprocess.check_call([mcwutil_path, "nbt-to-xml", chunk_file, os.path.join(work_dir, "chunk.xml")])
 
 									# Process the XML file.
 									etree = xml.etree.ElementTree.parse(os.path.join(work_dir, "chunk.xml"))
@@ -759,15 +752,8 @@ def run(mcwutil_path, vanilla_block_ranges, vanilla_item_ranges, mod_info, remap
 										remapper.remap_chunk(etree, map_info)
 									etree.write(os.path.join(work_dir, "chunk.xml"), encoding="UTF-8")
 
-									# Shell out to mcwutil nbt-from-xml.
-									subprocess.check_call([mcwutil_path, "nbt-from-xml", os.path.join(work_dir, "chunk.xml"), os.path.join(work_dir, "chunk.nbt")])
-
-									# We could shell out to mcwutil zlib-compress, but doing it in-process is faster than forking.
-									with open(os.path.join(work_dir, "chunk.nbt"), "rb") as fp:
-										plain_data = fp.read()
-									compressed_data = zlib.compress(plain_data, 9)
-									with open(os.path.join(work_dir, "chunk-" + chunk + ".nbt.zlib"), "wb") as fp:
-										fp.write(compressed_data)
+									# Shell out to mcwutil nbt-from-xml, which writes the zlib-compressed chunk directly.
+									subprocess.check_call([mcwutil_path, "nbt-from-xml", "--zlib", os.path.join(work_dir, "chunk.xml"), chunk_file])
 
 									# Update progress.
 									done += 1